@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;        // Bytes in data
+    size_t used;
+    char data[];
+} ArenaChunk;
+
+// Bump allocator for short-lived objects such as records staged for an
+// insert. Nothing is freed on its own: arenaReset drops everything at
+// once and keeps the chunks for reuse, freeArena returns them.
+typedef struct {
+    ArenaChunk *chunks;     // First chunk
+    ArenaChunk *current;    // Chunk allocations are served from
+} Arena;
+
+// Function prototypes
+Arena *createArena(void);
+void freeArena(Arena *arena);
+void *arenaAlloc(Arena *arena, size_t size);
+void arenaReset(Arena *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,65 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define AIO_QUEUE_DEPTH 32           // Requests kept in flight
+#define AIO_REQUEST_SIZE (256 * 1024) // Bytes a save or load moves per request
+#define AIO_THREADS 4                // Workers of the fallback thread pool
+
+// One read or write in flight. `result` is 1 once it completed in full,
+// 0 if it failed.
+typedef struct AioRequest {
+    int write;
+    struct iovec iov;   // Buffer and size; io_uring reads the iovec itself
+    off_t offset;
+    void *tag;          // Handed back by aioWait
+    int result;
+    struct AioRequest *next;  // Free, queued or completed list
+} AioRequest;
+
+// Reads and writes of one file kept in flight together, so the device
+// works on many of them while the caller prepares the next ones. Requests
+// go through io_uring when the kernel offers it, and through a small pool
+// of threads doing pread/pwrite otherwise (or when built with
+// -DASYNC_IO_THREADS). One thread submits and waits; completions come
+// back in any order.
+typedef struct {
+    int fd;
+    int inFlight;
+    AioRequest requests[AIO_QUEUE_DEPTH];
+    AioRequest *free;
+
+    // io_uring, when ring >= 0
+    int ring;
+    void *sqMap, *cqMap;
+    size_t sqMapSize, cqMapSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+    unsigned unsubmitted;       // Queued on the ring but not yet taken by the kernel
+
+    // Thread pool otherwise
+    pthread_t threads[AIO_THREADS];
+    int threadCount;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;      // Signalled when `pending` gets a request
+    pthread_cond_t completed;   // Signalled when `done` gets one
+    AioRequest *pending, *pendingTail;
+    AioRequest *done;
+    int stopping;
+} AsyncIo;
+
+// Function prototypes
+AsyncIo *aioOpen(int fd);
+void aioClose(AsyncIo *io);
+int aioFull(const AsyncIo *io);
+int aioSubmit(AsyncIo *io, int write, void *buffer, size_t size, off_t offset, void *tag);
+int aioWait(AsyncIo *io, void **tag);
+int aioDrain(AsyncIo *io);
+
+#endif // ASYNC_IO_H
@@ -3,15 +3,108 @@
 
 #include "record.h"
 
+// Slotted block layout:
+//
+//   +-------------+--------+---------+---------+-----+- - - -+--------+--------+
+//   | BlockHeader | filter | Record0 | Record1 | ... |  free | slot 1 | slot 0 |
+//   +-------------+--------+---------+---------+-----+- - - -+--------+--------+
+//
+// Records (header + inline payload) are packed from the front, the slot
+// array grows down from the end and holds each record's offset in scan
+// order. Everything lives inside `data`, so a block can be written to disk
+// and read back byte-for-byte.
+//
+// The header keeps the smallest and largest id stored in the block, and
+// is followed by a Bloom filter over the ids, so a lookup can rule out a
+// block without reading its records. The filter takes a power of two
+// bytes, about 1/BLOCK_FILTER_RATIO of the block and at least
+// BLOCK_FILTER_MIN_BYTES. Inserts add their id to both. Deleting a record
+// leaves its id behind, which only costs a false positive, until
+// blockCompact rebuilds them from the live records.
+//
+// Blocks of fixed-length files put every record at a multiple of the same
+// stride and keep a copy of the ids in a key column ahead of them, so key
+// scans read consecutive ints instead of hopping from record to record:
+//
+//   +-------------+--------+------------+---------+---------+- - - -+--------+
+//   | BlockHeader | filter | key column | Record0 | Record1 |  free | slots  |
+//   +-------------+--------+------------+---------+---------+- - - -+--------+
+//
+// Key i belongs to the i-th record in the block's data, which is also the
+// i-th slot unless slots were inserted out of order (ordered files).
+//
+// A record too large for one block is stored in pieces, each a Record with
+// the record's id and a part of its data. The first piece is the last slot
+// of its block and every later piece is slot 0 of the block after the one
+// before, so the pieces are found without any pointers. All pieces but the
+// last carry RECORD_CONTINUED, all but the first RECORD_CONTINUATION.
+typedef struct {
+    int recordCount;    // Number of slots in use
+    int dataEnd;        // Offset one past the last record byte
+    int minKey;         // Smallest id stored since the block was last compacted, INT_MAX if none
+    int maxKey;         // Largest one, INT_MIN if none
+} BlockHeader;
+
+#define BLOCK_FILTER_RATIO 32       // Blocks give about 1/32 of their bytes to the filter
+#define BLOCK_FILTER_MIN_BYTES 8
+#define BLOCK_FILTER_PROBES 3       // Bits each id sets in the filter
+
+// Block flags
+#define BLOCK_MAPPED 0x1    // data points into a file mapping and is not owned
+#define BLOCK_DIRTY  0x2    // Changed since it was last written to disk
+#define BLOCK_TABLE  0x4    // data is a slot of a block table and is not owned
+#define BLOCK_PAGED  0x8    // data is a buffer pool frame, NULL while not resident
+
 typedef struct Block {
     char *data;         // Block data (dynamically allocated)
     int blockSize;      // Fixed size of the block
-    int freeSpace;      // Remaining space in the block
+    int freeSpace;      // Space between the last record and the slot array
+    int deadSpace;      // Space held by deleted or superseded records
     struct Block *next; // Pointer to the next block
+    struct Block *fsmPrev, *fsmNext; // Free-space map bucket links
+    int fsmBucket;      // Free-space map bucket, -1 when not tracked
+    int flags;          // BLOCK_* flags
+    int diskBlock;      // Stable slot in the saved file, -1 until first written
+    int recordSpace;    // Stride of fixed-length records, 0 for variable-length blocks
+    int position;       // Index in the file's block table, -1 outside contiguous files
+    int frame;          // Buffer pool frame holding the data, -1 unless paged in
+    int pins;           // Pins keeping it in its frame (see buffer_pool.h)
+    int spillSlot;      // Slot of its latest image in the spill file, -1 if none
 } Block;
 
 // Function prototypes
+void blockInit(Block *block, char *data, int blockSize, int flags);
+void blockFormat(Block *block);
 Block *createBlock(int blockSize);
+Block *createMappedBlock(char *data, int blockSize);
 void freeBlock(Block *block);
+void blockRefresh(Block *block);
+void blockImage(const Block *block, char *image);
+int blockCanHold(int blockSize, int dataSize);
+int blockKeyCapacity(int blockSize, int recordSpace);
+int blockSpaceNeeded(int recordSpace, int dataSize);
+int blockCapacity(const Block *block);
+int blockPieceSize(int freeSpace);
+int blockMaxPieceSize(int blockSize);
+int blockRecordLength(const Block *block, const Record *record);
+int blockReadData(const Block *block, const Record *record, char *data, int capacity);
+Record *blockJoinRecord(const Block *block, const Record *record, char **buffer, int *capacity);
+Record *blockCopyRecord(const Block *block, const Record *record, char **buffer, int *capacity);
+const int *blockKeys(const Block *block);
+Record *blockRecordAtPosition(const Block *block, int position);
+int blockFindKey(const Block *block, int key);
+int blockMayHoldKey(const Block *block, int key);
+int blockMayHoldRange(const Block *block, int low, int high);
+int blockRecordCount(const Block *block);
+int blockRecordOffset(const Block *block, int slot);
+Record *blockRecordAt(const Block *block, int slot);
+int blockFindSlot(const Block *block, int offset);
+int blockLowerBound(const Block *block, int key);
+int blockUpperBound(const Block *block, int key);
+int blockInsertRecord(Block *block, int slot, const Record *record, int slack);
+int blockUpdateRecord(Block *block, int slot, const char *data, int size);
+void blockDeleteRecord(Block *block, int slot);
+void blockCompact(Block *block);
+void blockSplit(Block *block, Block *right, int slot);
 
 #endif // BLOCK_H
@@ -0,0 +1,17 @@
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+// Compression of block images in the LZ4 block format: a run of
+// sequences, each a token, literal bytes copied as they are, and a match
+// copying earlier output at a 16-bit distance. Built with -DHAVE_LZ4 the
+// work is done by liblz4; otherwise a built-in greedy single-pass codec
+// reads and writes the same format.
+
+// Room codecCompress may need for `size` bytes, whatever they hold
+#define CODEC_BOUND(size) ((size) + (size) / 255 + 16)
+
+// Function prototypes
+int codecCompress(const char *source, int size, char *dest, int capacity);
+int codecDecompress(const char *source, int size, char *dest, int capacity);
+
+#endif // BLOCK_CODEC_H
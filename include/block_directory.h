@@ -0,0 +1,33 @@
+#ifndef BLOCK_DIRECTORY_H
+#define BLOCK_DIRECTORY_H
+
+#include "block.h"
+
+// Fence keys of one block of an ordered file
+typedef struct {
+    int minKey;         // Id of the block's first record
+    int maxKey;         // Id of the block's last record
+    Block *block;
+} DirectoryEntry;
+
+// One entry per block, in file order. Because an ordered file keeps its
+// blocks in key order, the entries are sorted by both fence keys and can
+// be binary searched to find the single block that may hold a key.
+typedef struct {
+    DirectoryEntry *entries;
+    int count;
+    int capacity;
+} BlockDirectory;
+
+// Function prototypes
+BlockDirectory *createDirectory(void);
+void freeDirectory(BlockDirectory *directory);
+void directoryClear(BlockDirectory *directory);
+void directoryInsert(BlockDirectory *directory, int pos, Block *block);
+void directoryInsertKeys(BlockDirectory *directory, int pos, Block *block, int minKey, int maxKey);
+void directoryRemove(BlockDirectory *directory, int pos);
+void directoryRefresh(BlockDirectory *directory, int pos);
+int directoryFind(const BlockDirectory *directory, int key);
+int directoryPosition(const BlockDirectory *directory, const Block *block);
+
+#endif // BLOCK_DIRECTORY_H
@@ -0,0 +1,45 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <stddef.h>
+#include "block.h"
+
+#define POOL_FIRST_SLAB 16           // Items in the first slab; each later slab doubles
+#define POOL_MAX_SLAB_SIZE (1 << 20) // Slabs stop growing at this many bytes
+#define POOL_ALIGNMENT 64            // Alignment of block data
+
+// Fixed-size items carved out of large slabs. Freed items go on a free
+// list threaded through their first bytes and are handed out again before
+// a new slab is allocated.
+typedef struct {
+    size_t itemSize;
+    void *freeList;     // Freed items
+    char *next;         // Unused part of the newest slab
+    char *end;
+    size_t slabItems;   // Items in the next slab
+    void **slabs;
+    int slabCount;
+    int slabCapacity;
+} SlabAllocator;
+
+// Blocks of one file: Block structs and block data come from two slab
+// allocators, so blocks wrapping a file mapping, a block table's slot or
+// a buffer pool frame take no data, and the whole pool is released slab
+// by slab instead of block by block.
+typedef struct {
+    int blockSize;
+    int recordSpace;        // Block::recordSpace of the pool's blocks
+    SlabAllocator blocks;   // Block structs
+    SlabAllocator data;     // blockSize bytes each
+} BlockPool;
+
+// Function prototypes
+BlockPool *createBlockPool(int blockSize, int recordSpace);
+void freeBlockPool(BlockPool *pool);
+Block *poolAllocBlock(BlockPool *pool);
+Block *poolAllocMappedBlock(BlockPool *pool, char *data);
+Block *poolAllocTableBlock(BlockPool *pool, char *data);
+Block *poolAllocPagedBlock(BlockPool *pool);
+void poolFreeBlock(BlockPool *pool, Block *block);
+
+#endif // BLOCK_POOL_H
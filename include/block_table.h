@@ -0,0 +1,38 @@
+#ifndef BLOCK_TABLE_H
+#define BLOCK_TABLE_H
+
+#include "block.h"
+
+#define TABLE_FIRST_SLOTS 16    // Slots of a new region; it doubles whenever it fills up
+
+// Storage of a contiguous ("table") file: the data of every block lives in
+// one region of blockSize-strided slots, and `blocks` lists the blocks in
+// file order, so block i is found in O(1). A block keeps its slot while it
+// exists; new blocks take the slots of dropped ones before the region
+// grows. Files built by appending, and every file after tablePack, have
+// block i in slot i, so scanning them reads the region front to back.
+typedef struct {
+    int blockSize;
+    char *region;       // slotCapacity slots of blockSize bytes
+    int slotCount;      // Slots handed out, in use or free
+    int slotCapacity;
+    int *freeSlots;     // Slots of dropped blocks
+    int freeCount;
+    int freeCapacity;
+    Block **blocks;     // In file order; Block::position is the index
+    int count;
+    int capacity;
+} BlockTable;
+
+// Function prototypes
+BlockTable *createBlockTable(int blockSize);
+void freeBlockTable(BlockTable *table);
+char *tableAllocData(BlockTable *table);
+int tableReserve(BlockTable *table, int slots);
+void tableFreeData(BlockTable *table, char *data);
+void tableInsert(BlockTable *table, int pos, Block *block);
+void tableRemove(BlockTable *table, int pos);
+void tablePack(BlockTable *table);
+int tableIsPacked(const BlockTable *table);
+
+#endif // BLOCK_TABLE_H
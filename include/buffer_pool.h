@@ -0,0 +1,67 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "block.h"
+
+#define BUFFER_POOL_MIN_FRAMES 8   // Frames a pool has whatever its budget
+
+typedef struct {
+    Block *block;       // Block held, NULL when the frame is free
+    char *data;         // blockSize bytes
+    int referenced;     // CLOCK bit, set by every pin
+} BufferFrame;
+
+// Frames of a paged file (see openPagedFile): a fixed number of
+// blockSize buffers that the file's blocks are read into when they are
+// pinned and evicted from, least recently used first by the CLOCK
+// algorithm, when a frame is needed and they are not pinned. A block
+// without a frame has `data` NULL.
+//
+// The saved file is only written by saves and flushes, so it stays
+// consistent whatever is evicted: a dirty block is written back to a spill
+// file instead, unlinked from the start, and read from there until the
+// next save or flush makes it clean. Clean blocks are read from their
+// slot in the saved file.
+//
+// Pins are counted, so readers sharing the file's latch pin blocks side by
+// side; the pool's lock covers its frames and I/O. When every frame is
+// pinned the pool grows past its budget rather than fail, and shrinks back
+// to it as those blocks are unpinned.
+typedef struct {
+    int fd;             // Saved file clean blocks are read from
+    char *path;         // Its name, which spill files are named after
+    int spillFd;        // Spill file, -1 until the first dirty eviction
+    int *spillFree;     // Spill slots no block holds
+    int spillFreeCount;
+    int spillCapacity;
+    int spillCount;     // Spill slots handed out, held or free
+    int blockSize;
+    off_t base;         // Where slot 0 starts in the saved file
+    BufferFrame *frames;
+    int frameCount;
+    int frameBudget;    // Frames the budget pays for
+    int hand;           // Next frame the CLOCK looks at
+    Block **touched;    // Blocks a write has pinned until it ends (bufferPoolTouch)
+    int touchedCount;
+    int touchedCapacity;
+    size_t hits;        // Pins of resident blocks
+    size_t misses;      // Pins that had to read the block
+    size_t evictions;
+    size_t writeBacks;  // Evictions that wrote a dirty block to the spill file
+    pthread_mutex_t lock;
+} BufferPool;
+
+// Function prototypes
+BufferPool *createBufferPool(int fd, const char *path, int blockSize, off_t base, size_t budget);
+void freeBufferPool(BufferPool *pool);
+void bufferPoolPin(BufferPool *pool, Block *block);
+void bufferPoolUnpin(BufferPool *pool, Block *block);
+Block *bufferPoolTouch(BufferPool *pool, Block *block);
+void bufferPoolUnpinTouched(BufferPool *pool);
+void bufferPoolDrop(BufferPool *pool, Block *block);
+void bufferPoolSettle(BufferPool *pool, Block *head, int fd);
+
+#endif // BUFFER_POOL_H
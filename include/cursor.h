@@ -0,0 +1,38 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include "sequential_file.h"
+
+// Forward scan over the live records of a file, or of those with keys in
+// [startKey, endKey]. Records are returned in place, not copied, and stay
+// valid until the file is modified, or in a paged file until the cursor
+// leaves their block, which is pinned meanwhile. A record spanning blocks
+// is joined into a buffer of the cursor instead, valid until the next
+// cursorNext. The file must not be modified while a cursor is open.
+// Other threads may read alongside, and write: the cursor keeps reading
+// the copy it started on, and a write waits for cursorClose before it
+// changes that copy too. cursorClose must be called once for every open.
+//
+//   Cursor cursor;
+//   cursorOpenRange(&cursor, file, 10, 20);
+//   for (Record *record; (record = cursorNext(&cursor)); ) { ... }
+//   cursorClose(&cursor);
+typedef struct {
+    SequentialFile *opened;  // File the cursor was opened on
+    SequentialFile *file;    // Copy of it being read (see readBegin)
+    Block *block;       // Block being scanned (pinned), NULL once the scan is over
+    int slot;           // Next slot to look at in `block`
+    int bounded;        // Whether only keys in [startKey, endKey] are wanted
+    int startKey;
+    int endKey;
+    char *buffer;       // Spanned records are joined here
+    int capacity;
+} Cursor;
+
+// Function prototypes
+void cursorOpen(Cursor *cursor, SequentialFile *file);
+void cursorOpenRange(Cursor *cursor, SequentialFile *file, int startKey, int endKey);
+Record *cursorNext(Cursor *cursor);
+void cursorClose(Cursor *cursor);
+
+#endif // CURSOR_H
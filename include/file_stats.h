@@ -0,0 +1,83 @@
+#ifndef FILE_STATS_H
+#define FILE_STATS_H
+
+#include <stddef.h>
+
+// Latency histograms have one bucket per power of two nanoseconds: bucket
+// b counts operations that took [2^(b-1), 2^b) ns, bucket 0 those under
+// 1 ns and the last one everything from about a second on
+#define STAT_BUCKETS 32
+
+// Operations timed by the file's counters
+typedef enum {
+    STAT_LOOKUP,        // searchRecord, copyRecord, binarySearchInFile
+    STAT_INSERT,
+    STAT_BATCH_INSERT,  // One insertRecordsBatch call, however many records
+    STAT_UPDATE,
+    STAT_DELETE,
+    STAT_SCAN,          // parallelScan
+    STAT_COMPACT,       // compactFile and reorganizeFile
+    STAT_SAVE,
+    STAT_FLUSH,
+    STAT_LOAD,
+    STAT_OPERATIONS
+} StatOperation;
+
+// What a file counted since it was created, loaded or reset. It holds
+// nothing but unsigned long long counters, which are bumped with relaxed
+// atomic adds so readers of a shared file can count side by side.
+typedef struct {
+    unsigned long long latency[STAT_OPERATIONS][STAT_BUCKETS]; // Operations by duration
+    unsigned long long totalNs[STAT_OPERATIONS];               // Time spent in each kind
+    unsigned long long blocksWalked;       // Blocks lookups, cursors, scans and compaction visited
+    unsigned long long blocksSkipped;      // Blocks lookups ruled out unread by their filter or key range
+    unsigned long long recordsExamined;    // Slots lookups and cursors looked at
+    unsigned long long tombstonesSkipped;  // Deleted records they passed over
+    unsigned long long blocksAllocated;
+    unsigned long long blocksFreed;
+    unsigned long long blockSplits;        // Ordered blocks split in two
+    unsigned long long recordsRelocated;   // Updates that moved their record
+    unsigned long long allocations;        // Heap allocations made by the operations above
+    unsigned long long bytesRead;          // By loads, for the header, descriptors and blocks read up front
+    unsigned long long bytesWritten;       // By saves and flushes, to the file itself
+} FileCounters;
+
+// Snapshot returned by getFileStats: the counters, and gauges of how full
+// the blocks are, taken from their space accounting
+typedef struct {
+    FileCounters counters;
+    int countersEnabled;        // 0 when built with -DNO_FILE_STATS, leaving the counters at 0
+    int blocks;
+    size_t capacityBytes;       // Record space of all blocks
+    size_t liveBytes;           // Held by live records and their slots
+    size_t deadBytes;           // Held by deleted or superseded records, until compaction
+    size_t freeBytes;
+    double fillFactor;          // liveBytes / capacityBytes
+    double tombstoneRatio;      // deadBytes / (liveBytes + deadBytes)
+    size_t pageHits;            // Buffer pool counters of a paged file, 0 otherwise
+    size_t pageMisses;
+    size_t pageEvictions;
+    size_t pageWriteBacks;
+} FileStats;
+
+#ifdef NO_FILE_STATS
+#define STAT_ADD(file, counter, n) ((void)0)
+#define STAT_TIMER(name)
+#define STAT_RECORD(file, operation, name) ((void)0)
+#else
+#define STAT_ADD(file, counter, n) \
+    __atomic_fetch_add(&(file)->counters->counter, (unsigned long long)(n), __ATOMIC_RELAXED)
+#define STAT_TIMER(name) unsigned long long name = statClock()
+#define STAT_RECORD(file, operation, name) statRecordLatency((file)->counters, (operation), statClock() - (name))
+#endif
+
+// Function prototypes
+unsigned long long statClock(void);
+void statRecordLatency(FileCounters *counters, StatOperation operation, unsigned long long ns);
+void statCopyCounters(FileCounters *to, const FileCounters *from);
+void statClearCounters(FileCounters *counters);
+unsigned long long statCount(const FileCounters *counters, StatOperation operation);
+unsigned long long statPercentile(const FileCounters *counters, StatOperation operation, double fraction);
+void printFileStats(const FileStats *stats);
+
+#endif // FILE_STATS_H
@@ -0,0 +1,25 @@
+#ifndef FREE_SPACE_MAP_H
+#define FREE_SPACE_MAP_H
+
+#include "block.h"
+
+#define FSM_MIN_SHIFT 5   // Blocks with less than 32 reclaimable bytes are not tracked
+#define FSM_BUCKETS 20
+
+// Blocks bucketed by reclaimable bytes (free space plus space held by
+// deleted or superseded records): bucket k holds blocks with
+// [2^(k + FSM_MIN_SHIFT), 2^(k + FSM_MIN_SHIFT + 1)) bytes. Each bucket is
+// an intrusive doubly linked list threaded through the blocks themselves.
+typedef struct {
+    Block *buckets[FSM_BUCKETS];
+} FreeSpaceMap;
+
+// Function prototypes
+FreeSpaceMap *createFreeSpaceMap(void);
+void freeFreeSpaceMap(FreeSpaceMap *map);
+void fsmClear(FreeSpaceMap *map);
+void fsmUpdate(FreeSpaceMap *map, Block *block);
+void fsmRemove(FreeSpaceMap *map, Block *block);
+Block *fsmFind(FreeSpaceMap *map, int needed);
+
+#endif // FREE_SPACE_MAP_H
@@ -0,0 +1,29 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include "block.h"
+
+// Location of one record, keyed by its id
+typedef struct {
+    int id;             // Record identifier
+    int offset;         // Offset of the record inside `block`
+    Block *block;       // Block holding the record, NULL for an empty bucket
+} IndexEntry;
+
+// Open-addressing (linear probing) hash table from record id to location
+typedef struct {
+    IndexEntry *entries;
+    int capacity;       // Number of buckets, always a power of two
+    int count;          // Number of occupied buckets
+} HashIndex;
+
+// Function prototypes
+HashIndex *createHashIndex(int capacity);
+void freeHashIndex(HashIndex *index);
+void hashIndexClear(HashIndex *index);
+void hashIndexReserve(HashIndex *index, int count);
+void hashIndexPut(HashIndex *index, int id, Block *block, int offset);
+IndexEntry *hashIndexGet(HashIndex *index, int id);
+int hashIndexRemove(HashIndex *index, int id);
+
+#endif // HASH_INDEX_H
@@ -0,0 +1,12 @@
+#ifndef KEY_SCAN_H
+#define KEY_SCAN_H
+
+// Searches over a column of int keys, such as the key column of a
+// fixed-length block. On x86 the keys are compared 8 at a time with AVX2
+// when the CPU has it and 4 at a time with SSE2 otherwise; elsewhere, or
+// when built with -DKEY_SCAN_SCALAR, one at a time.
+
+// Function prototypes
+int keyScanRange(const int *keys, int from, int count, int low, int high);
+
+#endif // KEY_SCAN_H
@@ -0,0 +1,42 @@
+#ifndef PARALLEL_SCAN_H
+#define PARALLEL_SCAN_H
+
+#include <limits.h>
+#include <pthread.h>
+#include "sequential_file.h"
+
+#define SCAN_BLOCKS_PER_THREAD 64   // Fewer blocks than this per thread are scanned with fewer threads
+
+// Decides whether a record matches; called concurrently from the workers
+typedef int (*RecordPredicate)(const Record *record, void *arg);
+// Receives the matching records, one at a time, on the calling thread
+typedef void (*RecordCallback)(const Record *record, void *arg);
+
+typedef struct {
+    Record **records;   // First slots of the matches, in place
+    size_t count;
+    size_t capacity;
+    char *join;         // Spanned records are joined here for the predicate
+    int joinCapacity;
+} MatchBuffer;
+
+// Matches found in one block: `count` records of a worker's buffer
+typedef struct {
+    int worker;
+    size_t start;
+    size_t count;
+} MatchSpan;
+
+// Blocks [next, end) of the block array still to be scanned by a worker.
+// The owner takes blocks from the front, idle workers steal from the back.
+typedef struct {
+    pthread_mutex_t lock;
+    int next;
+    int end;
+} WorkQueue;
+
+// Function prototypes
+size_t parallelScan(SequentialFile *file, int startKey, int endKey, RecordPredicate predicate,
+                    RecordCallback callback, void *arg, int threads);
+
+#endif // PARALLEL_SCAN_H
@@ -0,0 +1,54 @@
+#ifndef PAYLOAD_INDEX_H
+#define PAYLOAD_INDEX_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "record.h"
+
+// One indexed record: its id and a copy of its data
+typedef struct {
+    int id;
+    unsigned int hash;  // Hash of `data`
+    char *data;         // NUL-terminated copy, NULL once the entry is removed
+    int next;           // Next entry of the same hash chain, -1 at the end
+} PayloadEntry;
+
+// Secondary index over record data. Entries are chained by the hash of
+// their data for exact matches, and kept in a sorted array, ordered by
+// data and then id, for prefix searches. Entries added since the last
+// prefix search wait in `pending` and are merged into the sorted array by
+// the next one, so a run of inserts costs one sort. Removed entries stay
+// in the sorted array until that merge, and their slots are reused after it.
+//
+// The index holds copies of the data, so matches are answered from the
+// index alone. Writes never change an index while it is searched (see
+// enableConcurrency); prefix searches running side by side take `lock` to
+// merge.
+typedef struct {
+    PayloadEntry *entries;
+    int entryCount;     // Entries handed out, in use or removed
+    int entryCapacity;
+    int *buckets;       // First entry of each hash chain, -1 if none
+    int bucketCount;    // Always a power of two
+    int count;          // Entries in use
+    int *sorted;        // Entries by data, then id
+    int sortedCount;
+    int *pending;       // Entries added since the last merge
+    int pendingCount;
+    int *retired;       // Removed entries the sorted array may still name
+    int retiredCount;
+    int *free;          // Removed entries that can be reused
+    int freeCount;      // The four lists above hold up to entryCapacity entries each
+    pthread_mutex_t lock;
+} PayloadIndex;
+
+// Function prototypes
+PayloadIndex *createPayloadIndex(void);
+void freePayloadIndex(PayloadIndex *index);
+void payloadIndexClear(PayloadIndex *index);
+void payloadIndexAdd(PayloadIndex *index, int id, const char *data);
+int payloadIndexRemove(PayloadIndex *index, int id, const char *data);
+size_t payloadIndexFind(PayloadIndex *index, const char *data, RecordBatch *results);
+size_t payloadIndexFindPrefix(PayloadIndex *index, const char *prefix, RecordBatch *results);
+
+#endif // PAYLOAD_INDEX_H
@@ -3,9 +3,78 @@
 
 #include "sequential_file.h"
 
+// On-disk layout:
+//
+//   +------------+---------+--------+-----+------------+------------------+
+//   | FileHeader | padding | Slot 0 | ... | Slot n - 1 | BlockDescriptors |
+//   +------------+---------+--------+-----+------------+------------------+
+//   0                      FILE_HEADER_SIZE
+//
+// Blocks are stored raw in fixed, blockSize-strided slots, so an opened
+// file maps them in place. A block keeps its slot for as long as it
+// exists, which lets flushFileToDisk rewrite only the blocks that changed;
+// slots of dropped blocks are unused until a new block takes them over.
+// The descriptors after the last slot list the blocks in chain order with
+// the per-block bookkeeping needed at open time, so opening never touches
+// the blocks themselves.
+//
+// A compressed file (see enableCompression) stores every block with the
+// codec of block_codec.h, back to back in chain order from
+// FILE_HEADER_SIZE, each taking the bytes its descriptor gives and raw
+// when compressing does not make it smaller. Such a file has no slots to
+// rewrite, so it is always saved in full.
+//
+// A file saved with its log enabled has a write-ahead log next to it,
+// `<name>.wal` (see wal.h), holding the changes made since the file was
+// last flushed. Opening the file replays them.
+#define FILE_MAGIC 0x46514553   // "SEQF"
+#define FILE_VERSION 7
+#define FILE_HEADER_SIZE 4096   // Blocks start on a page boundary
+
+// FileHeader::flags
+#define FILE_FLAG_CONTIGUOUS 0x01
+#define FILE_FLAG_ORDERED    0x02
+#define FILE_FLAG_FIXED      0x04
+#define FILE_FLAG_OVERLAP    0x08
+#define FILE_FLAG_INDEXED    0x10
+#define FILE_FLAG_LOGGED     0x20   // Has a write-ahead log
+#define FILE_FLAG_COMPRESSED 0x40   // Blocks are compressed
+#define FILE_FLAG_PAYLOAD_INDEXED 0x80 // Has a payload index, rebuilt on load
+
+// Compressed blocks are decompressed at load on one thread per this many
+// blocks, up to one per online CPU
+#define LOAD_BLOCKS_PER_THREAD 256
+
+typedef struct {
+    int magic;              // FILE_MAGIC
+    int version;            // FILE_VERSION
+    int blockSize;          // Size of every block
+    int flags;              // FILE_FLAG_* bits
+    int blockCount;         // Number of blocks (and descriptors)
+    int diskBlockCount;     // Number of block slots, in use or not
+    int recordSize;         // SequentialFile::recordSize
+    int updateSlack;        // SequentialFile::updateSlack
+    unsigned int generation; // Changes with every save or flush; ties the log to the file
+    unsigned int checksum;  // FNV-1a over the fields above and the descriptors
+} FileHeader;
+
+typedef struct {
+    int freeSpace;          // Block::freeSpace
+    int deadSpace;          // Block::deadSpace
+    int minKey;             // Fence keys, ordered files only
+    int maxKey;
+    int diskBlock;          // Slot holding the block
+    int storedSize;         // Bytes the block takes in a compressed file (blockSize if raw), 0 otherwise
+} BlockDescriptor;
+
 // Function prototypes
 void saveFileToDisk(SequentialFile *file, const char *filename);
+int flushFileToDisk(SequentialFile *file, const char *filename, int sync);
 SequentialFile *loadFileFromDisk(const char *filename);
+SequentialFile *openPagedFile(const char *filename, size_t budget);
 int deleteFileFromDisk(const char *filename);
+int enableWriteAheadLog(SequentialFile *file);
+void enableCompression(SequentialFile *file);
+int commitFile(SequentialFile *file);
 
 #endif // PERSISTENCE_H
@@ -1,14 +1,52 @@
 #ifndef RECORD_H
 #define RECORD_H
 
+#include <stddef.h>
+#include "arena.h"
+
+// Record flags
+#define RECORD_DELETED 0x1  // Logically deleted (tombstone)
+#define RECORD_CONTINUED 0x2    // Data continues in a piece in the next block
+#define RECORD_CONTINUATION 0x4 // A later piece of a record, not a record of its own
+
+// A record is stored exactly like this inside a block: a fixed header
+// followed by its payload bytes, so blocks never point outside themselves.
+// Inside a variable-length block a record may be followed by `slack`
+// unused bytes, into which an update can grow it in place.
 typedef struct {
     int id;           // Record identifier
     int size;         // Size of the data
-    char *data;       // Dynamically allocated record data
+    unsigned short flags; // RECORD_* flags
+    unsigned short slack; // Bytes reserved after the data in its block, 0 elsewhere
+    char data[];      // Record data, stored inline after the header
 } Record;
 
+// Bytes a record with `size` bytes of data occupies inside a block,
+// rounded up so the following record header stays aligned.
+#define RECORD_SPACE(size) ((int)((sizeof(Record) + (size) + 3) & ~3))
+
+// Most slack a record can have; a multiple of 4, like every record's space
+#define RECORD_MAX_SLACK 0xfffc
+
+// Records in a packed buffer follow each other RECORD_SPACE bytes apart
+#define NEXT_RECORD(record) ((const Record *)((const char *)(record) + RECORD_SPACE((record)->size)))
+
+// Growable buffer of records packed back to back in their block format,
+// so many records can be staged with a handful of allocations
+typedef struct {
+    char *data;         // Packed records
+    size_t used;        // Bytes in use
+    size_t capacity;    // Bytes allocated
+    size_t count;       // Number of records
+} RecordBatch;
+
 // Function prototypes
 Record *createRecord(int id, const char *data);
 void freeRecord(Record *record);
+Record *createArenaRecord(Arena *arena, int id, const char *data);
+void initRecordBatch(RecordBatch *batch);
+void recordBatchAdd(RecordBatch *batch, int id, const char *data);
+void recordBatchClear(RecordBatch *batch);
+void freeRecordBatch(RecordBatch *batch);
 
 #endif // RECORD_H
@@ -1,29 +1,133 @@
 #ifndef SEQUENTIAL_FILE_H
 #define SEQUENTIAL_FILE_H
 
+#include <pthread.h>
 #include "block.h"
 #include "record.h"
+#include "hash_index.h"
+#include "payload_index.h"
+#include "block_directory.h"
+#include "block_table.h"
+#include "free_space_map.h"
+#include "wal.h"
+#include "block_pool.h"
+#include "buffer_pool.h"
+#include "arena.h"
+#include "file_stats.h"
 
+// Ordered bulk loads fill blocks to this percentage, leaving room for
+// later inserts to land without splitting right away
+#define BULK_FILL_PERCENT 90
+
+// Compaction merges a block into the one before it only while the merged
+// block stays within this fill percentage, for the same reason
+#define COMPACT_FILL_PERCENT 90
+
+// Blocks visited by each compaction step run between other operations
+#define COMPACT_STEP_BLOCKS 8
+
+// A record spanning blocks starts in a new block rather than leave a first
+// piece with less data than this at the end of a nearly full one
+#define SPAN_MIN_PIECE 16
+
+// Data bytes per record of a fixed-length file until setRecordSize
+#define FIXED_RECORD_SIZE 32
+
+// Where the blocks of a saved or loaded file live on disk
+typedef struct {
+    char *path;        // File the blocks were last saved to or loaded from, or NULL
+    int blockCount;    // Block slots in that file, in use or free
+    int *freeBlocks;   // Slots released by dropped blocks, reused by new ones
+    int freeCount;
+    int freeCapacity;
+    unsigned int generation; // Bumped by every save or flush
+} DiskState;
+
+// The two copies of a file shared between threads (see enableConcurrency).
+// Readers count themselves into the readable one. A write changes the
+// other, makes it the readable one, waits for the readers still in the
+// first to leave, then changes that one the same way.
 typedef struct {
+    struct SequentialFile *copies[2]; // The file itself, then its read copy
+    int readable;      // Copy new readers enter
+    int readers[2];    // Readers in each copy
+    int changed;       // Copies the running write has changed
+    pthread_mutex_t writer;    // Held by the running write
+} ReadCopies;
+
+typedef struct SequentialFile {
     Block *head;       // Pointer to the first block
+    Block *tail;       // Pointer to the last block, where appends go
     int blockSize;     // Size of each block
-    int isContiguous;  // 1 for Table, 0 for List
+    int isContiguous;  // 1 for Table (blocks in one region, see block_table.h), 0 for List
     int isOrdered;     // 1 for Ordered, 0 for Unordered
     int isFixed;       // 1 for Fixed, 0 for Variable
+    int recordSize;    // Data bytes every record takes in a fixed-length file, 0 otherwise
     int allowOverlap;  // 1 for Continued, 0 for Not Continued
+    int updateSlack;   // Bytes reserved after each new variable-length record (setUpdateSlack)
+    HashIndex *index;  // Primary-key index, NULL when disabled
+    PayloadIndex *payloadIndex; // Secondary index on record data, NULL when disabled
+    BlockDirectory *directory; // Fence keys per block, ordered files only
+    FreeSpaceMap *freeMap;     // Blocks with reclaimable space, unordered files only
+    BlockTable *table; // Block data and blocks by position, contiguous files only
+    char *mapping;     // File mapping that mapped blocks point into, or NULL
+    size_t mappingSize;
+    DiskState disk;    // On-disk placement for incremental flushes
+    WriteAheadLog *log;        // Log of changes since the last flush, NULL when disabled
+    int isCompressed;  // 1 if blocks are saved compressed (enableCompression)
+    Block *compactCursor;      // Last block kept by the running compaction pass, NULL before the first
+    BlockPool *pool;   // Where the file's blocks are allocated
+    BufferPool *buffers;       // Frames the blocks are paged into, NULL unless opened with openPagedFile
+    Arena *arena;      // Scratch space for transient records, single-threaded
+    ReadCopies *shared;        // Copies readers and writes alternate between; NULL unless enableConcurrency
+    pthread_rwlock_t *latch;   // Guards a shared paged file instead, readers share it; NULL otherwise
+    struct SequentialFile *original; // File a read copy mirrors, NULL for the file itself
+    FileCounters stats;        // Operation counters and latencies (see getFileStats)
+    FileCounters *counters;    // Where operations count: `stats`, or the original's for a read copy
 } SequentialFile;
 
 // Function prototypes
 SequentialFile *initializeFile(int blockSize, int isContiguous, int isOrdered, int isFixed, int allowOverlap);
 void insertRecord(SequentialFile *file, Record *record);
+size_t insertRecordsBatch(SequentialFile *file, const Record *records, size_t n);
 int updateRecord(SequentialFile *file, int id, const char *newData);
 int deleteRecord(SequentialFile *file, int id);
 Record *searchRecord(SequentialFile *file, int key);
+int copyRecord(SequentialFile *file, int id, char *data, int capacity);
 // Add this prototype
 void searchRecordsByRange(SequentialFile *file, int startKey, int endKey);
 void reorganizeFile(SequentialFile *file);
+int compactFile(SequentialFile *file, int maxBlocks);
 void freeFile(SequentialFile *file);
 void printFile(SequentialFile *file);
 Record *binarySearchInFile(SequentialFile *file, int key);
+int enableIndex(SequentialFile *file);
+void disableIndex(SequentialFile *file);
+int rebuildIndex(SequentialFile *file);
+void enablePayloadIndex(SequentialFile *file);
+void disablePayloadIndex(SequentialFile *file);
+void rebuildPayloadIndex(SequentialFile *file);
+size_t searchRecordsByPayload(SequentialFile *file, const char *data, RecordBatch *results);
+size_t searchRecordsByPayloadPrefix(SequentialFile *file, const char *prefix, RecordBatch *results);
+void rebuildDirectory(SequentialFile *file);
+void rebuildFreeSpaceMap(SequentialFile *file);
+void releaseBlock(SequentialFile *file, Block *block);
+Block *fileBlockAt(SequentialFile *file, int position);
+void pinBlock(SequentialFile *file, Block *block);
+void unpinBlock(SequentialFile *file, Block *block);
+void pinSpan(SequentialFile *file, Block *block);
+void unpinSpan(SequentialFile *file, Block *block);
+void releaseDiskBlock(SequentialFile *file, int diskBlock);
+int setRecordSize(SequentialFile *file, int size);
+int setUpdateSlack(SequentialFile *file, int bytes);
+void enableConcurrency(SequentialFile *file);
+SequentialFile *readBegin(SequentialFile *file);
+void readEnd(SequentialFile *file, SequentialFile *copy);
+SequentialFile *writeBegin(SequentialFile *file);
+SequentialFile *writeNext(SequentialFile *file, SequentialFile *copy);
+void writeBeginAlone(SequentialFile *file);
+void writeEnd(SequentialFile *file);
+void getFileStats(SequentialFile *file, FileStats *stats);
+void resetFileStats(SequentialFile *file);
 
 #endif // SEQUENTIAL_FILE_H
@@ -0,0 +1,64 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Write-ahead log layout:
+//
+//   +-----------+-----------+---------+-----------+---------+-----
+//   | WalHeader | WalRecord | payload | WalRecord | payload | ...
+//   +-----------+-----------+---------+-----------+---------+-----
+//
+// Operations are appended as they happen and made durable in groups, so
+// many of them share one fdatasync. The log belongs to one generation of
+// the data file: a checkpoint writes the data file forward one generation
+// and starts the log over. Every record is checksummed together with the
+// generation, so a record torn by a crash (or left over from an older
+// generation) ends the log.
+#define WAL_MAGIC 0x4C415753             // "SWAL"
+#define WAL_GROUP_COMMIT 64              // Operations per fdatasync
+#define WAL_BUFFER_SIZE (64 * 1024)      // Bytes buffered before a write
+#define WAL_CHECKPOINT_SIZE (16 << 20)   // Log size that triggers a checkpoint
+
+// WalRecord::type
+#define WAL_INSERT 1       // Record `id` inserted, payload is its data
+#define WAL_UPDATE 2       // Record `id` updated, payload is its new data
+#define WAL_DELETE 3       // Record `id` deleted
+#define WAL_BLOCK 4        // Checkpoint: image of the block in disk slot `id`
+#define WAL_TABLE 5        // Checkpoint: new FileHeader followed by the descriptors
+#define WAL_CHECKPOINT 6   // Checkpoint images complete, `id` is the generation they produce
+
+typedef struct {
+    int magic;                // WAL_MAGIC
+    unsigned int generation;  // Data file generation the records apply to
+} WalHeader;
+
+typedef struct {
+    unsigned int checksum;    // FNV-1a over the generation, the fields below and the payload
+    int type;                 // WAL_* record type
+    int id;
+    int size;                 // Payload bytes that follow, padded to 4
+} WalRecord;
+
+typedef struct {
+    int fd;
+    unsigned int generation;  // From the header, 0 for a new or unreadable log
+    off_t end;                // Where the next record goes in the log file
+    char *buffer;             // Records not yet written
+    size_t used;
+    size_t capacity;
+    int pending;              // Operations not yet made durable
+} WriteAheadLog;
+
+// Function prototypes
+WriteAheadLog *walOpen(const char *path);
+void walClose(WriteAheadLog *log);
+int walReset(WriteAheadLog *log, unsigned int generation);
+void walAppend(WriteAheadLog *log, int type, int id, const void *data, int size);
+int walCommit(WriteAheadLog *log);
+char *walRead(WriteAheadLog *log, size_t *size);
+const WalRecord *walNext(const WriteAheadLog *log, const char *contents, size_t size, size_t *pos);
+int walTruncate(WriteAheadLog *log, size_t size);
+
+#endif // WAL_H
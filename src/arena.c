@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include "arena.h"
+
+static ArenaChunk *createChunk(size_t size) {
+    ArenaChunk *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + size);
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+Arena *createArena(void) {
+    Arena *arena = (Arena *)malloc(sizeof(Arena));
+    arena->chunks = arena->current = createChunk(ARENA_CHUNK_SIZE);
+    return arena;
+}
+
+void freeArena(Arena *arena) {
+    if (arena) {
+        ArenaChunk *chunk = arena->chunks;
+        while (chunk) {
+            ArenaChunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        free(arena);
+    }
+}
+
+// `size` bytes, 8-byte aligned, valid until the next arenaReset
+void *arenaAlloc(Arena *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+
+    // Move on to the next chunk that has room, adding one if none does
+    ArenaChunk *chunk = arena->current;
+    while (chunk->used + size > chunk->size) {
+        if (!chunk->next) {
+            chunk->next = createChunk(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+        }
+        chunk = chunk->next;
+    }
+    arena->current = chunk;
+
+    void *memory = chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+// Free everything allocated so far, keeping the chunks
+void arenaReset(Arena *arena) {
+    for (ArenaChunk *chunk = arena->chunks; chunk; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = arena->chunks;
+}
@@ -0,0 +1,339 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "async_io.h"
+
+// Move all of `size` bytes, resuming after short transfers.
+// Returns 1 on success, 0 on failure (including end of file on a read).
+static int transfer(int fd, int write, char *buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t moved = write ? pwrite(fd, buffer, size, offset) : pread(fd, buffer, size, offset);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved <= 0) {
+            return 0;
+        }
+        buffer += moved;
+        size -= moved;
+        offset += moved;
+    }
+    return 1;
+}
+
+#ifndef ASYNC_IO_THREADS
+static int ringEnter(AsyncIo *io, unsigned submit, unsigned wait) {
+    return (int)syscall(__NR_io_uring_enter, io->ring, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Set up an io_uring with room for every request and map its rings.
+// Returns 0 on success, -1 if the kernel does not offer io_uring.
+static int openRing(AsyncIo *io) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    io->ring = (int)syscall(__NR_io_uring_setup, AIO_QUEUE_DEPTH, &params);
+    if (io->ring < 0) {
+        return -1;
+    }
+
+    io->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    io->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // Newer kernels share one mapping between both rings
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cqMapSize > io->sqMapSize) {
+            io->sqMapSize = io->cqMapSize;
+        }
+        io->cqMapSize = 0;
+    }
+    io->sqMap = mmap(NULL, io->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring,
+                     IORING_OFF_SQ_RING);
+    io->cqMap = io->cqMapSize == 0 ? io->sqMap
+                                   : mmap(NULL, io->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                          io->ring, IORING_OFF_CQ_RING);
+    io->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = (struct io_uring_sqe *)mmap(NULL, io->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                           io->ring, IORING_OFF_SQES);
+    if (io->sqMap == MAP_FAILED || io->cqMap == MAP_FAILED || io->sqes == MAP_FAILED) {
+        if (io->sqMap != MAP_FAILED) munmap(io->sqMap, io->sqMapSize);
+        if (io->cqMapSize && io->cqMap != MAP_FAILED) munmap(io->cqMap, io->cqMapSize);
+        if (io->sqes != MAP_FAILED) munmap(io->sqes, io->sqesSize);
+        close(io->ring);
+        io->ring = -1;
+        return -1;
+    }
+
+    char *sq = (char *)io->sqMap;
+    char *cq = (char *)io->cqMap;
+    io->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    io->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    io->sqArray = (unsigned *)(sq + params.sq_off.array);
+    io->cqHead = (unsigned *)(cq + params.cq_off.head);
+    io->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    io->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void closeRing(AsyncIo *io) {
+    munmap(io->sqes, io->sqesSize);
+    if (io->cqMapSize) {
+        munmap(io->cqMap, io->cqMapSize);
+    }
+    munmap(io->sqMap, io->sqMapSize);
+    close(io->ring);
+}
+
+// Queue `request` on the submission ring and hand the kernel everything
+// queued so far; what it does not take now is handed over by aioWait
+static void ringSubmit(AsyncIo *io, AioRequest *request) {
+    unsigned tail = *io->sqTail;
+    unsigned index = tail & *io->sqMask;
+    struct io_uring_sqe *sqe = &io->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = io->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&request->iov;
+    sqe->len = 1;
+    sqe->off = (uint64_t)request->offset;
+    sqe->user_data = (uint64_t)(uintptr_t)request;
+    io->sqArray[index] = index;
+    __atomic_store_n(io->sqTail, tail + 1, __ATOMIC_RELEASE);
+    io->unsubmitted++;
+
+    int taken = ringEnter(io, io->unsubmitted, 0);
+    if (taken > 0) {
+        io->unsubmitted -= taken;
+    }
+}
+
+// Next completed request, waiting for one if none has completed yet
+static AioRequest *ringReap(AsyncIo *io) {
+    for (;;) {
+        unsigned head = *io->cqHead;
+        if (head != __atomic_load_n(io->cqTail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &io->cqes[head & *io->cqMask];
+            AioRequest *request = (AioRequest *)(uintptr_t)cqe->user_data;
+            int res = cqe->res;
+            __atomic_store_n(io->cqHead, head + 1, __ATOMIC_RELEASE);
+
+            // The kernel may move fewer bytes than asked, or ask to be
+            // retried; the rest is moved here
+            if (res == (int)request->iov.iov_len) {
+                request->result = 1;
+            } else if (res >= 0 || res == -EAGAIN || res == -EINTR) {
+                size_t done = res > 0 ? (size_t)res : 0;
+                request->result = transfer(io->fd, request->write, (char *)request->iov.iov_base + done,
+                                           request->iov.iov_len - done, request->offset + done);
+            } else {
+                request->result = 0;
+            }
+            return request;
+        }
+
+        int taken = ringEnter(io, io->unsubmitted, 1);
+        if (taken > 0) {
+            io->unsubmitted -= taken;
+        } else if (taken < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return NULL;
+        }
+    }
+}
+#endif
+
+static void *runIoThread(void *arg) {
+    AsyncIo *io = (AsyncIo *)arg;
+
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        while (!io->pending && !io->stopping) {
+            pthread_cond_wait(&io->queued, &io->lock);
+        }
+        AioRequest *request = io->pending;
+        if (!request) {
+            break;
+        }
+        io->pending = request->next;
+        pthread_mutex_unlock(&io->lock);
+
+        request->result = transfer(io->fd, request->write, (char *)request->iov.iov_base, request->iov.iov_len,
+                                   request->offset);
+
+        pthread_mutex_lock(&io->lock);
+        request->next = io->done;
+        io->done = request;
+        pthread_cond_signal(&io->completed);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+static void startThreads(AsyncIo *io) {
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->queued, NULL);
+    pthread_cond_init(&io->completed, NULL);
+    for (int i = 0; i < AIO_THREADS; i++) {
+        if (pthread_create(&io->threads[io->threadCount], NULL, runIoThread, io) == 0) {
+            io->threadCount++;
+        }
+    }
+}
+
+// Reads and writes of `fd`, through io_uring if the kernel has it and a
+// thread pool otherwise. Without either (no thread could be started),
+// aioSubmit does the transfer on the spot.
+AsyncIo *aioOpen(int fd) {
+    AsyncIo *io = (AsyncIo *)calloc(1, sizeof(AsyncIo));
+    io->fd = fd;
+    io->ring = -1;
+    for (int i = AIO_QUEUE_DEPTH - 1; i >= 0; i--) {
+        io->requests[i].next = io->free;
+        io->free = &io->requests[i];
+    }
+
+#ifndef ASYNC_IO_THREADS
+    if (openRing(io) == 0) {
+        return io;
+    }
+#endif
+    startThreads(io);
+    return io;
+}
+
+// Wait for the requests still in flight and release everything
+void aioClose(AsyncIo *io) {
+    if (!io) {
+        return;
+    }
+    aioDrain(io);
+#ifndef ASYNC_IO_THREADS
+    if (io->ring >= 0) {
+        closeRing(io);
+        free(io);
+        return;
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    io->stopping = 1;
+    pthread_cond_broadcast(&io->queued);
+    pthread_mutex_unlock(&io->lock);
+    for (int i = 0; i < io->threadCount; i++) {
+        pthread_join(io->threads[i], NULL);
+    }
+    pthread_cond_destroy(&io->completed);
+    pthread_cond_destroy(&io->queued);
+    pthread_mutex_destroy(&io->lock);
+    free(io);
+}
+
+// 1 if AIO_QUEUE_DEPTH requests are in flight, so aioWait must return one
+// before another can be submitted
+int aioFull(const AsyncIo *io) {
+    return io->free == NULL;
+}
+
+// Start reading (or, with `write`, writing) `size` bytes at `offset` of
+// the file. `buffer` must stay untouched until aioWait hands back `tag`.
+// Returns 1 if the request was started, 0 if the queue is full.
+int aioSubmit(AsyncIo *io, int write, void *buffer, size_t size, off_t offset, void *tag) {
+    AioRequest *request = io->free;
+    if (!request) {
+        return 0;
+    }
+    io->free = request->next;
+    request->write = write;
+    request->iov.iov_base = buffer;
+    request->iov.iov_len = size;
+    request->offset = offset;
+    request->tag = tag;
+    request->next = NULL;
+    io->inFlight++;
+
+#ifndef ASYNC_IO_THREADS
+    if (io->ring >= 0) {
+        ringSubmit(io, request);
+        return 1;
+    }
+#endif
+    if (io->threadCount == 0) {
+        request->result = transfer(io->fd, write, (char *)buffer, size, offset);
+        request->next = io->done;
+        io->done = request;
+        return 1;
+    }
+
+    pthread_mutex_lock(&io->lock);
+    if (io->pending) {
+        io->pendingTail->next = request;
+    } else {
+        io->pending = request;
+    }
+    io->pendingTail = request;
+    pthread_cond_signal(&io->queued);
+    pthread_mutex_unlock(&io->lock);
+    return 1;
+}
+
+// Wait for a request to complete, in whatever order they do, and store its
+// tag in `*tag` (may be NULL). Returns 1 if it moved all of its bytes, 0
+// if it failed, -1 if nothing is in flight.
+int aioWait(AsyncIo *io, void **tag) {
+    AioRequest *request;
+
+    if (io->inFlight == 0) {
+        return -1;
+    }
+#ifndef ASYNC_IO_THREADS
+    if (io->ring >= 0) {
+        request = ringReap(io);
+        if (!request) {
+            // The ring broke down; nothing in flight can be trusted, so
+            // every request is given up on at once
+            io->free = NULL;
+            for (int i = AIO_QUEUE_DEPTH - 1; i >= 0; i--) {
+                io->requests[i].next = io->free;
+                io->free = &io->requests[i];
+            }
+            io->inFlight = 0;
+            return 0;
+        }
+    } else
+#endif
+    if (io->threadCount == 0) {
+        request = io->done;
+        io->done = request->next;
+    } else {
+        pthread_mutex_lock(&io->lock);
+        while (!io->done) {
+            pthread_cond_wait(&io->completed, &io->lock);
+        }
+        request = io->done;
+        io->done = request->next;
+        pthread_mutex_unlock(&io->lock);
+    }
+
+    if (tag) {
+        *tag = request->tag;
+    }
+    int result = request->result;
+    request->next = io->free;
+    io->free = request;
+    io->inFlight--;
+    return result;
+}
+
+// Wait for every request in flight. Returns 1 if all of them succeeded.
+int aioDrain(AsyncIo *io) {
+    int succeeded = 1;
+    int result;
+
+    while ((result = aioWait(io, NULL)) >= 0) {
+        succeeded &= result;
+    }
+    return succeeded;
+}
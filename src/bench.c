@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "sequential_file.h"
+#include "persistence.h"
+#include "cursor.h"
+
+// Non-interactive load generator for `make bench`. It builds a file from
+// synthetic records, runs the workload phases against it through the
+// public API and prints one JSON object per phase on stdout: operations
+// per second and latency percentiles of the calls into the library, and
+// the peak resident set size so far. Generating the workload is not
+// timed. Messages the library prints are discarded so the output stays
+// parseable.
+
+#define BENCH_TEXT_SIZE 65536   // Random text payloads are cut from
+#define BENCH_BATCH_SIZE 1000   // Records per insertRecordsBatch call with --batch
+
+typedef struct {
+    int records;            // Records inserted by the insert phase
+    int blockSize;
+    int payloadMin;         // Payload sizes, in bytes without the terminator
+    int payloadMax;
+    const char *payloadDist; // fixed, uniform or skewed (mostly small)
+    const char *keyOrder;   // sequential, reverse or random
+    int lookups;            // Operations of each per-record phase
+    int ranges;             // Range queries of the range phase
+    int rangeWidth;         // Keys covered by one range query
+    int mixOps;             // Operations of the mixed phase
+    int mix[4];             // Mixed phase percentages: lookup, update, insert, delete
+    int deletePercent;      // Share of the records the delete phase removes
+    int isContiguous;
+    int isOrdered;
+    int isFixed;
+    int allowOverlap;
+    int index;
+    int compress;
+    int slack;
+    int batch;              // Insert through insertRecordsBatch
+    size_t pagedBudget;     // Open the file paged within this many bytes, 0 to keep it in memory
+    unsigned int seed;
+    const char *path;
+    const char *phases;     // Comma-separated phases to run, NULL for all
+} BenchConfig;
+
+typedef struct {
+    uint64_t *latencies;    // Nanoseconds per call
+    size_t calls;
+    size_t capacity;
+    size_t ops;             // Records handled, more than calls for batches
+    uint64_t elapsed;       // Nanoseconds spent in the calls
+} Phase;
+
+static FILE *out;
+static char text[BENCH_TEXT_SIZE];
+static unsigned int randomState;
+
+static uint64_t nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+// xorshift32, so runs with the same seed do the same work everywhere
+static unsigned int nextRandom(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static double nextUnit(void) {
+    return (nextRandom() & 0xffffff) / (double)0x1000000;
+}
+
+static int payloadSize(const BenchConfig *config) {
+    int span = config->payloadMax - config->payloadMin;
+    if (strcmp(config->payloadDist, "fixed") == 0 || span <= 0) {
+        return config->payloadMax;
+    }
+    double unit = nextUnit();
+    if (strcmp(config->payloadDist, "skewed") == 0) {
+        unit = unit * unit * unit;
+    }
+    return config->payloadMin + (int)(unit * (span + 1));
+}
+
+// A payload of a size drawn from the configured distribution, in `buffer`
+static const char *makePayload(const BenchConfig *config, char *buffer) {
+    int size = payloadSize(config);
+    int from = nextRandom() % (BENCH_TEXT_SIZE - size);
+    memcpy(buffer, text + from, size);
+    buffer[size] = '\0';
+    return buffer;
+}
+
+static void phaseStart(Phase *phase) {
+    phase->calls = 0;
+    phase->ops = 0;
+    phase->elapsed = 0;
+}
+
+static void phaseRecord(Phase *phase, uint64_t began, size_t ops) {
+    if (phase->calls == phase->capacity) {
+        phase->capacity = phase->capacity ? phase->capacity * 2 : 1024;
+        phase->latencies = (uint64_t *)realloc(phase->latencies, phase->capacity * sizeof(uint64_t));
+    }
+    uint64_t latency = nowNs() - began;
+    phase->latencies[phase->calls++] = latency;
+    phase->elapsed += latency;
+    phase->ops += ops;
+}
+
+static int compareLatencies(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const Phase *phase, double fraction) {
+    size_t rank = (size_t)(fraction * (phase->calls - 1) + 0.5);
+    return phase->latencies[rank];
+}
+
+static long peakRssKb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void phaseReport(Phase *phase, const char *name) {
+    double seconds = phase->elapsed / 1e9;
+
+    fprintf(out, "{\"phase\":\"%s\",\"ops\":%zu,\"calls\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.1f", name,
+            phase->ops, phase->calls, seconds, seconds > 0 ? phase->ops / seconds : 0.0);
+    if (phase->calls > 0) {
+        qsort(phase->latencies, phase->calls, sizeof(uint64_t), compareLatencies);
+        fprintf(out, ",\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu",
+                (unsigned long long)percentile(phase, 0.50), (unsigned long long)percentile(phase, 0.90),
+                (unsigned long long)percentile(phase, 0.99), (unsigned long long)percentile(phase, 0.999),
+                (unsigned long long)phase->latencies[phase->calls - 1]);
+    }
+    fprintf(out, ",\"peak_rss_kb\":%ld}\n", peakRssKb());
+    fflush(out);
+}
+
+static int wantPhase(const BenchConfig *config, const char *name) {
+    if (!config->phases) {
+        return 1;
+    }
+    size_t length = strlen(name);
+    for (const char *at = config->phases; (at = strstr(at, name)); at += length) {
+        if ((at == config->phases || at[-1] == ',') && (at[length] == ',' || at[length] == '\0')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void reportConfig(const BenchConfig *config) {
+    fprintf(out,
+            "{\"phase\":\"config\",\"records\":%d,\"block_size\":%d,\"payload_min\":%d,\"payload_max\":%d,"
+            "\"payload_dist\":\"%s\",\"key_order\":\"%s\",\"mix\":\"%d:%d:%d:%d\",\"contiguous\":%d,"
+            "\"ordered\":%d,\"fixed\":%d,\"overlap\":%d,\"index\":%d,\"compress\":%d,\"slack\":%d,"
+            "\"batch\":%d,\"paged_budget\":%zu,\"seed\":%u}\n",
+            config->records, config->blockSize, config->payloadMin, config->payloadMax, config->payloadDist,
+            config->keyOrder, config->mix[0], config->mix[1], config->mix[2], config->mix[3],
+            config->isContiguous, config->isOrdered, config->isFixed, config->allowOverlap, config->index,
+            config->compress, config->slack, config->batch, config->pagedBudget, config->seed);
+}
+
+// Keys of the insert phase, in the order they are inserted
+static int *makeKeys(const BenchConfig *config) {
+    int *keys = (int *)malloc((config->records ? config->records : 1) * sizeof(int));
+    for (int i = 0; i < config->records; i++) {
+        keys[i] = strcmp(config->keyOrder, "reverse") == 0 ? config->records - 1 - i : i;
+    }
+    if (strcmp(config->keyOrder, "random") == 0) {
+        for (int i = config->records - 1; i > 0; i--) {
+            int j = nextRandom() % (i + 1);
+            int key = keys[i];
+            keys[i] = keys[j];
+            keys[j] = key;
+        }
+    }
+    return keys;
+}
+
+static void insertPhase(const BenchConfig *config, SequentialFile *file, const int *keys, Phase *phase) {
+    char payload[BENCH_TEXT_SIZE];
+
+    phaseStart(phase);
+    if (config->batch) {
+        RecordBatch batch;
+        initRecordBatch(&batch);
+        for (int i = 0; i < config->records; i += BENCH_BATCH_SIZE) {
+            int end = i + BENCH_BATCH_SIZE < config->records ? i + BENCH_BATCH_SIZE : config->records;
+            recordBatchClear(&batch);
+            for (int k = i; k < end; k++) {
+                recordBatchAdd(&batch, keys[k], makePayload(config, payload));
+            }
+            uint64_t began = nowNs();
+            size_t inserted = insertRecordsBatch(file, (const Record *)batch.data, batch.count);
+            phaseRecord(phase, began, inserted);
+        }
+        freeRecordBatch(&batch);
+    } else {
+        for (int i = 0; i < config->records; i++) {
+            Record *record = createArenaRecord(file->arena, keys[i], makePayload(config, payload));
+            uint64_t began = nowNs();
+            insertRecord(file, record);
+            phaseRecord(phase, began, 1);
+            arenaReset(file->arena);
+        }
+    }
+    phaseReport(phase, "insert");
+}
+
+static void lookupPhase(const BenchConfig *config, SequentialFile *file, Phase *phase) {
+    phaseStart(phase);
+    for (int i = 0; i < config->lookups; i++) {
+        int key = nextRandom() % config->records;
+        uint64_t began = nowNs();
+        searchRecord(file, key);
+        phaseRecord(phase, began, 1);
+    }
+    phaseReport(phase, "lookup");
+}
+
+static void rangePhase(const BenchConfig *config, SequentialFile *file, Phase *phase) {
+    phaseStart(phase);
+    for (int i = 0; i < config->ranges; i++) {
+        int startKey = nextRandom() % config->records;
+        Cursor cursor;
+        uint64_t began = nowNs();
+        cursorOpenRange(&cursor, file, startKey, startKey + config->rangeWidth - 1);
+        while (cursorNext(&cursor)) {
+            // Only reaching the records is measured
+        }
+        cursorClose(&cursor);
+        phaseRecord(phase, began, 1);
+    }
+    phaseReport(phase, "range");
+}
+
+static void updatePhase(const BenchConfig *config, SequentialFile *file, Phase *phase) {
+    char payload[BENCH_TEXT_SIZE];
+
+    phaseStart(phase);
+    for (int i = 0; i < config->lookups; i++) {
+        int key = nextRandom() % config->records;
+        const char *data = makePayload(config, payload);
+        uint64_t began = nowNs();
+        updateRecord(file, key, data);
+        phaseRecord(phase, began, 1);
+    }
+    phaseReport(phase, "update");
+}
+
+// Lookups, updates, inserts of new keys and deletes drawn by the --mix
+// percentages
+static void mixedPhase(const BenchConfig *config, SequentialFile *file, Phase *phase) {
+    char payload[BENCH_TEXT_SIZE];
+    int nextKey = config->records;
+
+    phaseStart(phase);
+    for (int i = 0; i < config->mixOps; i++) {
+        int pick = nextRandom() % 100;
+        int key = nextRandom() % config->records;
+        const char *data = pick >= config->mix[0] ? makePayload(config, payload) : NULL;
+        uint64_t began;
+
+        if (pick < config->mix[0]) {
+            began = nowNs();
+            searchRecord(file, key);
+        } else if (pick < config->mix[0] + config->mix[1]) {
+            began = nowNs();
+            updateRecord(file, key, data);
+        } else if (pick < config->mix[0] + config->mix[1] + config->mix[2]) {
+            Record *record = createArenaRecord(file->arena, nextKey++, data);
+            began = nowNs();
+            insertRecord(file, record);
+            arenaReset(file->arena);
+        } else {
+            began = nowNs();
+            deleteRecord(file, key);
+        }
+        phaseRecord(phase, began, 1);
+    }
+    phaseReport(phase, "mixed");
+}
+
+static void deletePhase(const BenchConfig *config, SequentialFile *file, Phase *phase) {
+    int count = (int)((long)config->records * config->deletePercent / 100);
+
+    phaseStart(phase);
+    for (int i = 0; i < count; i++) {
+        int key = nextRandom() % config->records;
+        uint64_t began = nowNs();
+        deleteRecord(file, key);
+        phaseRecord(phase, began, 1);
+    }
+    phaseReport(phase, "delete");
+}
+
+// Save to the configured path and reopen, in memory or paged
+static SequentialFile *reopen(const BenchConfig *config, SequentialFile *file, Phase *save, Phase *load) {
+    uint64_t began;
+
+    phaseStart(save);
+    began = nowNs();
+    saveFileToDisk(file, config->path);
+    phaseRecord(save, began, 1);
+
+    phaseStart(load);
+    began = nowNs();
+    SequentialFile *loaded = config->pagedBudget ? openPagedFile(config->path, config->pagedBudget)
+                                                 : loadFileFromDisk(config->path);
+    phaseRecord(load, began, 1);
+    if (!loaded) {
+        fprintf(stderr, "Error: '%s' could not be reopened\n", config->path);
+        exit(1);
+    }
+    freeFile(file);
+    return loaded;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --records N          records inserted (100000)\n"
+            "  --block-size N       block size in bytes (4096)\n"
+            "  --payload MIN:MAX    payload size range in bytes (16:128)\n"
+            "  --payload-dist D     fixed, uniform or skewed (uniform)\n"
+            "  --key-order O        sequential, reverse or random (random)\n"
+            "  --ops N              operations of the lookup and update phases (records)\n"
+            "  --ranges N           range queries (1000)\n"
+            "  --range-width N      keys per range query (100)\n"
+            "  --mix L:U:I:D        mixed phase lookup:update:insert:delete percentages (70:20:5:5)\n"
+            "  --mix-ops N          operations of the mixed phase (records)\n"
+            "  --delete-percent N   share of records the delete phase removes (50)\n"
+            "  --contiguous --ordered --fixed --no-overlap --no-index --compress --batch\n"
+            "  --slack N            update slack in bytes (0)\n"
+            "  --paged MB           reopen the saved file paged within MB megabytes\n"
+            "  --seed N             random seed (1)\n"
+            "  --file PATH          file saved and loaded (one per run under /tmp)\n"
+            "  --phases LIST        comma-separated subset of lookup,range,update,mixed,delete,\n"
+            "                       reorganize,save,load to run after the inserts (all)\n",
+            program);
+    exit(2);
+}
+
+static void parseOptions(BenchConfig *config, int argc, char **argv) {
+    enum { RECORDS = 256, BLOCK_SIZE, PAYLOAD, PAYLOAD_DIST, KEY_ORDER, OPS, RANGES, RANGE_WIDTH, MIX, MIX_OPS,
+           DELETE_PERCENT, SLACK, PAGED, SEED, FILE_PATH, PHASES };
+    const struct option options[] = {
+        {"records", required_argument, NULL, RECORDS},
+        {"block-size", required_argument, NULL, BLOCK_SIZE},
+        {"payload", required_argument, NULL, PAYLOAD},
+        {"payload-dist", required_argument, NULL, PAYLOAD_DIST},
+        {"key-order", required_argument, NULL, KEY_ORDER},
+        {"ops", required_argument, NULL, OPS},
+        {"ranges", required_argument, NULL, RANGES},
+        {"range-width", required_argument, NULL, RANGE_WIDTH},
+        {"mix", required_argument, NULL, MIX},
+        {"mix-ops", required_argument, NULL, MIX_OPS},
+        {"delete-percent", required_argument, NULL, DELETE_PERCENT},
+        {"slack", required_argument, NULL, SLACK},
+        {"paged", required_argument, NULL, PAGED},
+        {"seed", required_argument, NULL, SEED},
+        {"file", required_argument, NULL, FILE_PATH},
+        {"phases", required_argument, NULL, PHASES},
+        {"contiguous", no_argument, &config->isContiguous, 1},
+        {"ordered", no_argument, &config->isOrdered, 1},
+        {"fixed", no_argument, &config->isFixed, 1},
+        {"no-overlap", no_argument, &config->allowOverlap, 0},
+        {"no-index", no_argument, &config->index, 0},
+        {"compress", no_argument, &config->compress, 1},
+        {"batch", no_argument, &config->batch, 1},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int lookups = -1;
+    int mixOps = -1;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (option) {
+            case 0:
+                break;
+            case RECORDS: config->records = atoi(optarg); break;
+            case BLOCK_SIZE: config->blockSize = atoi(optarg); break;
+            case PAYLOAD:
+                if (sscanf(optarg, "%d:%d", &config->payloadMin, &config->payloadMax) != 2) usage(argv[0]);
+                break;
+            case PAYLOAD_DIST: config->payloadDist = optarg; break;
+            case KEY_ORDER: config->keyOrder = optarg; break;
+            case OPS: lookups = atoi(optarg); break;
+            case RANGES: config->ranges = atoi(optarg); break;
+            case RANGE_WIDTH: config->rangeWidth = atoi(optarg); break;
+            case MIX:
+                if (sscanf(optarg, "%d:%d:%d:%d", &config->mix[0], &config->mix[1], &config->mix[2],
+                           &config->mix[3]) != 4) usage(argv[0]);
+                break;
+            case MIX_OPS: mixOps = atoi(optarg); break;
+            case DELETE_PERCENT: config->deletePercent = atoi(optarg); break;
+            case SLACK: config->slack = atoi(optarg); break;
+            case PAGED: config->pagedBudget = (size_t)atoi(optarg) << 20; break;
+            case SEED: config->seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case FILE_PATH: config->path = optarg; break;
+            case PHASES: config->phases = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    config->lookups = lookups >= 0 ? lookups : config->records;
+    config->mixOps = mixOps >= 0 ? mixOps : config->records;
+
+    int mixTotal = config->mix[0] + config->mix[1] + config->mix[2] + config->mix[3];
+    if (optind < argc || config->records <= 0 || config->blockSize <= 0 || config->payloadMin < 0 ||
+        config->payloadMax < config->payloadMin || config->payloadMax >= BENCH_TEXT_SIZE / 2 ||
+        config->rangeWidth <= 0 || mixTotal != 100 || config->deletePercent < 0 ||
+        (strcmp(config->payloadDist, "fixed") && strcmp(config->payloadDist, "uniform") &&
+         strcmp(config->payloadDist, "skewed")) ||
+        (strcmp(config->keyOrder, "sequential") && strcmp(config->keyOrder, "reverse") &&
+         strcmp(config->keyOrder, "random"))) {
+        usage(argv[0]);
+    }
+    if (config->pagedBudget && (config->isContiguous || config->compress)) {
+        fprintf(stderr, "Error: Only uncompressed List files can be paged\n");
+        exit(2);
+    }
+    if (config->seed == 0) {
+        config->seed = 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config = {
+        .records = 100000,
+        .blockSize = 4096,
+        .payloadMin = 16,
+        .payloadMax = 128,
+        .payloadDist = "uniform",
+        .keyOrder = "random",
+        .ranges = 1000,
+        .rangeWidth = 100,
+        .mix = {70, 20, 5, 5},
+        .deletePercent = 50,
+        .allowOverlap = 1,
+        .index = 1,
+        .seed = 1,
+    };
+    parseOptions(&config, argc, argv);
+
+    // Saved under /tmp unless told otherwise, so an interrupted run leaves
+    // nothing behind in the working tree; a finished one removes it
+    char defaultPath[64];
+    if (!config.path) {
+        snprintf(defaultPath, sizeof(defaultPath), "/tmp/sequential_file_bench_%d.bin", (int)getpid());
+        config.path = defaultPath;
+    }
+
+    // Results keep the real stdout; the library's messages go nowhere
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) {
+        perror("Error redirecting output");
+        return 1;
+    }
+
+    randomState = config.seed;
+    for (int i = 0; i < BENCH_TEXT_SIZE; i++) {
+        text[i] = 'a' + nextRandom() % 26;
+    }
+
+    SequentialFile *file = initializeFile(config.blockSize, config.isContiguous, config.isOrdered, config.isFixed,
+                                          config.allowOverlap);
+    if (!file) {
+        fprintf(stderr, "Error: %d-byte blocks are too small to hold a record\n", config.blockSize);
+        return 1;
+    }
+    if ((config.isFixed && !setRecordSize(file, config.payloadMax + 1)) ||
+        (config.slack && !setUpdateSlack(file, config.slack))) {
+        fprintf(stderr, "Error: Records of up to %d bytes do not fit this file\n", config.payloadMax);
+        return 1;
+    }
+    if (config.index) {
+        enableIndex(file);
+    }
+    if (config.compress) {
+        enableCompression(file);
+    }
+    reportConfig(&config);
+
+    Phase phase = {0};
+    Phase load = {0};
+    int *keys = makeKeys(&config);
+
+    insertPhase(&config, file, keys, &phase);
+    free(keys);
+
+    // A paged file is built in memory and opened paged before it is used
+    if (config.pagedBudget) {
+        file = reopen(&config, file, &phase, &load);
+    }
+    if (wantPhase(&config, "lookup")) {
+        lookupPhase(&config, file, &phase);
+    }
+    if (wantPhase(&config, "range")) {
+        rangePhase(&config, file, &phase);
+    }
+    if (wantPhase(&config, "update")) {
+        updatePhase(&config, file, &phase);
+    }
+    if (wantPhase(&config, "mixed")) {
+        mixedPhase(&config, file, &phase);
+    }
+    if (wantPhase(&config, "delete")) {
+        deletePhase(&config, file, &phase);
+    }
+    if (wantPhase(&config, "reorganize")) {
+        phaseStart(&phase);
+        uint64_t began = nowNs();
+        reorganizeFile(file);
+        phaseRecord(&phase, began, 1);
+        phaseReport(&phase, "reorganize");
+    }
+    if (wantPhase(&config, "save") || wantPhase(&config, "load")) {
+        file = reopen(&config, file, &phase, &load);
+        if (wantPhase(&config, "save")) {
+            phaseReport(&phase, "save");
+        }
+        if (wantPhase(&config, "load")) {
+            phaseReport(&load, "load");
+        }
+    }
+
+    freeFile(file);
+    if (config.pagedBudget || wantPhase(&config, "save") || wantPhase(&config, "load")) {
+        deleteFileFromDisk(config.path);
+    }
+    free(phase.latencies);
+    free(load.latencies);
+    fclose(out);
+    return 0;
+}
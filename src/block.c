@@ -1,18 +1,566 @@
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include "block.h"
+#include "key_scan.h"
 
-Block *createBlock(int blockSize) {
-    Block *block = (Block *)malloc(sizeof(Block));
-    block->data = (char *)malloc(blockSize);
+#define SLOT_SIZE ((int)sizeof(int))
+#define KEY_SIZE ((int)sizeof(int))
+
+static BlockHeader *blockHeader(const Block *block) {
+    return (BlockHeader *)block->data;
+}
+
+// Bytes of the Bloom filter of a block of `blockSize` bytes
+static int filterBytes(int blockSize) {
+    int bytes = BLOCK_FILTER_MIN_BYTES;
+    while (bytes * 2 <= blockSize / BLOCK_FILTER_RATIO) {
+        bytes *= 2;
+    }
+    return bytes;
+}
+
+// Bytes ahead of the key column or the records: the header and the filter
+static int headerBytes(int blockSize) {
+    return (int)sizeof(BlockHeader) + filterBytes(blockSize);
+}
+
+static unsigned char *filterOf(const Block *block) {
+    return (unsigned char *)(block->data + sizeof(BlockHeader));
+}
+
+static int *keyColumn(const Block *block) {
+    return (int *)(block->data + headerBytes(block->blockSize));
+}
+
+// Offset of the first record: after the key column in fixed-length blocks
+static int recordsStart(const Block *block) {
+    int keys = block->recordSpace ? blockKeyCapacity(block->blockSize, block->recordSpace) : 0;
+    return headerBytes(block->blockSize) + keys * KEY_SIZE;
+}
+
+// The filter bits of `key` are found by double hashing: probe i is
+// first + i * step, both taken from one well-mixed hash of the key
+static unsigned int filterHash(int key) {
+    unsigned int hash = (unsigned int)key;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static void filterAdd(Block *block, int key) {
+    BlockHeader *header = blockHeader(block);
+    unsigned char *filter = filterOf(block);
+    unsigned int mask = filterBytes(block->blockSize) * 8 - 1;
+    unsigned int hash = filterHash(key);
+    unsigned int step = (hash >> 17 | hash << 15) | 1;
+
+    for (int i = 0; i < BLOCK_FILTER_PROBES; i++, hash += step) {
+        filter[(hash & mask) >> 3] |= 1 << (hash & 7);
+    }
+    if (key < header->minKey) header->minKey = key;
+    if (key > header->maxKey) header->maxKey = key;
+}
+
+// Forget every id, for a block about to be emptied or rebuilt
+static void filterClear(Block *block) {
+    BlockHeader *header = blockHeader(block);
+    memset(filterOf(block), 0, filterBytes(block->blockSize));
+    header->minKey = INT_MAX;
+    header->maxKey = INT_MIN;
+}
+
+// Bytes a record with `size` bytes of data takes up in the block
+static int recordSpaceIn(const Block *block, int size) {
+    return block->recordSpace ? block->recordSpace : RECORD_SPACE(size);
+}
+
+// Bytes a stored record takes up in the block, its slack included
+static int storedSpace(const Block *block, const Record *record) {
+    return recordSpaceIn(block, record->size) + record->slack;
+}
+
+// Slot 0 is the last int of the block, slot 1 the one before it, ...
+static int *slotAt(const Block *block, int slot) {
+    return (int *)(block->data + block->blockSize) - 1 - slot;
+}
+
+// Set up a block around `data`, which the caller allocated. The data is
+// left as it is; blockFormat makes it an empty block.
+void blockInit(Block *block, char *data, int blockSize, int flags) {
+    block->data = data;
     block->blockSize = blockSize;
-    block->freeSpace = blockSize;
     block->next = NULL;
+    block->fsmPrev = block->fsmNext = NULL;
+    block->fsmBucket = -1;
+    block->flags = flags;
+    block->diskBlock = -1;
+    block->recordSpace = 0;
+    block->position = -1;
+    block->frame = -1;
+    block->pins = 0;
+    block->spillSlot = -1;
+}
+
+// Empty the block
+void blockFormat(Block *block) {
+    BlockHeader *header = blockHeader(block);
+    header->recordCount = 0;
+    header->dataEnd = recordsStart(block);
+    filterClear(block);
+    block->freeSpace = blockCapacity(block);
+    block->deadSpace = 0;
+    block->flags |= BLOCK_DIRTY;
+}
+
+Block *createBlock(int blockSize) {
+    Block *block = (Block *)malloc(sizeof(Block));
+    blockInit(block, (char *)malloc(blockSize), blockSize, 0);
+    blockFormat(block);
+    return block;
+}
+
+// Wrap an already formatted block that lives elsewhere (e.g. in a file
+// mapping) without copying or even reading it. The caller fills in
+// freeSpace and deadSpace, or calls blockRefresh.
+Block *createMappedBlock(char *data, int blockSize) {
+    Block *block = (Block *)malloc(sizeof(Block));
+    blockInit(block, data, blockSize, BLOCK_MAPPED);
     return block;
 }
 
 void freeBlock(Block *block) {
     if (block) {
-        free(block->data);
+        if (!(block->flags & BLOCK_MAPPED)) {
+            free(block->data);
+        }
         free(block);
     }
 }
+
+// Recompute the in-memory bookkeeping after `data` was filled externally
+// (e.g. read back from disk).
+void blockRefresh(Block *block) {
+    BlockHeader *header = blockHeader(block);
+    int liveSpace = 0;
+
+    for (int slot = 0; slot < header->recordCount; slot++) {
+        Record *record = blockRecordAt(block, slot);
+        if (!(record->flags & RECORD_DELETED)) {
+            liveSpace += storedSpace(block, record) + SLOT_SIZE;
+        }
+    }
+
+    if (block->recordSpace) {
+        block->freeSpace = blockCapacity(block) - header->recordCount * (block->recordSpace + SLOT_SIZE);
+    } else {
+        block->freeSpace = block->blockSize - header->dataEnd - header->recordCount * SLOT_SIZE;
+    }
+    block->deadSpace = blockCapacity(block) - liveSpace - block->freeSpace;
+}
+
+// Copy the block's bytes into `image` with the free space between the
+// records and the slot array zeroed, since it may hold stale bytes that
+// would only make the image compress worse
+void blockImage(const Block *block, char *image) {
+    BlockHeader *header = blockHeader(block);
+    int slots = header->recordCount * SLOT_SIZE;
+
+    memcpy(image, block->data, header->dataEnd);
+    memset(image + header->dataEnd, 0, block->blockSize - header->dataEnd - slots);
+    memcpy(image + block->blockSize - slots, block->data + block->blockSize - slots, slots);
+}
+
+// Whether a record with `dataSize` bytes of data fits in an empty block.
+int blockCanHold(int blockSize, int dataSize) {
+    return RECORD_SPACE(dataSize) + SLOT_SIZE <= blockSize - headerBytes(blockSize);
+}
+
+// Records a fixed-length block holds when they are `recordSpace` bytes
+// apart: each takes its stride, a key and a slot
+int blockKeyCapacity(int blockSize, int recordSpace) {
+    return (blockSize - headerBytes(blockSize)) / (recordSpace + KEY_SIZE + SLOT_SIZE);
+}
+
+// Free space a record with `dataSize` bytes of data needs in a block whose
+// records are `recordSpace` bytes apart (0 for variable-length blocks)
+int blockSpaceNeeded(int recordSpace, int dataSize) {
+    return (recordSpace ? recordSpace : RECORD_SPACE(dataSize)) + SLOT_SIZE;
+}
+
+// Free space of the block when it is empty
+int blockCapacity(const Block *block) {
+    if (block->recordSpace) {
+        return blockKeyCapacity(block->blockSize, block->recordSpace) * (block->recordSpace + SLOT_SIZE);
+    }
+    return block->blockSize - headerBytes(block->blockSize);
+}
+
+// Most data a piece can hold in a block with `freeSpace` bytes free
+int blockPieceSize(int freeSpace) {
+    int size = (freeSpace - SLOT_SIZE - (int)sizeof(Record)) & ~3;
+    return size > 0 ? size : 0;
+}
+
+// Most data a piece can hold in an empty block of `blockSize` bytes
+int blockMaxPieceSize(int blockSize) {
+    return blockPieceSize(blockSize - headerBytes(blockSize));
+}
+
+// Data size of the record starting with `record`, a slot of `block`,
+// summed over all of its pieces
+int blockRecordLength(const Block *block, const Record *record) {
+    int size = record->size;
+    while (record->flags & RECORD_CONTINUED) {
+        block = block->next;
+        record = blockRecordAt(block, 0);
+        size += record->size;
+    }
+    return size;
+}
+
+// Copy up to `capacity` bytes of the data of the record starting with
+// `record`, a slot of `block`, into `data`. Returns the full data size.
+int blockReadData(const Block *block, const Record *record, char *data, int capacity) {
+    int size = 0;
+    for (;;) {
+        int part = record->size < capacity - size ? record->size : capacity - size;
+        if (part > 0) {
+            memcpy(data + size, record->data, part);
+        }
+        size += record->size;
+        if (!(record->flags & RECORD_CONTINUED)) {
+            return size;
+        }
+        block = block->next;
+        record = blockRecordAt(block, 0);
+    }
+}
+
+// The record starting with `record`, a slot of `block`, in one piece:
+// itself when it fits in the block, otherwise a copy joined from all of
+// its pieces in `*buffer`, which is grown to `*capacity` bytes as needed
+// and belongs to the caller
+Record *blockJoinRecord(const Block *block, const Record *record, char **buffer, int *capacity) {
+    if (!(record->flags & RECORD_CONTINUED)) {
+        return (Record *)record;
+    }
+    return blockCopyRecord(block, record, buffer, capacity);
+}
+
+// Like blockJoinRecord, but the record is copied into `*buffer` even when
+// it fits in the block
+Record *blockCopyRecord(const Block *block, const Record *record, char **buffer, int *capacity) {
+    int size = blockRecordLength(block, record);
+    if ((int)sizeof(Record) + size > *capacity) {
+        *capacity = (int)sizeof(Record) + size;
+        *buffer = (char *)realloc(*buffer, *capacity);
+    }
+    Record *joined = (Record *)*buffer;
+    joined->id = record->id;
+    joined->size = size;
+    joined->flags = record->flags & ~RECORD_CONTINUED;
+    joined->slack = 0;
+    blockReadData(block, record, joined->data, size);
+    return joined;
+}
+
+// The ids of the block's records in storage order, one per slot, or NULL
+// for a variable-length block. Deleted records keep their keys.
+const int *blockKeys(const Block *block) {
+    return block->recordSpace ? keyColumn(block) : NULL;
+}
+
+// The record whose key is at `position` in a fixed-length block's key column
+Record *blockRecordAtPosition(const Block *block, int position) {
+    return (Record *)(block->data + recordsStart(block) + position * block->recordSpace);
+}
+
+int blockRecordCount(const Block *block) {
+    return blockHeader(block)->recordCount;
+}
+
+int blockRecordOffset(const Block *block, int slot) {
+    return *slotAt(block, slot);
+}
+
+Record *blockRecordAt(const Block *block, int slot) {
+    return (Record *)(block->data + *slotAt(block, slot));
+}
+
+// Slot whose record starts at `offset`, or -1 if none does
+int blockFindSlot(const Block *block, int offset) {
+    int count = blockHeader(block)->recordCount;
+    for (int slot = 0; slot < count; slot++) {
+        if (*slotAt(block, slot) == offset) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Offset of the first live record with id `key`, or -1 if the block has
+// none. Fixed-length blocks compare their key column several keys at a time.
+int blockFindKey(const Block *block, int key) {
+    int count = blockHeader(block)->recordCount;
+
+    if (block->recordSpace) {
+        const int *keys = keyColumn(block);
+        for (int i = keyScanRange(keys, 0, count, key, key); i < count;
+             i = keyScanRange(keys, i + 1, count, key, key)) {
+            Record *record = blockRecordAtPosition(block, i);
+            if (!(record->flags & RECORD_DELETED)) {
+                return (int)((char *)record - block->data);
+            }
+        }
+        return -1;
+    }
+
+    for (int slot = 0; slot < count; slot++) {
+        Record *record = blockRecordAt(block, slot);
+        if (record->id == key && !(record->flags & (RECORD_DELETED | RECORD_CONTINUATION))) {
+            return *slotAt(block, slot);
+        }
+    }
+    return -1;
+}
+
+// Whether the block may hold a record with id `key`: 0 means it certainly
+// does not, 1 that its records have to be looked at. Only the header and
+// the filter are read.
+int blockMayHoldKey(const Block *block, int key) {
+    const BlockHeader *header = blockHeader(block);
+    if (key < header->minKey || key > header->maxKey) {
+        return 0;
+    }
+
+    const unsigned char *filter = filterOf(block);
+    unsigned int mask = filterBytes(block->blockSize) * 8 - 1;
+    unsigned int hash = filterHash(key);
+    unsigned int step = (hash >> 17 | hash << 15) | 1;
+    for (int i = 0; i < BLOCK_FILTER_PROBES; i++, hash += step) {
+        if (!(filter[(hash & mask) >> 3] & (1 << (hash & 7)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Whether the block may hold records with ids in [low, high], going by
+// the smallest and largest id it has stored
+int blockMayHoldRange(const Block *block, int low, int high) {
+    const BlockHeader *header = blockHeader(block);
+    return header->minKey <= high && header->maxKey >= low;
+}
+
+// First slot whose id is >= key (slots of ordered files are sorted by id)
+int blockLowerBound(const Block *block, int key) {
+    int left = 0;
+    int right = blockHeader(block)->recordCount;
+
+    while (left < right) {
+        int mid = (left + right) / 2;
+        if (blockRecordAt(block, mid)->id < key) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
+
+// First slot whose id is > key
+int blockUpperBound(const Block *block, int key) {
+    int left = 0;
+    int right = blockHeader(block)->recordCount;
+
+    while (left < right) {
+        int mid = (left + right) / 2;
+        if (blockRecordAt(block, mid)->id <= key) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
+
+// Copy `record` into the block and give it position `slot` in scan order,
+// shifting later slots up by one. In a variable-length block up to `slack`
+// more bytes are reserved after the data, as many as the block has room
+// for. Returns the record's offset in the block, or -1 if there is not
+// enough free space for the record itself (or, in a fixed-length block,
+// the record is longer than the stride).
+int blockInsertRecord(Block *block, int slot, const Record *record, int slack) {
+    BlockHeader *header = blockHeader(block);
+    int space = recordSpaceIn(block, record->size);
+
+    if (space + SLOT_SIZE > block->freeSpace || RECORD_SPACE(record->size) > space) {
+        return -1;
+    }
+    if (block->recordSpace) {
+        slack = 0;
+    } else if (slack > block->freeSpace - space - SLOT_SIZE) {
+        slack = block->freeSpace - space - SLOT_SIZE;
+    }
+    slack = (slack > RECORD_MAX_SLACK ? RECORD_MAX_SLACK : slack) & ~3;
+
+    int offset = header->dataEnd;
+    block->flags |= BLOCK_DIRTY;
+    memcpy(block->data + offset, record, sizeof(Record) + record->size);
+    ((Record *)(block->data + offset))->slack = slack;
+    header->dataEnd += space + slack;
+    if (block->recordSpace) {
+        keyColumn(block)[(offset - recordsStart(block)) / space] = record->id;
+    }
+    filterAdd(block, record->id);
+
+    // Slots grow downwards, so making room at `slot` moves the later
+    // slots one int towards the start of the block.
+    int count = header->recordCount;
+    if (slot < count) {
+        memmove(slotAt(block, count), slotAt(block, count - 1), (count - slot) * SLOT_SIZE);
+    }
+    *slotAt(block, slot) = offset;
+    header->recordCount++;
+
+    block->freeSpace -= space + slack + SLOT_SIZE;
+    return offset;
+}
+
+// Replace the data of the record at `slot`. The record is rewritten in
+// place when the new data fits its current footprint, slack included, and
+// whatever the new data leaves over becomes its slack; otherwise a new
+// copy is appended to the block and the slot repointed (the old bytes stay
+// dead until the block is compacted). Fixed-length records are always
+// rewritten in place. Returns the record's offset, or -1 if the block has
+// no room for the new copy.
+int blockUpdateRecord(Block *block, int slot, const char *data, int size) {
+    Record *record = blockRecordAt(block, slot);
+
+    if (block->recordSpace) {
+        if (RECORD_SPACE(size) > block->recordSpace) {
+            return -1;
+        }
+        block->flags |= BLOCK_DIRTY;
+        memcpy(record->data, data, size);
+        record->size = size;
+        return *slotAt(block, slot);
+    }
+
+    int space = RECORD_SPACE(size);
+    int footprint = storedSpace(block, record);
+    if (space <= footprint) {
+        int slack = footprint - space;
+        if (slack > RECORD_MAX_SLACK) {
+            block->deadSpace += slack - RECORD_MAX_SLACK;
+            slack = RECORD_MAX_SLACK;
+        }
+        block->flags |= BLOCK_DIRTY;
+        memcpy(record->data, data, size);
+        record->size = size;
+        record->slack = slack;
+        return *slotAt(block, slot);
+    }
+
+    if (space > block->freeSpace) {
+        return -1;
+    }
+    // The new copy keeps the record's slack if there is room for it
+    int slack = space + record->slack <= block->freeSpace ? record->slack : 0;
+    block->flags |= BLOCK_DIRTY;
+    block->deadSpace += footprint;
+
+    BlockHeader *header = blockHeader(block);
+    int offset = header->dataEnd;
+    Record *moved = (Record *)(block->data + offset);
+    moved->id = record->id;
+    moved->flags = record->flags;
+    moved->slack = slack;
+    moved->size = size;
+    memcpy(moved->data, data, size);
+
+    header->dataEnd += space + slack;
+    *slotAt(block, slot) = offset;
+    block->freeSpace -= space + slack;
+    return offset;
+}
+
+// Mark the record at `slot` deleted. Its bytes and slot stay in place
+// (and are accounted as dead) until the block is compacted.
+void blockDeleteRecord(Block *block, int slot) {
+    Record *record = blockRecordAt(block, slot);
+    record->flags |= RECORD_DELETED;
+    block->flags |= BLOCK_DIRTY;
+    block->deadSpace += storedSpace(block, record) + SLOT_SIZE;
+}
+
+// Blocks are compacted through this buffer, one per thread, which only
+// grows, so compaction does not allocate once it is large enough
+static __thread char *compactBuffer;
+static __thread int compactCapacity;
+
+// Rewrite the block so it holds only its live records, packed in slot
+// order. Deleted records and space left behind by updates are reclaimed;
+// records keep their slack.
+void blockCompact(Block *block) {
+    BlockHeader *header = blockHeader(block);
+    int count = header->recordCount;
+    int start = recordsStart(block);
+    int end = start;
+    int live = 0;
+
+    if (compactCapacity < block->blockSize) {
+        compactCapacity = block->blockSize;
+        compactBuffer = (char *)realloc(compactBuffer, compactCapacity);
+    }
+    char *packed = compactBuffer;
+
+    // Only the live ids go back into the filter
+    filterClear(block);
+    for (int i = 0; i < count; i++) {
+        Record *record = blockRecordAt(block, i);
+        if (record->flags & RECORD_DELETED) {
+            continue;
+        }
+        int space = storedSpace(block, record);
+        memcpy(packed + end, record, sizeof(Record) + record->size);
+        // Keys are not read here, so the column is rewritten in place
+        if (block->recordSpace) {
+            keyColumn(block)[live] = record->id;
+        }
+        filterAdd(block, record->id);
+        // Slot array is rebuilt in `packed` the same way as in the block
+        *((int *)(packed + block->blockSize) - 1 - live) = end;
+        end += space;
+        live++;
+    }
+
+    memcpy(block->data + start, packed + start, end - start);
+    memcpy(slotAt(block, live - 1), packed + block->blockSize - live * SLOT_SIZE, live * SLOT_SIZE);
+
+    header->recordCount = live;
+    header->dataEnd = end;
+    block->flags |= BLOCK_DIRTY;
+    blockRefresh(block);
+}
+
+// Move the records at `slot` and after to the end of the (empty) block
+// `right`, then compact `block` down to the records before `slot`.
+void blockSplit(Block *block, Block *right, int slot) {
+    BlockHeader *header = blockHeader(block);
+    int count = header->recordCount;
+
+    for (int i = slot; i < count; i++) {
+        Record *record = blockRecordAt(block, i);
+        if (!(record->flags & RECORD_DELETED)) {
+            blockInsertRecord(right, blockRecordCount(right), record, record->slack);
+        }
+    }
+
+    header->recordCount = slot;
+    blockCompact(block);
+}
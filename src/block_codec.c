@@ -0,0 +1,191 @@
+#include <string.h>
+#include <stdint.h>
+#include "block_codec.h"
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+
+// Compress `size` bytes into at most `capacity` bytes of `dest`.
+// Returns the compressed size, or 0 if it does not fit.
+int codecCompress(const char *source, int size, char *dest, int capacity) {
+    return LZ4_compress_default(source, dest, size, capacity);
+}
+
+// Decompress `size` bytes into at most `capacity` bytes of `dest`.
+// Returns the decompressed size, or -1 if the input is malformed.
+int codecDecompress(const char *source, int size, char *dest, int capacity) {
+    int length = LZ4_decompress_safe(source, dest, size, capacity);
+    return length < 0 ? -1 : length;
+}
+
+#else
+
+#define MIN_MATCH 4         // Shortest match the format can express
+#define LAST_LITERALS 5     // The last bytes are always literals
+#define MATCH_LIMIT 12      // No match starts within this many bytes of the end
+#define MAX_DISTANCE 65535
+#define HASH_BITS 12
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int hash4(const unsigned char *p) {
+    return (int)((read32(p) * 2654435761u) >> (32 - HASH_BITS));
+}
+
+// The bytes extending a length of 15 or more that its token nibble holds
+static unsigned char *putLength(unsigned char *out, int length) {
+    for (length -= 15; length >= 255; length -= 255) {
+        *out++ = 255;
+    }
+    *out++ = (unsigned char)length;
+    return out;
+}
+
+// Write one sequence: `literals` bytes from `anchor`, then a match of
+// `matchLength` bytes at `distance` (none when matchLength is 0).
+// Returns the new end of the output, or NULL if it does not fit.
+static unsigned char *putSequence(unsigned char *out, unsigned char *outEnd, const unsigned char *anchor,
+                                  int literals, int distance, int matchLength) {
+    int extra = matchLength ? matchLength - MIN_MATCH : 0;
+    if (out + 1 + literals / 255 + 1 + literals + 2 + extra / 255 + 1 > outEnd) {
+        return NULL;
+    }
+
+    unsigned char *token = out++;
+    *token = (unsigned char)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) {
+        out = putLength(out, literals);
+    }
+    memcpy(out, anchor, literals);
+    out += literals;
+
+    if (matchLength) {
+        *out++ = (unsigned char)distance;
+        *out++ = (unsigned char)(distance >> 8);
+        *token |= (unsigned char)(extra < 15 ? extra : 15);
+        if (extra >= 15) {
+            out = putLength(out, extra);
+        }
+    }
+    return out;
+}
+
+// Compress `size` bytes into at most `capacity` bytes of `dest`. Each
+// position is looked up by its first 4 bytes in a table of the last
+// position with the same hash, and the longest match found there is taken.
+// Returns the compressed size, or 0 if it does not fit.
+int codecCompress(const char *source, int size, char *dest, int capacity) {
+    const unsigned char *in = (const unsigned char *)source;
+    const unsigned char *end = in + size;
+    const unsigned char *anchor = in;
+    unsigned char *out = (unsigned char *)dest;
+    unsigned char *outEnd = out + capacity;
+    int table[1 << HASH_BITS];
+
+    memset(table, 0, sizeof(table));
+    if (size > MATCH_LIMIT) {
+        const unsigned char *matchEnd = end - LAST_LITERALS;
+        const unsigned char *last = end - MATCH_LIMIT;
+        const unsigned char *pos = in;
+
+        while (pos <= last) {
+            int hash = hash4(pos);
+            const unsigned char *candidate = in + table[hash];
+            table[hash] = (int)(pos - in);
+
+            if (candidate >= pos || pos - candidate > MAX_DISTANCE || read32(candidate) != read32(pos)) {
+                pos++;
+                continue;
+            }
+
+            const unsigned char *scan = pos + MIN_MATCH;
+            const unsigned char *match = candidate + MIN_MATCH;
+            while (scan < matchEnd && *scan == *match) {
+                scan++;
+                match++;
+            }
+            while (pos > anchor && candidate > in && pos[-1] == candidate[-1]) {
+                pos--;
+                candidate--;
+            }
+
+            out = putSequence(out, outEnd, anchor, (int)(pos - anchor), (int)(pos - candidate), (int)(scan - pos));
+            if (!out) {
+                return 0;
+            }
+            pos = anchor = scan;
+        }
+    }
+
+    out = putSequence(out, outEnd, anchor, (int)(end - anchor), 0, 0);
+    return out ? (int)(out - (unsigned char *)dest) : 0;
+}
+
+// A length of 15 or more continues in the bytes after `*in`; adds them.
+// Returns 0 if the input ends first.
+static int getLength(const unsigned char **in, const unsigned char *end, int *length) {
+    unsigned char byte;
+    do {
+        if (*in >= end) {
+            return 0;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return 1;
+}
+
+// Decompress `size` bytes into at most `capacity` bytes of `dest`,
+// checking every length and distance against both buffers.
+// Returns the decompressed size, or -1 if the input is malformed.
+int codecDecompress(const char *source, int size, char *dest, int capacity) {
+    const unsigned char *in = (const unsigned char *)source;
+    const unsigned char *end = in + size;
+    unsigned char *out = (unsigned char *)dest;
+    unsigned char *outEnd = out + capacity;
+
+    while (in < end) {
+        int token = *in++;
+        int literals = token >> 4;
+        if (literals == 15 && !getLength(&in, end, &literals)) {
+            return -1;
+        }
+        if (literals > end - in || literals > outEnd - out) {
+            return -1;
+        }
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+
+        // The last sequence has no match
+        if (in == end) {
+            break;
+        }
+        if (end - in < 2) {
+            return -1;
+        }
+        int distance = in[0] | in[1] << 8;
+        in += 2;
+        int length = token & 15;
+        if (length == 15 && !getLength(&in, end, &length)) {
+            return -1;
+        }
+        length += MIN_MATCH;
+        if (distance == 0 || distance > out - (unsigned char *)dest || length > outEnd - out) {
+            return -1;
+        }
+
+        // Byte by byte, since a match may overlap its own output
+        const unsigned char *match = out - distance;
+        while (length-- > 0) {
+            *out++ = *match++;
+        }
+    }
+    return (int)(out - (unsigned char *)dest);
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+#include "block_directory.h"
+
+BlockDirectory *createDirectory(void) {
+    BlockDirectory *directory = (BlockDirectory *)malloc(sizeof(BlockDirectory));
+    directory->capacity = 16;
+    directory->count = 0;
+    directory->entries = (DirectoryEntry *)malloc(directory->capacity * sizeof(DirectoryEntry));
+    return directory;
+}
+
+void freeDirectory(BlockDirectory *directory) {
+    if (directory) {
+        free(directory->entries);
+        free(directory);
+    }
+}
+
+void directoryClear(BlockDirectory *directory) {
+    directory->count = 0;
+}
+
+// Make room for a new entry at position `pos`, shifting later entries back
+static DirectoryEntry *openEntry(BlockDirectory *directory, int pos) {
+    if (directory->count == directory->capacity) {
+        directory->capacity *= 2;
+        directory->entries = (DirectoryEntry *)realloc(directory->entries,
+                                                       directory->capacity * sizeof(DirectoryEntry));
+    }
+    memmove(&directory->entries[pos + 1], &directory->entries[pos],
+            (directory->count - pos) * sizeof(DirectoryEntry));
+    directory->count++;
+    return &directory->entries[pos];
+}
+
+// Add `block` at position `pos`, reading its fence keys from the block
+void directoryInsert(BlockDirectory *directory, int pos, Block *block) {
+    openEntry(directory, pos)->block = block;
+    directoryRefresh(directory, pos);
+}
+
+// Add `block` at position `pos` with fence keys that are already known
+// (e.g. read from disk), without touching the block's data
+void directoryInsertKeys(BlockDirectory *directory, int pos, Block *block, int minKey, int maxKey) {
+    DirectoryEntry *entry = openEntry(directory, pos);
+    entry->block = block;
+    entry->minKey = minKey;
+    entry->maxKey = maxKey;
+}
+
+void directoryRemove(BlockDirectory *directory, int pos) {
+    memmove(&directory->entries[pos], &directory->entries[pos + 1],
+            (directory->count - pos - 1) * sizeof(DirectoryEntry));
+    directory->count--;
+}
+
+// Re-read the fence keys of entry `pos` from its block's first and last slot
+void directoryRefresh(BlockDirectory *directory, int pos) {
+    DirectoryEntry *entry = &directory->entries[pos];
+    int count = blockRecordCount(entry->block);
+
+    if (count > 0) {
+        entry->minKey = blockRecordAt(entry->block, 0)->id;
+        entry->maxKey = blockRecordAt(entry->block, count - 1)->id;
+    }
+}
+
+// Position of the block responsible for `key`: the first block whose last
+// key is >= key, or the last block when key is beyond every block.
+// Returns -1 for an empty directory.
+int directoryFind(const BlockDirectory *directory, int key) {
+    int left = 0;
+    int right = directory->count - 1;
+
+    if (right < 0) {
+        return -1;
+    }
+
+    while (left < right) {
+        int mid = (left + right) / 2;
+        if (directory->entries[mid].maxKey >= key) {
+            right = mid;
+        } else {
+            left = mid + 1;
+        }
+    }
+    return left;
+}
+
+// Position of `block`, found through its first key; blocks that share
+// that key are told apart by a short scan. Returns -1 if it is not listed.
+int directoryPosition(const BlockDirectory *directory, const Block *block) {
+    if (blockRecordCount(block) > 0) {
+        int key = blockRecordAt(block, 0)->id;
+        for (int pos = directoryFind(directory, key);
+             pos >= 0 && pos < directory->count && directory->entries[pos].minKey <= key; pos++) {
+            if (directory->entries[pos].block == block) {
+                return pos;
+            }
+        }
+    }
+    for (int pos = 0; pos < directory->count; pos++) {
+        if (directory->entries[pos].block == block) {
+            return pos;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include "block_pool.h"
+
+static void initSlabAllocator(SlabAllocator *allocator, size_t itemSize) {
+    // Items must be able to hold the free-list link
+    allocator->itemSize = itemSize < sizeof(void *) ? sizeof(void *) : itemSize;
+    allocator->freeList = NULL;
+    allocator->next = allocator->end = NULL;
+    allocator->slabItems = POOL_FIRST_SLAB;
+    allocator->slabs = NULL;
+    allocator->slabCount = 0;
+    allocator->slabCapacity = 0;
+}
+
+static void freeSlabAllocator(SlabAllocator *allocator) {
+    for (int i = 0; i < allocator->slabCount; i++) {
+        free(allocator->slabs[i]);
+    }
+    free(allocator->slabs);
+}
+
+static void *slabAlloc(SlabAllocator *allocator) {
+    if (allocator->freeList) {
+        void *item = allocator->freeList;
+        allocator->freeList = *(void **)item;
+        return item;
+    }
+
+    if (allocator->next == allocator->end) {
+        size_t size = allocator->slabItems * allocator->itemSize;
+        void *slab;
+        if (posix_memalign(&slab, POOL_ALIGNMENT, size) != 0) {
+            return NULL;
+        }
+        if (allocator->slabCount == allocator->slabCapacity) {
+            allocator->slabCapacity = allocator->slabCapacity ? allocator->slabCapacity * 2 : 8;
+            allocator->slabs = (void **)realloc(allocator->slabs, allocator->slabCapacity * sizeof(void *));
+        }
+        allocator->slabs[allocator->slabCount++] = slab;
+        allocator->next = (char *)slab;
+        allocator->end = (char *)slab + size;
+
+        if ((allocator->slabItems * 2) * allocator->itemSize <= POOL_MAX_SLAB_SIZE) {
+            allocator->slabItems *= 2;
+        }
+    }
+
+    void *item = allocator->next;
+    allocator->next += allocator->itemSize;
+    return item;
+}
+
+static void slabFree(SlabAllocator *allocator, void *item) {
+    *(void **)item = allocator->freeList;
+    allocator->freeList = item;
+}
+
+BlockPool *createBlockPool(int blockSize, int recordSpace) {
+    BlockPool *pool = (BlockPool *)malloc(sizeof(BlockPool));
+    pool->blockSize = blockSize;
+    pool->recordSpace = recordSpace;
+    initSlabAllocator(&pool->blocks, sizeof(Block));
+    // Keep every block's data aligned like the first one
+    initSlabAllocator(&pool->data, ((size_t)blockSize + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1));
+    return pool;
+}
+
+// Release every block of the pool at once, in O(slabs)
+void freeBlockPool(BlockPool *pool) {
+    if (pool) {
+        freeSlabAllocator(&pool->blocks);
+        freeSlabAllocator(&pool->data);
+        free(pool);
+    }
+}
+
+// An empty block
+Block *poolAllocBlock(BlockPool *pool) {
+    Block *block = (Block *)slabAlloc(&pool->blocks);
+    blockInit(block, (char *)slabAlloc(&pool->data), pool->blockSize, 0);
+    block->recordSpace = pool->recordSpace;
+    blockFormat(block);
+    return block;
+}
+
+// A block wrapping `data`, like createMappedBlock
+Block *poolAllocMappedBlock(BlockPool *pool, char *data) {
+    Block *block = (Block *)slabAlloc(&pool->blocks);
+    blockInit(block, data, pool->blockSize, BLOCK_MAPPED);
+    block->recordSpace = pool->recordSpace;
+    return block;
+}
+
+// An empty block around `data`, a slot of a block table
+Block *poolAllocTableBlock(BlockPool *pool, char *data) {
+    Block *block = (Block *)slabAlloc(&pool->blocks);
+    blockInit(block, data, pool->blockSize, BLOCK_TABLE);
+    block->recordSpace = pool->recordSpace;
+    blockFormat(block);
+    return block;
+}
+
+// A block of a paged file, its data in a buffer pool frame once pinned
+Block *poolAllocPagedBlock(BlockPool *pool) {
+    Block *block = (Block *)slabAlloc(&pool->blocks);
+    blockInit(block, NULL, pool->blockSize, BLOCK_PAGED);
+    block->recordSpace = pool->recordSpace;
+    return block;
+}
+
+void poolFreeBlock(BlockPool *pool, Block *block) {
+    if (!(block->flags & (BLOCK_MAPPED | BLOCK_TABLE | BLOCK_PAGED))) {
+        slabFree(&pool->data, block->data);
+    }
+    slabFree(&pool->blocks, block);
+}
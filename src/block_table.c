@@ -0,0 +1,161 @@
+#define _GNU_SOURCE // mremap
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "block_table.h"
+
+BlockTable *createBlockTable(int blockSize) {
+    BlockTable *table = (BlockTable *)calloc(1, sizeof(BlockTable));
+    table->blockSize = blockSize;
+    return table;
+}
+
+void freeBlockTable(BlockTable *table) {
+    if (table) {
+        if (table->region) {
+            munmap(table->region, (size_t)table->slotCapacity * table->blockSize);
+        }
+        free(table->freeSlots);
+        free(table->blocks);
+        free(table);
+    }
+}
+
+// Re-point every block at its slot after the region moved from `old`
+static void rebase(BlockTable *table, char *old) {
+    for (int i = 0; i < table->count; i++) {
+        Block *block = table->blocks[i];
+        block->data = table->region + (block->data - old);
+    }
+}
+
+// Double the region. mremap moves the pages instead of copying them, and
+// only the block data pointers need fixing up afterwards.
+static int growRegion(BlockTable *table) {
+    size_t oldSize = (size_t)table->slotCapacity * table->blockSize;
+    int capacity = table->slotCapacity ? table->slotCapacity * 2 : TABLE_FIRST_SLOTS;
+    size_t newSize = (size_t)capacity * table->blockSize;
+    char *region;
+
+    if (table->region) {
+        region = (char *)mremap(table->region, oldSize, newSize, MREMAP_MAYMOVE);
+    } else {
+        region = (char *)mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (region == MAP_FAILED) {
+        return 0;
+    }
+
+    char *old = table->region;
+    table->region = region;
+    table->slotCapacity = capacity;
+    if (old && region != old) {
+        rebase(table, old);
+    }
+    return 1;
+}
+
+// blockSize bytes for a new block: a dropped block's slot, or the next
+// unused one. Growing the region moves the data of the blocks already in
+// the table, so a block has to be inserted before the next allocation.
+// Returns NULL when the region cannot grow.
+char *tableAllocData(BlockTable *table) {
+    if (table->freeCount > 0) {
+        return table->region + (size_t)table->freeSlots[--table->freeCount] * table->blockSize;
+    }
+    if (table->slotCount == table->slotCapacity && !growRegion(table)) {
+        return NULL;
+    }
+    return table->region + (size_t)table->slotCount++ * table->blockSize;
+}
+
+// Grow the region until `slots` more blocks can be allocated without
+// growing it again, so an operation that adds several blocks can find out
+// up front whether it will get them. Returns 0 when the region cannot grow.
+int tableReserve(BlockTable *table, int slots) {
+    while (table->freeCount + table->slotCapacity - table->slotCount < slots) {
+        if (!growRegion(table)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void tableFreeData(BlockTable *table, char *data) {
+    if (table->freeCount == table->freeCapacity) {
+        table->freeCapacity = table->freeCapacity ? table->freeCapacity * 2 : 16;
+        table->freeSlots = (int *)realloc(table->freeSlots, table->freeCapacity * sizeof(int));
+    }
+    table->freeSlots[table->freeCount++] = (int)((data - table->region) / table->blockSize);
+}
+
+// Renumber the blocks from position `from` on
+static void renumber(BlockTable *table, int from) {
+    for (int i = from; i < table->count; i++) {
+        table->blocks[i]->position = i;
+    }
+}
+
+// Add `block` at position `pos`, shifting later blocks back. Only the
+// pointers move; the block data stays in its slot.
+void tableInsert(BlockTable *table, int pos, Block *block) {
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 16;
+        table->blocks = (Block **)realloc(table->blocks, table->capacity * sizeof(Block *));
+    }
+    memmove(&table->blocks[pos + 1], &table->blocks[pos], (table->count - pos) * sizeof(Block *));
+    table->blocks[pos] = block;
+    table->count++;
+    renumber(table, pos);
+}
+
+void tableRemove(BlockTable *table, int pos) {
+    memmove(&table->blocks[pos], &table->blocks[pos + 1], (table->count - pos - 1) * sizeof(Block *));
+    table->count--;
+    table->blocks[table->count]->position = -1;
+    renumber(table, pos);
+}
+
+// Whether block i is in slot i for every block
+int tableIsPacked(const BlockTable *table) {
+    if (table->slotCount != table->count) {
+        return 0;
+    }
+    for (int i = 0; i < table->count; i++) {
+        if (table->blocks[i]->data != table->region + (size_t)i * table->blockSize) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Lay the blocks out in file order, block i in slot i, in a region sized
+// for them, so sequential scans read it front to back and it can be
+// written out in one piece. Keeps the old layout if no region is left.
+void tablePack(BlockTable *table) {
+    if (tableIsPacked(table)) {
+        return;
+    }
+
+    int capacity = TABLE_FIRST_SLOTS;
+    while (capacity < table->count) {
+        capacity *= 2;
+    }
+    size_t size = (size_t)capacity * table->blockSize;
+    char *region = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return;
+    }
+
+    for (int i = 0; i < table->count; i++) {
+        Block *block = table->blocks[i];
+        char *data = region + (size_t)i * table->blockSize;
+        memcpy(data, block->data, table->blockSize);
+        block->data = data;
+    }
+    munmap(table->region, (size_t)table->slotCapacity * table->blockSize);
+    table->region = region;
+    table->slotCapacity = capacity;
+    table->slotCount = table->count;
+    table->freeCount = 0;
+}
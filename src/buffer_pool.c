@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "buffer_pool.h"
+
+#define FRAME_ALIGNMENT 64
+
+// A page-in or write-back that fails leaves the block with no valid copy
+// in memory, and the operation that needed it has no way to go on
+static void ioFailed(const char *what) {
+    perror(what);
+    abort();
+}
+
+static void transfer(int fd, int write, char *buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t moved = write ? pwrite(fd, buffer, size, offset) : pread(fd, buffer, size, offset);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved <= 0) {
+            ioFailed(write ? "Error writing back a block" : "Error reading a block");
+        }
+        buffer += moved;
+        size -= moved;
+        offset += moved;
+    }
+}
+
+// Frames take their memory when first used, so a large budget costs
+// nothing until the file is actually read. `base` is where slot 0 of the
+// saved file starts; the pool takes over `fd`.
+BufferPool *createBufferPool(int fd, const char *path, int blockSize, off_t base, size_t budget) {
+    BufferPool *pool = (BufferPool *)calloc(1, sizeof(BufferPool));
+    pool->fd = fd;
+    pool->path = strdup(path);
+    pool->spillFd = -1;
+    pool->blockSize = blockSize;
+    pool->base = base;
+    pool->frameBudget = (int)(budget / blockSize);
+    if (pool->frameBudget < BUFFER_POOL_MIN_FRAMES) {
+        pool->frameBudget = BUFFER_POOL_MIN_FRAMES;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+void freeBufferPool(BufferPool *pool) {
+    if (!pool) {
+        return;
+    }
+    for (int i = 0; i < pool->frameCount; i++) {
+        free(pool->frames[i].data);
+    }
+    free(pool->frames);
+    free(pool->spillFree);
+    free(pool->touched);
+    if (pool->spillFd >= 0) {
+        close(pool->spillFd);
+    }
+    if (pool->fd >= 0) {
+        close(pool->fd);
+    }
+    free(pool->path);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+// Slot of the spill file for `block`'s next write-back
+static int spillSlotFor(BufferPool *pool, Block *block) {
+    if (block->spillSlot >= 0) {
+        return block->spillSlot;
+    }
+    if (pool->spillFd < 0) {
+        char name[4096];
+        snprintf(name, sizeof(name), "%s.spill.XXXXXX", pool->path);
+        pool->spillFd = mkstemp(name);
+        if (pool->spillFd < 0) {
+            ioFailed("Error creating spill file");
+        }
+        unlink(name);
+    }
+    block->spillSlot = pool->spillFreeCount ? pool->spillFree[--pool->spillFreeCount] : pool->spillCount++;
+    return block->spillSlot;
+}
+
+static void releaseSpillSlot(BufferPool *pool, Block *block) {
+    if (pool->spillFreeCount == pool->spillCapacity) {
+        pool->spillCapacity = pool->spillCapacity ? pool->spillCapacity * 2 : 16;
+        pool->spillFree = (int *)realloc(pool->spillFree, pool->spillCapacity * sizeof(int));
+    }
+    pool->spillFree[pool->spillFreeCount++] = block->spillSlot;
+    block->spillSlot = -1;
+}
+
+static void evict(BufferPool *pool, BufferFrame *frame) {
+    Block *block = frame->block;
+
+    if (block->flags & BLOCK_DIRTY) {
+        int slot = spillSlotFor(pool, block);
+        transfer(pool->spillFd, 1, frame->data, pool->blockSize, (off_t)slot * pool->blockSize);
+        pool->writeBacks++;
+    }
+    block->data = NULL;
+    block->frame = -1;
+    frame->block = NULL;
+    pool->evictions++;
+}
+
+// Frames taken past the budget while every frame was pinned go again as
+// soon as their blocks are unpinned, evicting those blocks; the last frame
+// moves into the place of each one retired
+static void retireSurplus(BufferPool *pool) {
+    for (int i = pool->frameCount - 1; i >= 0 && pool->frameCount > pool->frameBudget; i--) {
+        BufferFrame *frame = &pool->frames[i];
+        if (frame->block && frame->block->pins > 0) {
+            continue;
+        }
+        if (frame->block) {
+            evict(pool, frame);
+        }
+        free(frame->data);
+
+        BufferFrame *last = &pool->frames[--pool->frameCount];
+        if (frame != last) {
+            *frame = *last;
+            if (frame->block) {
+                frame->block->frame = i;
+            }
+        }
+    }
+    if (pool->hand >= pool->frameCount) {
+        pool->hand = 0;
+    }
+}
+
+// A frame to put a block in: a new one while the budget allows, then the
+// first unpinned one the CLOCK hand finds whose block was not pinned since
+// the hand last passed it, evicting that block
+static int takeFrame(BufferPool *pool) {
+    if (pool->frameCount >= pool->frameBudget) {
+        for (int looked = 0; looked < 2 * pool->frameCount; looked++) {
+            int i = pool->hand;
+            BufferFrame *frame = &pool->frames[i];
+
+            pool->hand = (pool->hand + 1) % pool->frameCount;
+            if (frame->block && frame->block->pins > 0) {
+                continue;
+            }
+            if (frame->block && frame->referenced) {
+                frame->referenced = 0;
+                continue;
+            }
+            if (frame->block) {
+                evict(pool, frame);
+            }
+            return i;
+        }
+    }
+
+    // Every frame is pinned, or the budget is not used up yet
+    pool->frames = (BufferFrame *)realloc(pool->frames, (pool->frameCount + 1) * sizeof(BufferFrame));
+    BufferFrame *frame = &pool->frames[pool->frameCount];
+    void *data;
+    if (posix_memalign(&data, FRAME_ALIGNMENT, pool->blockSize) != 0) {
+        ioFailed("Error allocating a frame");
+    }
+    frame->data = (char *)data;
+    frame->block = NULL;
+    return pool->frameCount++;
+}
+
+// Keep `block` in memory until bufferPoolUnpin, reading it in first if it
+// has no frame: from the spill file if it was evicted dirty, from its slot
+// of the saved file if clean. A block never written anywhere gets an
+// uninitialized frame to be formatted.
+void bufferPoolPin(BufferPool *pool, Block *block) {
+    pthread_mutex_lock(&pool->lock);
+    if (block->data) {
+        pool->frames[block->frame].referenced = 1;
+        block->pins++;
+        pool->hits++;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    int index = takeFrame(pool);
+    BufferFrame *frame = &pool->frames[index];
+    if (block->spillSlot >= 0) {
+        transfer(pool->spillFd, 0, frame->data, pool->blockSize, (off_t)block->spillSlot * pool->blockSize);
+        pool->misses++;
+    } else if (block->diskBlock >= 0) {
+        transfer(pool->fd, 0, frame->data, pool->blockSize, pool->base + (off_t)block->diskBlock * pool->blockSize);
+        pool->misses++;
+    }
+    frame->block = block;
+    frame->referenced = 1;
+    block->data = frame->data;
+    block->frame = index;
+    block->pins = 1;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void bufferPoolUnpin(BufferPool *pool, Block *block) {
+    pthread_mutex_lock(&pool->lock);
+    block->pins--;
+    retireSurplus(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Pin `block` until bufferPoolUnpinTouched, for writes, which touch a few
+// blocks here and there and release them all when they end. Writes run
+// alone, so one list serves them all.
+Block *bufferPoolTouch(BufferPool *pool, Block *block) {
+    bufferPoolPin(pool, block);
+    if (pool->touchedCount == pool->touchedCapacity) {
+        pool->touchedCapacity = pool->touchedCapacity ? pool->touchedCapacity * 2 : 16;
+        pool->touched = (Block **)realloc(pool->touched, pool->touchedCapacity * sizeof(Block *));
+    }
+    pool->touched[pool->touchedCount++] = block;
+    return block;
+}
+
+void bufferPoolUnpinTouched(BufferPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->touchedCount; i++) {
+        pool->touched[i]->pins--;
+    }
+    pool->touchedCount = 0;
+    retireSurplus(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Forget a block that is being freed, with its frame and spill image
+void bufferPoolDrop(BufferPool *pool, Block *block) {
+    pthread_mutex_lock(&pool->lock);
+    if (block->frame >= 0) {
+        pool->frames[block->frame].block = NULL;
+        block->data = NULL;
+        block->frame = -1;
+    }
+    if (block->spillSlot >= 0) {
+        releaseSpillSlot(pool, block);
+    }
+    int kept = 0;
+    for (int i = 0; i < pool->touchedCount; i++) {
+        if (pool->touched[i] != block) {
+            pool->touched[kept++] = pool->touched[i];
+        }
+    }
+    pool->touchedCount = kept;
+    block->pins = 0;
+    retireSurplus(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// The blocks from `head` on were just written to their slots by a save or
+// flush: the spill images of clean ones are obsolete, and blocks are read
+// from `fd` (the file saved to, or -1 if it is the same one) from now on
+void bufferPoolSettle(BufferPool *pool, Block *head, int fd) {
+    pthread_mutex_lock(&pool->lock);
+    for (Block *block = head; block; block = block->next) {
+        if (block->spillSlot >= 0 && !(block->flags & BLOCK_DIRTY)) {
+            releaseSpillSlot(pool, block);
+        }
+    }
+    if (fd >= 0 && fd != pool->fd) {
+        close(pool->fd);
+        pool->fd = fd;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
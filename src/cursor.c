@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include "cursor.h"
+
+// Make `block` (may be NULL) the one being scanned, keeping it and the
+// rest of a record it starts pinned while it is
+static void moveTo(Cursor *cursor, Block *block) {
+    if (block) {
+        pinSpan(cursor->file, block);
+        STAT_ADD(cursor->file, blocksWalked, 1);
+    }
+    if (cursor->block) {
+        unpinSpan(cursor->file, cursor->block);
+    }
+    cursor->block = block;
+    cursor->slot = 0;
+}
+
+// Scan every live record in file order. With concurrency enabled the
+// cursor reads one copy of the file until it is closed (see readBegin).
+void cursorOpen(Cursor *cursor, SequentialFile *file) {
+    cursor->opened = file;
+    cursor->file = readBegin(file);
+    cursor->block = NULL;
+    moveTo(cursor, cursor->file->head);
+    cursor->bounded = 0;
+    cursor->startKey = cursor->endKey = 0;
+    cursor->buffer = NULL;
+    cursor->capacity = 0;
+}
+
+// Scan the live records with keys in [startKey, endKey]. Ordered files
+// start at the first candidate slot, found through the block directory,
+// and stop at the first key past endKey; unordered files are filtered.
+void cursorOpenRange(Cursor *cursor, SequentialFile *file, int startKey, int endKey) {
+    cursorOpen(cursor, file);
+    cursor->bounded = 1;
+    cursor->startKey = startKey;
+    cursor->endKey = endKey;
+
+    // Whichever copy the cursor reads
+    file = cursor->file;
+    if (file->isOrdered) {
+        int pos = directoryFind(file->directory, startKey);
+        moveTo(cursor, pos < 0 ? NULL : file->directory->entries[pos].block);
+        cursor->slot = pos < 0 ? 0 : blockLowerBound(cursor->block, startKey);
+    }
+}
+
+// Add what a cursorNext call looked at to the file's counters at once, so
+// readers scanning side by side do not contend on them slot by slot
+static void countSlots(Cursor *cursor, int examined, int skipped) {
+    STAT_ADD(cursor->file, recordsExamined, examined);
+    STAT_ADD(cursor->file, tombstonesSkipped, skipped);
+}
+
+// The next record, or NULL at the end of the scan
+Record *cursorNext(Cursor *cursor) {
+    int examined = 0;
+    int skipped = 0;
+
+    while (cursor->block) {
+        Block *block = cursor->block;
+
+        while (cursor->slot < blockRecordCount(block)) {
+            Record *record = blockRecordAt(block, cursor->slot++);
+            examined++;
+
+            if (cursor->bounded && (record->id < cursor->startKey || record->id > cursor->endKey)) {
+                if (cursor->file->isOrdered && record->id > cursor->endKey) {
+                    countSlots(cursor, examined, skipped);
+                    moveTo(cursor, NULL);
+                    return NULL;
+                }
+                continue;
+            }
+            if (record->flags & RECORD_DELETED) {
+                skipped++;
+            } else if (!(record->flags & RECORD_CONTINUATION)) {
+                countSlots(cursor, examined, skipped);
+                return blockJoinRecord(block, record, &cursor->buffer, &cursor->capacity);
+            }
+        }
+        moveTo(cursor, block->next);
+    }
+    if (cursor->file) {
+        countSlots(cursor, examined, skipped);
+    }
+    return NULL;
+}
+
+void cursorClose(Cursor *cursor) {
+    if (cursor->file) {
+        moveTo(cursor, NULL);
+        readEnd(cursor->opened, cursor->file);
+        cursor->file = NULL;
+    }
+    free(cursor->buffer);
+    cursor->buffer = NULL;
+    cursor->block = NULL;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <time.h>
+#include "file_stats.h"
+
+static const char *operationNames[STAT_OPERATIONS] = {
+    "lookup", "insert", "batch insert", "update", "delete", "scan", "compact", "save", "flush", "load",
+};
+
+unsigned long long statClock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void statRecordLatency(FileCounters *counters, StatOperation operation, unsigned long long ns) {
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if (bucket >= STAT_BUCKETS) {
+        bucket = STAT_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&counters->latency[operation][bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counters->totalNs[operation], ns, __ATOMIC_RELAXED);
+}
+
+// Copy counters that may still be counting, one at a time
+void statCopyCounters(FileCounters *to, const FileCounters *from) {
+    const unsigned long long *source = (const unsigned long long *)from;
+    unsigned long long *target = (unsigned long long *)to;
+
+    for (size_t i = 0; i < sizeof(FileCounters) / sizeof(unsigned long long); i++) {
+        target[i] = __atomic_load_n(&source[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Zero counters that may still be counting, one at a time
+void statClearCounters(FileCounters *counters) {
+    unsigned long long *target = (unsigned long long *)counters;
+
+    for (size_t i = 0; i < sizeof(FileCounters) / sizeof(unsigned long long); i++) {
+        __atomic_store_n(&target[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+unsigned long long statCount(const FileCounters *counters, StatOperation operation) {
+    unsigned long long count = 0;
+    for (int bucket = 0; bucket < STAT_BUCKETS; bucket++) {
+        count += counters->latency[operation][bucket];
+    }
+    return count;
+}
+
+// Upper bound in ns of the bucket holding the `fraction` quantile of an
+// operation's latencies, 0 if it never ran
+unsigned long long statPercentile(const FileCounters *counters, StatOperation operation, double fraction) {
+    unsigned long long count = statCount(counters, operation);
+    unsigned long long rank = (unsigned long long)(fraction * count);
+    unsigned long long seen = 0;
+
+    if (count == 0) {
+        return 0;
+    }
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    for (int bucket = 0; bucket < STAT_BUCKETS; bucket++) {
+        seen += counters->latency[operation][bucket];
+        if (seen > rank) {
+            return 1ull << bucket;
+        }
+    }
+    return 1ull << (STAT_BUCKETS - 1);
+}
+
+void printFileStats(const FileStats *stats) {
+    const FileCounters *counters = &stats->counters;
+
+    printf("\nFile Statistics:\n");
+    printf("+--------------+------------+------------+------------+------------+\n");
+    printf("| Operation    | Count      | Mean (us)  | p50 (us) < | p99 (us) < |\n");
+    printf("+--------------+------------+------------+------------+------------+\n");
+    for (int operation = 0; operation < STAT_OPERATIONS; operation++) {
+        unsigned long long count = statCount(counters, (StatOperation)operation);
+        if (count == 0) {
+            continue;
+        }
+        printf("| %-12s | %-10llu | %-10.2f | %-10.2f | %-10.2f |\n", operationNames[operation], count,
+               counters->totalNs[operation] / 1000.0 / count,
+               statPercentile(counters, (StatOperation)operation, 0.50) / 1000.0,
+               statPercentile(counters, (StatOperation)operation, 0.99) / 1000.0);
+    }
+    printf("+--------------+------------+------------+------------+------------+\n");
+    if (!stats->countersEnabled) {
+        printf("Counters were compiled out (NO_FILE_STATS).\n");
+    }
+    printf("Blocks walked: %llu (%llu skipped unread), records examined: %llu, tombstones skipped: %llu\n",
+           counters->blocksWalked, counters->blocksSkipped, counters->recordsExamined, counters->tombstonesSkipped);
+    printf("Blocks allocated: %llu, freed: %llu, split: %llu; records relocated: %llu\n",
+           counters->blocksAllocated, counters->blocksFreed, counters->blockSplits, counters->recordsRelocated);
+    printf("Heap allocations: %llu; bytes read: %llu, written: %llu\n", counters->allocations, counters->bytesRead,
+           counters->bytesWritten);
+    printf("Blocks: %d, fill factor: %.1f%%, tombstone ratio: %.1f%% (%zu live, %zu dead, %zu free bytes)\n",
+           stats->blocks, stats->fillFactor * 100, stats->tombstoneRatio * 100, stats->liveBytes, stats->deadBytes,
+           stats->freeBytes);
+    if (stats->pageHits || stats->pageMisses) {
+        printf("Buffer pool hits: %zu, misses: %zu, evictions: %zu, write-backs: %zu\n", stats->pageHits,
+               stats->pageMisses, stats->pageEvictions, stats->pageWriteBacks);
+    }
+}
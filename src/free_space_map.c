@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+#include "free_space_map.h"
+
+// Bucket for `bytes` reclaimable bytes, or -1 if too few to track
+static int bucketFor(int bytes) {
+    if (bytes < (1 << FSM_MIN_SHIFT)) {
+        return -1;
+    }
+
+    int bucket = 0;
+    bytes >>= FSM_MIN_SHIFT + 1;
+    while (bytes && bucket < FSM_BUCKETS - 1) {
+        bytes >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static int reclaimable(const Block *block) {
+    return block->freeSpace + block->deadSpace;
+}
+
+FreeSpaceMap *createFreeSpaceMap(void) {
+    FreeSpaceMap *map = (FreeSpaceMap *)malloc(sizeof(FreeSpaceMap));
+    fsmClear(map);
+    return map;
+}
+
+void freeFreeSpaceMap(FreeSpaceMap *map) {
+    free(map);
+}
+
+// Forget every block. Blocks added again afterwards must first have their
+// fsmBucket reset to -1, as createBlock does.
+void fsmClear(FreeSpaceMap *map) {
+    memset(map->buckets, 0, sizeof(map->buckets));
+}
+
+void fsmRemove(FreeSpaceMap *map, Block *block) {
+    if (block->fsmBucket < 0) {
+        return;
+    }
+
+    if (block->fsmPrev) {
+        block->fsmPrev->fsmNext = block->fsmNext;
+    } else {
+        map->buckets[block->fsmBucket] = block->fsmNext;
+    }
+    if (block->fsmNext) {
+        block->fsmNext->fsmPrev = block->fsmPrev;
+    }
+
+    block->fsmPrev = block->fsmNext = NULL;
+    block->fsmBucket = -1;
+}
+
+// Move `block` to the bucket matching its current reclaimable space
+void fsmUpdate(FreeSpaceMap *map, Block *block) {
+    int bucket = bucketFor(reclaimable(block));
+    if (bucket == block->fsmBucket) {
+        return;
+    }
+
+    fsmRemove(map, block);
+    if (bucket < 0) {
+        return;
+    }
+
+    block->fsmBucket = bucket;
+    block->fsmPrev = NULL;
+    block->fsmNext = map->buckets[bucket];
+    if (block->fsmNext) {
+        block->fsmNext->fsmPrev = block;
+    }
+    map->buckets[bucket] = block;
+}
+
+// First block with at least `needed` reclaimable bytes. Blocks in the
+// bucket `needed` falls into are checked one by one; a block in a higher
+// bucket fits while its bucket is current, but is checked all the same
+// rather than trusted, so a stale entry is passed over instead of handed out.
+Block *fsmFind(FreeSpaceMap *map, int needed) {
+    int bucket = bucketFor(needed);
+    if (bucket < 0) {
+        bucket = 0;
+    }
+
+    for (; bucket < FSM_BUCKETS; bucket++) {
+        for (Block *block = map->buckets[bucket]; block; block = block->fsmNext) {
+            if (reclaimable(block) >= needed) {
+                return block;
+            }
+        }
+    }
+    return NULL;
+}
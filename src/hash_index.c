@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hash_index.h"
+
+#define MIN_CAPACITY 16
+
+static unsigned int bucketOf(const HashIndex *index, int id) {
+    // Fibonacci hashing spreads sequential ids across the table
+    return ((unsigned int)id * 2654435769u) & (index->capacity - 1);
+}
+
+static void allocateEntries(HashIndex *index, int capacity) {
+    index->entries = (IndexEntry *)calloc(capacity, sizeof(IndexEntry));
+    index->capacity = capacity;
+    index->count = 0;
+}
+
+HashIndex *createHashIndex(int capacity) {
+    HashIndex *index = (HashIndex *)malloc(sizeof(HashIndex));
+    int rounded = MIN_CAPACITY;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    allocateEntries(index, rounded);
+    return index;
+}
+
+void freeHashIndex(HashIndex *index) {
+    if (index) {
+        free(index->entries);
+        free(index);
+    }
+}
+
+void hashIndexClear(HashIndex *index) {
+    memset(index->entries, 0, index->capacity * sizeof(IndexEntry));
+    index->count = 0;
+}
+
+static void grow(HashIndex *index) {
+    IndexEntry *old = index->entries;
+    int oldCapacity = index->capacity;
+
+    allocateEntries(index, oldCapacity * 2);
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i].block) {
+            hashIndexPut(index, old[i].id, old[i].block, old[i].offset);
+        }
+    }
+    free(old);
+}
+
+// Grow ahead of time so `count` entries fit without rehashing midway
+void hashIndexReserve(HashIndex *index, int count) {
+    while (count * 4 > index->capacity * 3) {
+        grow(index);
+    }
+}
+
+// Insert or replace the location of `id`
+void hashIndexPut(HashIndex *index, int id, Block *block, int offset) {
+    // Keep the load factor under 0.75 so probe sequences stay short
+    if ((index->count + 1) * 4 > index->capacity * 3) {
+        grow(index);
+    }
+
+    unsigned int mask = index->capacity - 1;
+    unsigned int i = bucketOf(index, id);
+    while (index->entries[i].block && index->entries[i].id != id) {
+        i = (i + 1) & mask;
+    }
+
+    if (!index->entries[i].block) {
+        index->count++;
+    }
+    index->entries[i].id = id;
+    index->entries[i].block = block;
+    index->entries[i].offset = offset;
+}
+
+IndexEntry *hashIndexGet(HashIndex *index, int id) {
+    unsigned int mask = index->capacity - 1;
+    unsigned int i = bucketOf(index, id);
+
+    while (index->entries[i].block) {
+        if (index->entries[i].id == id) {
+            return &index->entries[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+// Remove `id`, returns 1 if it was present. Uses backward-shift deletion so
+// no tombstones accumulate in the table.
+int hashIndexRemove(HashIndex *index, int id) {
+    IndexEntry *entry = hashIndexGet(index, id);
+    if (!entry) {
+        return 0;
+    }
+
+    unsigned int mask = index->capacity - 1;
+    unsigned int hole = entry - index->entries;
+    unsigned int i = (hole + 1) & mask;
+
+    while (index->entries[i].block) {
+        unsigned int home = bucketOf(index, index->entries[i].id);
+        // Move the entry into the hole unless its home lies cyclically
+        // in (hole, i], in which case it is already reachable.
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index->entries[hole] = index->entries[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+
+    index->entries[hole].block = NULL;
+    index->count--;
+    return 1;
+}
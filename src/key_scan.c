@@ -0,0 +1,67 @@
+#include "key_scan.h"
+
+#if !defined(KEY_SCAN_SCALAR) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KEY_SCAN_X86
+#include <immintrin.h>
+#endif
+
+static int scanScalar(const int *keys, int from, int count, int low, int high) {
+    for (; from < count; from++) {
+        if (keys[from] >= low && keys[from] <= high) {
+            return from;
+        }
+    }
+    return count;
+}
+
+#ifdef KEY_SCAN_X86
+// Each pass compares a vector of keys against both bounds; the movemask
+// has one bit per key that is out of range
+__attribute__((target("sse2")))
+static int scanSse2(const int *keys, int from, int count, int low, int high) {
+    __m128i lows = _mm_set1_epi32(low);
+    __m128i highs = _mm_set1_epi32(high);
+
+    for (; from + 4 <= count; from += 4) {
+        __m128i batch = _mm_loadu_si128((const __m128i *)(keys + from));
+        __m128i outside = _mm_or_si128(_mm_cmplt_epi32(batch, lows), _mm_cmpgt_epi32(batch, highs));
+        int inside = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+        if (inside) {
+            return from + __builtin_ctz(inside);
+        }
+    }
+    return scanScalar(keys, from, count, low, high);
+}
+
+__attribute__((target("avx2")))
+static int scanAvx2(const int *keys, int from, int count, int low, int high) {
+    __m256i lows = _mm256_set1_epi32(low);
+    __m256i highs = _mm256_set1_epi32(high);
+
+    for (; from + 8 <= count; from += 8) {
+        __m256i batch = _mm256_loadu_si256((const __m256i *)(keys + from));
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(lows, batch), _mm256_cmpgt_epi32(batch, highs));
+        int inside = ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF;
+        if (inside) {
+            return from + __builtin_ctz(inside);
+        }
+    }
+    // Not scanSse2: mixing its legacy SSE code with the AVX state above
+    // costs more than the few remaining keys
+    return scanScalar(keys, from, count, low, high);
+}
+#endif
+
+// Position of the first of keys[from..count) in [low, high], or `count`
+// if there is none
+int keyScanRange(const int *keys, int from, int count, int low, int high) {
+#ifdef KEY_SCAN_X86
+    // The CPU is probed once at startup, this only reads the result
+    if (__builtin_cpu_supports("avx2")) {
+        return scanAvx2(keys, from, count, low, high);
+    }
+    return scanSse2(keys, from, count, low, high);
+#else
+    return scanScalar(keys, from, count, low, high);
+#endif
+}
@@ -1,8 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "sequential_file.h"
 #include "persistence.h"
+#include "parallel_scan.h"
+
+#define SCRIPT_BATCH_RECORDS 65536  // Most consecutive script inserts staged before they are inserted
 
 // Function prototypes
 void displayMenu();
@@ -12,11 +16,59 @@ void handleReadOne(SequentialFile *file);
 void handleRangeSearch(SequentialFile *file);
 void handleUpdate(SequentialFile *file);
 void handleDelete(SequentialFile *file);
+void handlePayloadSearch(SequentialFile *file);
+int runScript(SequentialFile **file, FILE *in, FILE *out, int quiet);
 
-int main() {
+int main(int argc, char *argv[]) {
     SequentialFile *file = initializeFile(256, 0, 0, 0, 1); // Default file setup
+    enableIndex(file);
     int choice;
 
+    // `--batch [script]` runs commands from a script, or stdin, instead of
+    // the menu; `--quiet` leaves out everything but query results and errors.
+    // `--payload-index` indexes record data for searches by content.
+    const char *script = NULL;
+    int batch = 0, quiet = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                script = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            batch = quiet = 1;
+        } else if (strcmp(argv[i], "--payload-index") == 0) {
+            enablePayloadIndex(file);
+        } else {
+            fprintf(stderr, "Usage: %s [--batch [script]] [--quiet] [--payload-index]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (batch) {
+        FILE *in = script && strcmp(script, "-") != 0 ? fopen(script, "r") : stdin;
+        if (!in) {
+            perror("Error opening script");
+            return 1;
+        }
+        // Quiet results keep the real stdout; the library's messages go nowhere
+        FILE *out = stdout;
+        if (quiet) {
+            out = fdopen(dup(STDOUT_FILENO), "w");
+            if (!out || !freopen("/dev/null", "w", stdout)) {
+                perror("Error redirecting output");
+                return 1;
+            }
+        }
+        setvbuf(out, NULL, _IOFBF, 1 << 16);
+        int failed = runScript(&file, in, out, quiet);
+        freeFile(file);
+        fclose(out);
+        if (in != stdin) {
+            fclose(in);
+        }
+        return failed ? 1 : 0;
+    }
+
     while (1) {
         displayMenu();
         printf("Enter your choice: ");
@@ -25,6 +77,7 @@ int main() {
         switch (choice) {
             case 1:
                 handleInsert(file);
+                commitFile(file);
                 break;
             case 2:
                 handleReadAll(file);
@@ -34,20 +87,32 @@ int main() {
                 break;
             case 4:
                 handleUpdate(file);
+                commitFile(file);
                 break;
             case 5:
                 handleDelete(file);
+                // Reclaim deleted space a few blocks at a time
+                compactFile(file, COMPACT_STEP_BLOCKS);
+                commitFile(file);
                 break;
             case 6:
-                saveFileToDisk(file, "sequential_file.bin");
-                printf("File saved to disk.\n");
+                // Only the blocks changed since the last save are written.
+                // From the first save on, changes are also logged so they
+                // survive a crash before the next one.
+                if (flushFileToDisk(file, "sequential_file.bin", 1) && (file->log || enableWriteAheadLog(file))) {
+                    printf("File saved to disk.\n");
+                }
                 break;
-            case 7:
-                file = loadFileFromDisk("sequential_file.bin");
-                if (file) {
+            case 7: {
+                // Keep the current file if loading fails
+                SequentialFile *loaded = loadFileFromDisk("sequential_file.bin");
+                if (loaded) {
+                    freeFile(file);
+                    file = loaded;
                     printf("File loaded from disk.\n");
                 }
                 break;
+            }
             case 8:
                 deleteFileFromDisk("sequential_file.bin");
                 break;
@@ -58,6 +123,28 @@ int main() {
             case 10:
                 handleRangeSearch(file);
                 break;
+            case 11: {
+                // Only as many blocks as the budget pays for stay in memory
+                size_t megabytes;
+                printf("Enter memory budget in MB: ");
+                scanf("%zu", &megabytes);
+                SequentialFile *loaded = openPagedFile("sequential_file.bin", megabytes << 20);
+                if (loaded) {
+                    freeFile(file);
+                    file = loaded;
+                    printf("File loaded from disk with a %zu MB budget.\n", megabytes);
+                }
+                break;
+            }
+            case 12: {
+                FileStats stats;
+                getFileStats(file, &stats);
+                printFileStats(&stats);
+                break;
+            }
+            case 13:
+                handlePayloadSearch(file);
+                break;
             default:
                 printf("Invalid choice! Please try again.\n");
         }
@@ -78,6 +165,9 @@ void displayMenu() {
     printf("8. Delete File from Disk\n");
     printf("9. Exit\n");
     printf("10. Search Records by Range\n");  
+    printf("11. Load File from Disk within a Memory Budget\n");
+    printf("12. Show File Statistics\n");
+    printf("13. Search Records by Data\n");
     printf("============================\n");
 }
 
@@ -89,9 +179,9 @@ void handleInsert(SequentialFile *file) {
     printf("Enter Record Data: ");
     scanf(" %[^\n]", data);
 
-    Record *record = createRecord(id, data);
+    Record *record = createArenaRecord(file->arena, id, data);
     insertRecord(file, record);
-    freeRecord(record);
+    arenaReset(file->arena);
     printf("Record inserted successfully.\n");
 }
 
@@ -171,7 +261,7 @@ void handleUpdate(SequentialFile *file) {
                     printf("+------------+----------------+\n");
                 }
             } else {
-                printf("Error updating record. The new data might be too large for the available space.\n");
+                printf("Error updating record.\n");
             }
         } else {
             printf("Error reading new data.\n");
@@ -193,3 +283,198 @@ void handleDelete(SequentialFile *file) {
         printf("Record not found.\n");
     }
 }
+
+
+// Search by data; a trailing '*' searches for the data as a prefix
+void handlePayloadSearch(SequentialFile *file) {
+    char data[256];
+    printf("Enter Data to Search (end with * to match a prefix): ");
+    scanf(" %[^\n]", data);
+
+    RecordBatch results;
+    initRecordBatch(&results);
+    size_t length = strlen(data);
+    if (length > 0 && data[length - 1] == '*') {
+        data[length - 1] = '\0';
+        searchRecordsByPayloadPrefix(file, data, &results);
+    } else {
+        searchRecordsByPayload(file, data, &results);
+    }
+
+    if (results.count == 0) {
+        printf("No records found with that data.\n");
+    } else {
+        printf("\nRecords Found:\n");
+        printf("+------------+-----------------+\n");
+        printf("| Record ID  | Data            |\n");
+        printf("+------------+-----------------+\n");
+        const Record *record = (const Record *)results.data;
+        for (size_t i = 0; i < results.count; i++, record = NEXT_RECORD(record)) {
+            printf("| %-10d | %-15s |\n", record->id, record->data);
+        }
+        printf("+------------+-----------------+\n");
+        printf("Total records found: %zu\n", results.count);
+    }
+    freeRecordBatch(&results);
+}
+
+static void printScriptRow(const Record *record, void *arg) {
+    fprintf((FILE *)arg, "%d\t%s\n", record->id, record->data);
+}
+
+// Insert the records staged by consecutive script inserts in one batch
+static void flushScriptInserts(SequentialFile *file, RecordBatch *batch, FILE *out, int quiet) {
+    if (batch->count == 0) {
+        return;
+    }
+    size_t inserted = insertRecordsBatch(file, (const Record *)batch->data, batch->count);
+    if (!quiet) {
+        fprintf(out, "inserted %zu\n", inserted);
+    }
+    recordBatchClear(batch);
+}
+
+// Run the commands of a script, one per line, against `*file`:
+//
+//   insert <id> <data>    update <id> <data>    range <start> <end>
+//   get <id>              delete <id>           save [path]    load [path]
+//   find <data>           prefix <prefix>
+//
+// Blank lines and lines starting with '#' are skipped. Consecutive inserts
+// are staged in a RecordBatch and inserted with insertRecordsBatch. Found
+// records are written to `out` as "<id>\t<data>" lines; unless `quiet`,
+// so is a short acknowledgement of every other command. Errors go to
+// stderr with their line number. Saves default to sequential_file.bin and
+// write only the blocks changed since the file was last saved or loaded.
+// Returns the number of commands that failed.
+int runScript(SequentialFile **file, FILE *in, FILE *out, int quiet) {
+    RecordBatch batch;
+    initRecordBatch(&batch);
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
+    int lineNumber = 0;
+    int failed = 0;
+
+    while ((length = getline(&line, &lineCapacity, in)) >= 0) {
+        lineNumber++;
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = '\0';
+        }
+
+        char command[16];
+        int id = 0, endKey = 0, consumed = 0;
+        char *rest = line;
+        if (sscanf(line, " %15s%n", command, &consumed) != 1 || command[0] == '#') {
+            continue;
+        }
+        rest += consumed;
+        if (strcmp(command, "insert") == 0 || strcmp(command, "update") == 0) {
+            if (sscanf(rest, "%d%n", &id, &consumed) != 1) {
+                fprintf(stderr, "Line %d: %s needs an id\n", lineNumber, command);
+                failed++;
+                continue;
+            }
+            // The data is the rest of the line after one separating space
+            rest += consumed;
+            rest += *rest == ' ';
+        }
+
+        if (strcmp(command, "insert") == 0) {
+            recordBatchAdd(&batch, id, rest);
+            if (batch.count >= SCRIPT_BATCH_RECORDS) {
+                flushScriptInserts(*file, &batch, out, quiet);
+            }
+            continue;
+        }
+        flushScriptInserts(*file, &batch, out, quiet);
+
+        if (strcmp(command, "update") == 0) {
+            if (updateRecord(*file, id, rest)) {
+                if (!quiet) {
+                    fprintf(out, "updated %d\n", id);
+                }
+            } else {
+                fprintf(stderr, "Line %d: error updating record %d\n", lineNumber, id);
+                failed++;
+            }
+        } else if (strcmp(command, "get") == 0 && sscanf(rest, "%d", &id) == 1) {
+            Record *record = searchRecord(*file, id);
+            if (record) {
+                printScriptRow(record, out);
+            } else {
+                fprintf(stderr, "Line %d: record %d not found\n", lineNumber, id);
+                failed++;
+            }
+        } else if (strcmp(command, "delete") == 0 && sscanf(rest, "%d", &id) == 1) {
+            if (deleteRecord(*file, id)) {
+                // Reclaim deleted space a few blocks at a time, as the menu does
+                compactFile(*file, COMPACT_STEP_BLOCKS);
+                if (!quiet) {
+                    fprintf(out, "deleted %d\n", id);
+                }
+            } else {
+                fprintf(stderr, "Line %d: record %d not found\n", lineNumber, id);
+                failed++;
+            }
+        } else if (strcmp(command, "find") == 0 || strcmp(command, "prefix") == 0) {
+            // Like insert data, the searched data is the rest of the line
+            RecordBatch results;
+            initRecordBatch(&results);
+            rest += *rest == ' ';
+            if (command[0] == 'f') {
+                searchRecordsByPayload(*file, rest, &results);
+            } else {
+                searchRecordsByPayloadPrefix(*file, rest, &results);
+            }
+            const Record *record = (const Record *)results.data;
+            for (size_t i = 0; i < results.count; i++, record = NEXT_RECORD(record)) {
+                printScriptRow(record, out);
+            }
+            if (!quiet) {
+                fprintf(out, "found %zu\n", results.count);
+            }
+            freeRecordBatch(&results);
+        } else if (strcmp(command, "range") == 0 && sscanf(rest, "%d %d", &id, &endKey) == 2 && id <= endKey) {
+            size_t found = parallelScan(*file, id, endKey, NULL, printScriptRow, out, 0);
+            if (!quiet) {
+                fprintf(out, "found %zu\n", found);
+            }
+        } else if (strcmp(command, "save") == 0 || strcmp(command, "load") == 0) {
+            char path[4096] = "sequential_file.bin";
+            sscanf(rest, " %4095s", path);
+            if (command[0] == 's') {
+                if (flushFileToDisk(*file, path, 1)) {
+                    if (!quiet) {
+                        fprintf(out, "saved %s\n", path);
+                    }
+                } else {
+                    fprintf(stderr, "Line %d: error saving '%s'\n", lineNumber, path);
+                    failed++;
+                }
+            } else {
+                // Keep the current file if loading fails
+                SequentialFile *loaded = loadFileFromDisk(path);
+                if (loaded) {
+                    freeFile(*file);
+                    *file = loaded;
+                    if (!quiet) {
+                        fprintf(out, "loaded %s\n", path);
+                    }
+                } else {
+                    fprintf(stderr, "Line %d: error loading '%s'\n", lineNumber, path);
+                    failed++;
+                }
+            }
+        } else {
+            fprintf(stderr, "Line %d: invalid command '%s'\n", lineNumber, line);
+            failed++;
+        }
+    }
+
+    flushScriptInserts(*file, &batch, out, quiet);
+    commitFile(*file);
+    freeRecordBatch(&batch);
+    free(line);
+    return failed;
+}
@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "parallel_scan.h"
+#include "key_scan.h"
+
+typedef struct {
+    Block **blocks;         // Blocks to scan, in file order
+    int blockCount;
+    int startKey;
+    int endKey;
+    int isOrdered;
+    RecordPredicate predicate;
+    void *arg;
+    int workers;
+    WorkQueue *queues;      // One per worker
+    MatchBuffer *buffers;   // One per worker
+    MatchSpan *spans;       // One per block
+} ScanJob;
+
+typedef struct {
+    ScanJob *job;
+    int id;
+} Worker;
+
+static void addMatch(MatchBuffer *buffer, Record *record) {
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        buffer->records = (Record **)realloc(buffer->records, buffer->capacity * sizeof(Record *));
+    }
+    buffer->records[buffer->count++] = record;
+}
+
+static void scanBlock(ScanJob *job, int worker, int index) {
+    Block *block = job->blocks[index];
+    MatchBuffer *buffer = &job->buffers[worker];
+    const int *keys = blockKeys(block);
+    int count = blockRecordCount(block);
+    int slot = 0;
+
+    job->spans[index].worker = worker;
+    job->spans[index].start = buffer->count;
+    job->spans[index].count = 0;
+
+    // Unordered blocks whose ids all lie outside the range are not read
+    if (!job->isOrdered && !blockMayHoldRange(block, job->startKey, job->endKey)) {
+        return;
+    }
+
+    // Unordered fixed-length blocks store their records in slot order, so
+    // the key column can be searched for the range directly
+    if (keys && !job->isOrdered) {
+        for (int i = keyScanRange(keys, 0, count, job->startKey, job->endKey); i < count;
+             i = keyScanRange(keys, i + 1, count, job->startKey, job->endKey)) {
+            Record *record = blockRecordAtPosition(block, i);
+            if (!(record->flags & RECORD_DELETED) && (!job->predicate || job->predicate(record, job->arg))) {
+                addMatch(buffer, record);
+            }
+        }
+        job->spans[index].count = buffer->count - job->spans[index].start;
+        return;
+    }
+
+    // Blocks of ordered files are sorted, so the range bounds the slots
+    if (job->isOrdered) {
+        slot = blockLowerBound(block, job->startKey);
+    }
+    for (; slot < count; slot++) {
+        Record *record = blockRecordAt(block, slot);
+
+        if (record->id < job->startKey || record->id > job->endKey) {
+            if (job->isOrdered) break;
+            continue;
+        }
+        if ((record->flags & (RECORD_DELETED | RECORD_CONTINUATION)) ||
+            (job->predicate &&
+             !job->predicate(blockJoinRecord(block, record, &buffer->join, &buffer->joinCapacity), job->arg))) {
+            continue;
+        }
+        addMatch(buffer, record);
+    }
+    job->spans[index].count = buffer->count - job->spans[index].start;
+}
+
+// Next block for `worker`: from the front of its own queue, or stolen
+// from the back of another worker's. Returns -1 when no work is left.
+static int takeBlock(ScanJob *job, int worker) {
+    for (int i = 0; i < job->workers; i++) {
+        WorkQueue *queue = &job->queues[(worker + i) % job->workers];
+        int index = -1;
+
+        pthread_mutex_lock(&queue->lock);
+        if (queue->next < queue->end) {
+            index = i == 0 ? queue->next++ : --queue->end;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= 0) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+static void *runWorker(void *arg) {
+    Worker *worker = (Worker *)arg;
+    int index;
+
+    while ((index = takeBlock(worker->job, worker->id)) >= 0) {
+        scanBlock(worker->job, worker->id, index);
+    }
+    return NULL;
+}
+
+// Hand the matches of block `index` to `callback` (may be NULL), in slot
+// order. Returns their number.
+static size_t deliverMatches(ScanJob *job, int index, RecordCallback callback, void *arg) {
+    MatchSpan *span = &job->spans[index];
+    MatchBuffer *buffer = &job->buffers[span->worker];
+
+    for (size_t i = 0; callback && i < span->count; i++) {
+        Record *record = buffer->records[span->start + i];
+        callback(blockJoinRecord(job->blocks[index], record, &buffer->join, &buffer->joinCapacity), arg);
+    }
+    return span->count;
+}
+
+// Blocks that may hold keys in [startKey, endKey], in file order. Ordered
+// files take them straight from the directory; unordered files need all,
+// which contiguous files take straight from their table.
+static Block **collectBlocks(SequentialFile *file, int startKey, int endKey, int *countOut) {
+    Block **blocks;
+    int count = 0;
+
+    if (file->isOrdered) {
+        BlockDirectory *directory = file->directory;
+        int first = directoryFind(directory, startKey);
+        int last = first < 0 ? -1 : first;
+
+        while (last >= 0 && last < directory->count && directory->entries[last].minKey <= endKey) {
+            last++;
+        }
+        blocks = (Block **)malloc((first < 0 ? 1 : last - first + 1) * sizeof(Block *));
+        for (int pos = first; pos >= 0 && pos < last; pos++) {
+            blocks[count++] = directory->entries[pos].block;
+        }
+    } else if (file->table) {
+        count = file->table->count;
+        blocks = (Block **)malloc((count ? count : 1) * sizeof(Block *));
+        // An empty table may have no block array yet
+        if (count > 0) {
+            memcpy(blocks, file->table->blocks, count * sizeof(Block *));
+        }
+    } else {
+        for (Block *current = file->head; current; current = current->next) {
+            count++;
+        }
+        blocks = (Block **)malloc((count ? count : 1) * sizeof(Block *));
+        count = 0;
+        for (Block *current = file->head; current; current = current->next) {
+            blocks[count++] = current;
+        }
+    }
+
+    *countOut = count;
+    return blocks;
+}
+
+// Scan the records with keys in [startKey, endKey] (INT_MIN and INT_MAX
+// for the whole file) that satisfy `predicate` (NULL for all) on up to
+// `threads` threads, 0 meaning one per online CPU. The blocks are split
+// into one contiguous run per worker, and workers that finish early steal
+// blocks from the others. `callback` (may be NULL) then receives the
+// matches on the calling thread in file order, which for ordered files is
+// key order. The scan reads one copy of the file throughout (see
+// readBegin), so writes from other threads wait to change that copy
+// until it returns; `callback` must not modify the file. Paged files are
+// scanned on the calling thread alone.
+// Returns the number of matching records.
+size_t parallelScan(SequentialFile *file, int startKey, int endKey, RecordPredicate predicate,
+                    RecordCallback callback, void *arg, int threads) {
+    ScanJob job;
+
+    // Workers read the copy the calling thread entered
+    STAT_TIMER(scanStarted);
+    SequentialFile *copy = readBegin(file);
+    job.blocks = collectBlocks(copy, startKey, endKey, &job.blockCount);
+    job.startKey = startKey;
+    job.endKey = endKey;
+    job.isOrdered = copy->isOrdered;
+    job.predicate = predicate;
+    job.arg = arg;
+
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > job.blockCount / SCAN_BLOCKS_PER_THREAD) {
+        threads = job.blockCount / SCAN_BLOCKS_PER_THREAD;
+    }
+    if (threads < 1 || copy->buffers) {
+        threads = 1;
+    }
+    job.workers = threads;
+    job.queues = (WorkQueue *)malloc(threads * sizeof(WorkQueue));
+    job.buffers = (MatchBuffer *)calloc(threads, sizeof(MatchBuffer));
+    job.spans = (MatchSpan *)malloc((job.blockCount ? job.blockCount : 1) * sizeof(MatchSpan));
+
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&job.queues[i].lock, NULL);
+        job.queues[i].next = (int)((long)job.blockCount * i / threads);
+        job.queues[i].end = (int)((long)job.blockCount * (i + 1) / threads);
+    }
+
+    // The calling thread is worker 0
+    Worker *workers = (Worker *)malloc(threads * sizeof(Worker));
+    pthread_t *handles = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    char *started = (char *)calloc(threads, 1);
+    for (int i = 0; i < threads; i++) {
+        workers[i].job = &job;
+        workers[i].id = i;
+        // A worker that fails to start just has its blocks stolen
+        if (i > 0) {
+            started[i] = pthread_create(&handles[i], NULL, runWorker, &workers[i]) == 0;
+        }
+    }
+    size_t matches = 0;
+    if (copy->buffers) {
+        // Blocks of a paged file may be evicted once unpinned, so they are
+        // scanned one at a time on the calling thread, and each one's
+        // matches delivered while it is pinned
+        for (int index = 0; index < job.blockCount; index++) {
+            pinSpan(copy, job.blocks[index]);
+            scanBlock(&job, 0, index);
+            matches += deliverMatches(&job, index, callback, arg);
+            unpinSpan(copy, job.blocks[index]);
+            job.buffers[0].count = 0;
+        }
+    } else {
+        runWorker(&workers[0]);
+    }
+    for (int i = 1; i < threads; i++) {
+        if (started[i]) {
+            pthread_join(handles[i], NULL);
+        }
+    }
+
+    // Merge: blocks in order, each block's matches in slot order
+    for (int index = 0; index < job.blockCount && !copy->buffers; index++) {
+        matches += deliverMatches(&job, index, callback, arg);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&job.queues[i].lock);
+        free(job.buffers[i].records);
+        free(job.buffers[i].join);
+    }
+    free(started);
+    free(handles);
+    free(workers);
+    free(job.spans);
+    free(job.buffers);
+    free(job.queues);
+    free(job.blocks);
+    STAT_ADD(copy, blocksWalked, job.blockCount);
+    readEnd(file, copy);
+    STAT_RECORD(file, STAT_SCAN, scanStarted);
+    return matches;
+}
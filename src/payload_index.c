@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <string.h>
+#include "payload_index.h"
+
+#define MIN_CAPACITY 16
+
+// Removed entries pile up in the sorted array until a merge; writers merge
+// once there are more of them than this plus half the entries in use
+#define RETIRED_SLACK 64
+
+// Entries of the index being sorted, for the comparison below
+static __thread const PayloadEntry *sortEntries;
+
+// FNV-1a, as for the file checksum
+static unsigned int hashData(const char *data) {
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)data; *c; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    const PayloadEntry *x = &sortEntries[*(const int *)a];
+    const PayloadEntry *y = &sortEntries[*(const int *)b];
+    int order = strcmp(x->data, y->data);
+    return order ? order : (x->id > y->id) - (x->id < y->id);
+}
+
+PayloadIndex *createPayloadIndex(void) {
+    PayloadIndex *index = (PayloadIndex *)calloc(1, sizeof(PayloadIndex));
+    index->bucketCount = MIN_CAPACITY;
+    index->buckets = (int *)malloc(MIN_CAPACITY * sizeof(int));
+    memset(index->buckets, 0xff, MIN_CAPACITY * sizeof(int));
+    pthread_mutex_init(&index->lock, NULL);
+    return index;
+}
+
+void payloadIndexClear(PayloadIndex *index) {
+    for (int i = 0; i < index->entryCount; i++) {
+        free(index->entries[i].data);
+    }
+    memset(index->buckets, 0xff, index->bucketCount * sizeof(int));
+    index->entryCount = 0;
+    index->count = 0;
+    index->sortedCount = 0;
+    index->pendingCount = 0;
+    index->retiredCount = 0;
+    index->freeCount = 0;
+}
+
+void freePayloadIndex(PayloadIndex *index) {
+    if (index) {
+        payloadIndexClear(index);
+        free(index->entries);
+        free(index->buckets);
+        free(index->sorted);
+        free(index->pending);
+        free(index->retired);
+        free(index->free);
+        pthread_mutex_destroy(&index->lock);
+        free(index);
+    }
+}
+
+// Double the buckets and chain every entry in use into them again
+static void growBuckets(PayloadIndex *index) {
+    index->bucketCount *= 2;
+    index->buckets = (int *)realloc(index->buckets, index->bucketCount * sizeof(int));
+    memset(index->buckets, 0xff, index->bucketCount * sizeof(int));
+
+    unsigned int mask = index->bucketCount - 1;
+    for (int i = 0; i < index->entryCount; i++) {
+        PayloadEntry *entry = &index->entries[i];
+        if (entry->data) {
+            entry->next = index->buckets[entry->hash & mask];
+            index->buckets[entry->hash & mask] = i;
+        }
+    }
+}
+
+static void growEntries(PayloadIndex *index) {
+    int capacity = index->entryCapacity ? index->entryCapacity * 2 : MIN_CAPACITY;
+    index->entries = (PayloadEntry *)realloc(index->entries, capacity * sizeof(PayloadEntry));
+    index->sorted = (int *)realloc(index->sorted, capacity * sizeof(int));
+    index->pending = (int *)realloc(index->pending, capacity * sizeof(int));
+    index->retired = (int *)realloc(index->retired, capacity * sizeof(int));
+    index->free = (int *)realloc(index->free, capacity * sizeof(int));
+    index->entryCapacity = capacity;
+}
+
+// Sort the pending entries into the sorted array, dropping removed ones
+// from both, and let the removed entries be reused
+static void mergePending(PayloadIndex *index) {
+    sortEntries = index->entries;
+    int pendingCount = 0;
+    for (int i = 0; i < index->pendingCount; i++) {
+        if (index->entries[index->pending[i]].data) {
+            index->pending[pendingCount++] = index->pending[i];
+        }
+    }
+    qsort(index->pending, pendingCount, sizeof(int), compareEntries);
+
+    int *merged = (int *)malloc((index->count ? index->count : 1) * sizeof(int));
+    int count = 0;
+    int i = 0, j = 0;
+    while (i < index->sortedCount || j < pendingCount) {
+        if (i < index->sortedCount && !index->entries[index->sorted[i]].data) {
+            i++;
+        } else if (j == pendingCount ||
+                   (i < index->sortedCount && compareEntries(&index->sorted[i], &index->pending[j]) <= 0)) {
+            merged[count++] = index->sorted[i++];
+        } else {
+            merged[count++] = index->pending[j++];
+        }
+    }
+    memcpy(index->sorted, merged, count * sizeof(int));
+    free(merged);
+    index->sortedCount = count;
+    index->pendingCount = 0;
+
+    memcpy(index->free + index->freeCount, index->retired, index->retiredCount * sizeof(int));
+    index->freeCount += index->retiredCount;
+    index->retiredCount = 0;
+}
+
+// Index a copy of `data` for record `id`
+void payloadIndexAdd(PayloadIndex *index, int id, const char *data) {
+    if (index->count + 1 > index->bucketCount) {
+        growBuckets(index);
+    }
+
+    int slot;
+    if (index->freeCount > 0) {
+        slot = index->free[--index->freeCount];
+    } else {
+        if (index->entryCount == index->entryCapacity) {
+            growEntries(index);
+        }
+        slot = index->entryCount++;
+    }
+
+    PayloadEntry *entry = &index->entries[slot];
+    entry->id = id;
+    entry->hash = hashData(data);
+    entry->data = strdup(data);
+    unsigned int bucket = entry->hash & (index->bucketCount - 1);
+    entry->next = index->buckets[bucket];
+    index->buckets[bucket] = slot;
+    index->pending[index->pendingCount++] = slot;
+    index->count++;
+}
+
+// Remove the entry of record `id` with `data`, returns 1 if it was present
+int payloadIndexRemove(PayloadIndex *index, int id, const char *data) {
+    unsigned int hash = hashData(data);
+    int *link = &index->buckets[hash & (index->bucketCount - 1)];
+
+    while (*link >= 0) {
+        PayloadEntry *entry = &index->entries[*link];
+        if (entry->id == id && entry->hash == hash && strcmp(entry->data, data) == 0) {
+            index->retired[index->retiredCount++] = *link;
+            *link = entry->next;
+            free(entry->data);
+            entry->data = NULL;
+            index->count--;
+            if (index->retiredCount > index->count / 2 + RETIRED_SLACK) {
+                mergePending(index);
+            }
+            return 1;
+        }
+        link = &entry->next;
+    }
+    return 0;
+}
+
+// Append every record whose data is `data` to `results`. Returns their number.
+size_t payloadIndexFind(PayloadIndex *index, const char *data, RecordBatch *results) {
+    unsigned int hash = hashData(data);
+    size_t found = 0;
+
+    for (int i = index->buckets[hash & (index->bucketCount - 1)]; i >= 0; i = index->entries[i].next) {
+        const PayloadEntry *entry = &index->entries[i];
+        if (entry->hash == hash && strcmp(entry->data, data) == 0) {
+            recordBatchAdd(results, entry->id, entry->data);
+            found++;
+        }
+    }
+    return found;
+}
+
+// Append every record whose data starts with `prefix` to `results`, in
+// data order. Returns their number.
+size_t payloadIndexFindPrefix(PayloadIndex *index, const char *prefix, RecordBatch *results) {
+    // Searches running side by side take turns to merge; the sorted
+    // array then stays put until the next write
+    pthread_mutex_lock(&index->lock);
+    if (index->pendingCount > 0 || index->retiredCount > 0) {
+        mergePending(index);
+    }
+    pthread_mutex_unlock(&index->lock);
+
+    // Binary search for the first entry not below the prefix
+    size_t length = strlen(prefix);
+    int low = 0, high = index->sortedCount;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (strcmp(index->entries[index->sorted[mid]].data, prefix) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    size_t found = 0;
+    for (int i = low; i < index->sortedCount; i++) {
+        const PayloadEntry *entry = &index->entries[index->sorted[i]];
+        if (strncmp(entry->data, prefix, length) != 0) {
+            break;
+        }
+        recordBatchAdd(results, entry->id, entry->data);
+        found++;
+    }
+    return found;
+}
@@ -1,61 +1,922 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "persistence.h" // For saving and loading files, refer to persistence.h
+#include "block_codec.h"
+#include "async_io.h"
 
+// FNV-1a over the header fields preceding the checksum and the descriptors
+static unsigned int computeChecksum(const FileHeader *header, const BlockDescriptor *descriptors) {
+    unsigned int hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)header;
 
-void saveFileToDisk(SequentialFile *file, const char *filename) {
-    FILE *fp = fopen(filename, "wb");
-    if (!fp) {
+    for (size_t i = 0; i < offsetof(FileHeader, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    bytes = (const unsigned char *)descriptors;
+    for (size_t i = 0; i < (size_t)header->blockCount * sizeof(BlockDescriptor); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int fileFlags(const SequentialFile *file) {
+    int flags = 0;
+    if (file->isContiguous) flags |= FILE_FLAG_CONTIGUOUS;
+    if (file->isOrdered) flags |= FILE_FLAG_ORDERED;
+    if (file->isFixed) flags |= FILE_FLAG_FIXED;
+    if (file->allowOverlap) flags |= FILE_FLAG_OVERLAP;
+    if (file->index) flags |= FILE_FLAG_INDEXED;
+    if (file->log) flags |= FILE_FLAG_LOGGED;
+    if (file->isCompressed) flags |= FILE_FLAG_COMPRESSED;
+    if (file->payloadIndex) flags |= FILE_FLAG_PAYLOAD_INDEXED;
+    return flags;
+}
+
+// Fill one descriptor per block, in chain order
+static BlockDescriptor *describeBlocks(const SequentialFile *file, int blockCount) {
+    BlockDescriptor *descriptors = (BlockDescriptor *)calloc(blockCount ? blockCount : 1, sizeof(BlockDescriptor));
+    int i = 0;
+    for (Block *current = file->head; current; current = current->next, i++) {
+        descriptors[i].freeSpace = current->freeSpace;
+        descriptors[i].deadSpace = current->deadSpace;
+        descriptors[i].diskBlock = current->diskBlock;
+        if (file->directory) {
+            descriptors[i].minKey = file->directory->entries[i].minKey;
+            descriptors[i].maxKey = file->directory->entries[i].maxKey;
+        }
+    }
+    return descriptors;
+}
+
+static void fillHeader(FileHeader *header, const SequentialFile *file, int blockCount,
+                       const BlockDescriptor *descriptors) {
+    header->magic = FILE_MAGIC;
+    header->version = FILE_VERSION;
+    header->blockSize = file->blockSize;
+    header->flags = fileFlags(file);
+    header->blockCount = blockCount;
+    header->diskBlockCount = file->disk.blockCount;
+    header->recordSize = file->recordSize;
+    header->updateSlack = file->updateSlack;
+    header->generation = file->disk.generation;
+    header->checksum = computeChecksum(header, descriptors);
+}
+
+// Remember that the blocks now live in `filename`
+static void attachFile(SequentialFile *file, const char *filename) {
+    if (file->disk.path != filename) {
+        free(file->disk.path);
+        file->disk.path = strdup(filename);
+    }
+}
+
+static WriteAheadLog *openLog(const char *filename) {
+    char logName[4096];
+    snprintf(logName, sizeof(logName), "%s.wal", filename);
+    return walOpen(logName);
+}
+
+static int writeAt(int fd, const void *buffer, size_t size, off_t offset) {
+    const char *bytes = (const char *)buffer;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0) {
+            return -1;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+// Write the descriptor table after the last slot, then the header that
+// describes it. With `sync`, everything written before (the blocks and
+// the table) is durable before the header is.
+static int writeTable(int fd, const FileHeader *header, const BlockDescriptor *descriptors, int sync) {
+    off_t tableOffset = FILE_HEADER_SIZE + (off_t)header->diskBlockCount * header->blockSize;
+    size_t tableSize = (size_t)header->blockCount * sizeof(BlockDescriptor);
+
+    if (writeAt(fd, descriptors, tableSize, tableOffset) != 0 ||
+        ftruncate(fd, tableOffset + tableSize) != 0 ||
+        (sync && fdatasync(fd) != 0) ||
+        writeAt(fd, header, sizeof(FileHeader), 0) != 0 ||
+        (sync && fdatasync(fd) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Writes of a save in flight together: block images are staged in
+// buffers of AIO_REQUEST_SIZE (or one compressed block, if larger), and a
+// full buffer is written while the next one is filled. Memory that stays
+// put until the save ends, such as a packed region, is written directly.
+typedef struct {
+    AsyncIo *io;
+    size_t bufferSize;
+    char *buffers[AIO_QUEUE_DEPTH];
+    int bufferCount;
+    char *idle[AIO_QUEUE_DEPTH];    // Buffers not being written
+    int idleCount;
+    char *current;      // Buffer being filled, NULL if none
+    size_t used;
+    off_t offset;       // Where the next bytes go in the file
+    int failed;
+} BlockWriter;
+
+static void writerStart(BlockWriter *writer, int fd, int blockSize) {
+    memset(writer, 0, sizeof(*writer));
+    writer->io = aioOpen(fd);
+    writer->bufferSize = AIO_REQUEST_SIZE;
+    if (writer->bufferSize < (size_t)CODEC_BOUND(blockSize)) {
+        writer->bufferSize = CODEC_BOUND(blockSize);
+    }
+    writer->offset = FILE_HEADER_SIZE;
+}
+
+// Wait for one write; a staging buffer it was made from is idle again.
+// Returns 0 if nothing was in flight.
+static int writerReap(BlockWriter *writer) {
+    void *tag;
+    int result = aioWait(writer->io, &tag);
+    if (result == 0) {
+        writer->failed = 1;
+    }
+    if (result > 0 && tag) {
+        writer->idle[writer->idleCount++] = (char *)tag;
+    }
+    return result >= 0;
+}
+
+// Write the staged bytes, if any
+static void writerSubmit(BlockWriter *writer) {
+    if (writer->current && writer->used > 0) {
+        while (aioFull(writer->io) && writerReap(writer)) {
+        }
+        if (!aioSubmit(writer->io, 1, writer->current, writer->used, writer->offset, writer->current)) {
+            writer->failed = 1;
+            writer->idle[writer->idleCount++] = writer->current;
+        }
+        writer->offset += writer->used;
+        writer->current = NULL;
+    }
+}
+
+// Room for `size` (at most bufferSize) bytes, to be kept with writerCommit
+static char *writerReserve(BlockWriter *writer, size_t size) {
+    if (writer->current && writer->used + size > writer->bufferSize) {
+        writerSubmit(writer);
+    }
+    if (!writer->current) {
+        if (writer->idleCount == 0 && writer->bufferCount < AIO_QUEUE_DEPTH) {
+            writer->idle[writer->idleCount++] = writer->buffers[writer->bufferCount++] =
+                (char *)malloc(writer->bufferSize);
+        }
+        while (writer->idleCount == 0) {
+            // Every buffer is being written. If none was in flight after
+            // all, the requests were given up on and every buffer is idle.
+            if (!writerReap(writer)) {
+                memcpy(writer->idle, writer->buffers, writer->bufferCount * sizeof(char *));
+                writer->idleCount = writer->bufferCount;
+            }
+        }
+        writer->current = writer->idle[--writer->idleCount];
+        writer->used = 0;
+    }
+    return writer->current + writer->used;
+}
+
+static void writerCommit(BlockWriter *writer, size_t size) {
+    writer->used += size;
+}
+
+// Write `size` bytes that stay put until writerFinish, in requests of
+// AIO_REQUEST_SIZE
+static void writerWrite(BlockWriter *writer, const void *data, size_t size) {
+    const char *bytes = (const char *)data;
+
+    writerSubmit(writer);
+    while (size > 0) {
+        size_t chunk = size < AIO_REQUEST_SIZE ? size : AIO_REQUEST_SIZE;
+        while (aioFull(writer->io) && writerReap(writer)) {
+        }
+        if (!aioSubmit(writer->io, 1, (void *)bytes, chunk, writer->offset, NULL)) {
+            writer->failed = 1;
+        }
+        bytes += chunk;
+        size -= chunk;
+        writer->offset += chunk;
+    }
+}
+
+// Wait for every write. Returns 1 if all of them succeeded.
+static int writerFinish(BlockWriter *writer) {
+    writerSubmit(writer);
+    while (writerReap(writer)) {
+    }
+    aioClose(writer->io);
+    for (int i = 0; i < writer->bufferCount; i++) {
+        free(writer->buffers[i]);
+    }
+    return !writer->failed;
+}
+
+// Write every block compressed, in chain order, and record the bytes each
+// one takes. A block that does not shrink is written raw.
+static void writeCompressedBlocks(const SequentialFile *file, BlockWriter *writer, BlockDescriptor *descriptors) {
+    char *image = (char *)malloc(file->blockSize);
+    int i = 0;
+
+    for (Block *current = file->head; current; current = current->next, i++) {
+        blockImage(current, image);
+        char *packed = writerReserve(writer, CODEC_BOUND(file->blockSize));
+        int size = codecCompress(image, file->blockSize, packed, file->blockSize - 1);
+        if (size <= 0) {
+            memcpy(packed, image, file->blockSize);
+            size = file->blockSize;
+        }
+        writerCommit(writer, size);
+        descriptors[i].storedSize = size;
+    }
+    free(image);
+}
+
+static void saveLatched(SequentialFile *file, const char *filename) {
+    // Write a temporary file and rename it into place, so a crash never
+    // leaves a truncated file behind and a mapping of the old file stays
+    // valid while it is being replaced
+    char tempName[4096];
+    snprintf(tempName, sizeof(tempName), "%s.tmp", filename);
+
+    int fd = open(tempName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
         perror("Error opening file for writing");
         return;
     }
 
-    // Write header information
-    fwrite(&file->blockSize, sizeof(int), 1, fp);
-    fwrite(&file->isContiguous, sizeof(int), 1, fp);
-    fwrite(&file->isOrdered, sizeof(int), 1, fp);
-    fwrite(&file->isFixed, sizeof(int), 1, fp);
-    fwrite(&file->allowOverlap, sizeof(int), 1, fp);
+    // A full save packs the blocks into slots 0..n-1 in chain order, and
+    // the region of a contiguous file the same way, moving its records. It
+    // starts an unrelated generation, so no log written for another file
+    // at this path can be mistaken for this file's.
+    if (file->table) {
+        tablePack(file->table);
+    }
+    int blockCount = 0;
+    for (Block *current = file->head; current; current = current->next) {
+        blockCount++;
+    }
+    file->disk.blockCount = blockCount;
+    file->disk.freeCount = 0;
+    file->disk.generation = (file->disk.generation + 1) * 2654435761u ^ (unsigned int)time(NULL) ^
+                            ((unsigned int)getpid() << 16);
+
+    // Blocks keep their old slots until the new file is in place: a paged
+    // block not in memory is read back from its slot of the old file
+    BlockDescriptor *descriptors = describeBlocks(file, blockCount);
+    for (int i = 0; i < blockCount; i++) {
+        descriptors[i].diskBlock = i;
+    }
+
+    // Write blocks after the room left for the header, padded so the first
+    // block is page aligned; they are self-contained, so the raw bytes are
+    // enough, and a packed region already holds them in slot order. The
+    // writes are kept in flight while the next blocks are staged.
+    BlockWriter writer;
+    writerStart(&writer, fd, file->blockSize);
+    if (file->isCompressed) {
+        writeCompressedBlocks(file, &writer, descriptors);
+    } else if (file->table && tableIsPacked(file->table)) {
+        writerWrite(&writer, file->table->region, (size_t)blockCount * file->blockSize);
+    } else {
+        for (Block *current = file->head; current; current = current->next) {
+            pinBlock(file, current);
+            memcpy(writerReserve(&writer, current->blockSize), current->data, current->blockSize);
+            writerCommit(&writer, current->blockSize);
+            unpinBlock(file, current);
+        }
+    }
+    writerWrite(&writer, descriptors, (size_t)blockCount * sizeof(BlockDescriptor));
+    int failed = !writerFinish(&writer);
+
+    // The header goes in last, once compression has sized the blocks
+    char page[FILE_HEADER_SIZE] = {0};
+    fillHeader((FileHeader *)page, file, blockCount, descriptors);
+    free(descriptors);
 
-    // Write blocks
-    Block *current = file->head;
-    while (current) {
-        int usedSpace = current->blockSize - current->freeSpace;
-        fwrite(&usedSpace, sizeof(int), 1, fp);
-        fwrite(current->data, sizeof(char), usedSpace, fp);
-        current = current->next;
+    failed = failed || writeAt(fd, page, FILE_HEADER_SIZE, 0) != 0 || fdatasync(fd) != 0;
+    if (close(fd) != 0 || failed) {
+        perror("Error writing file");
+        remove(tempName);
+        return;
+    }
+    if (rename(tempName, filename) != 0) {
+        perror("Error replacing file");
+        remove(tempName);
+        return;
     }
 
-    fclose(fp);
+    // The writer ends where the file does: header page, blocks and table
+    STAT_ADD(file, bytesWritten, writer.offset);
+    STAT_ADD(file, allocations, 1 + writer.bufferCount);
+    attachFile(file, filename);
+    int slot = 0;
+    for (Block *current = file->head; current; current = current->next) {
+        current->diskBlock = slot++;
+        current->flags &= ~BLOCK_DIRTY;
+    }
+    // Blocks not in memory are read from the new file from now on
+    if (file->buffers) {
+        int readFd = open(filename, O_RDONLY);
+        if (readFd < 0) {
+            perror("Error reopening file");
+        }
+        bufferPoolSettle(file->buffers, file->head, readFd);
+    }
+
+    // Everything logged so far is in the saved file; the log starts over
+    // next to it (the file may have moved, or its old log been removed)
+    if (file->log) {
+        walClose(file->log);
+        file->log = openLog(filename);
+        if (file->log) {
+            walReset(file->log, file->disk.generation);
+        }
+    }
 }
 
-SequentialFile *loadFileFromDisk(const char *filename) {
-    FILE *fp = fopen(filename, "rb");
-    if (!fp) {
+// Bring `filename` up to date by writing only the blocks changed since the
+// file was last saved, loaded or flushed, each into its own slot, followed
+// by the descriptor table and the header. New blocks take over the slots
+// of dropped ones before the file grows. Falls back to a full save when
+// the blocks do not live in `filename` yet, and for compressed files,
+// which have no slots. With `sync`, the blocks and the table reach stable
+// storage before the header that describes them.
+//
+// When the file has a log, the flush is a checkpoint: the images of the
+// changed blocks and the new table are logged and made durable first, so
+// a crash while the file is being overwritten is repaired from the log on
+// the next open. The log then starts over.
+// Returns 1 on success, 0 on failure.
+static int flushLatched(SequentialFile *file, const char *filename, int sync) {
+    DiskState *disk = &file->disk;
+    WriteAheadLog *log = file->log;
+
+    if (!disk->path || strcmp(disk->path, filename) != 0 || file->isCompressed) {
+        saveLatched(file, filename);
+        return disk->path && strcmp(disk->path, filename) == 0;
+    }
+
+    int fd = open(filename, O_WRONLY);
+    if (fd < 0 && errno == ENOENT) {
+        // The file was deleted under us, write it anew
+        saveLatched(file, filename);
+        return access(filename, F_OK) == 0;
+    }
+    if (fd < 0) {
+        perror("Error opening file for writing");
+        return 0;
+    }
+
+    int blockCount = 0;
+    int dirtyCount = 0;
+    for (Block *current = file->head; current; current = current->next) {
+        blockCount++;
+        if (current->diskBlock < 0) {
+            current->diskBlock = disk->freeCount ? disk->freeBlocks[--disk->freeCount] : disk->blockCount++;
+        }
+        if (current->flags & BLOCK_DIRTY) {
+            dirtyCount++;
+        }
+    }
+
+    disk->generation++;
+    BlockDescriptor *descriptors = describeBlocks(file, blockCount);
+    FileHeader header = {0};
+    fillHeader(&header, file, blockCount, descriptors);
+    size_t tableSize = (size_t)blockCount * sizeof(BlockDescriptor);
+    int failed = 0;
+
+    if (log) {
+        for (Block *current = file->head; current; current = current->next) {
+            if (current->flags & BLOCK_DIRTY) {
+                pinBlock(file, current);
+                walAppend(log, WAL_BLOCK, current->diskBlock, current->data, current->blockSize);
+                unpinBlock(file, current);
+            }
+        }
+        char *table = (char *)malloc(sizeof(FileHeader) + tableSize);
+        memcpy(table, &header, sizeof(FileHeader));
+        memcpy(table + sizeof(FileHeader), descriptors, tableSize);
+        walAppend(log, WAL_TABLE, 0, table, (int)(sizeof(FileHeader) + tableSize));
+        walAppend(log, WAL_CHECKPOINT, (int)header.generation, NULL, 0);
+        free(table);
+        failed = !walCommit(log);
+        // Dropping the log below relies on the file being durable
+        sync = 1;
+    }
+
+    for (Block *current = file->head; current && !failed; current = current->next) {
+        if (current->flags & BLOCK_DIRTY) {
+            off_t offset = FILE_HEADER_SIZE + (off_t)current->diskBlock * file->blockSize;
+            pinBlock(file, current);
+            failed = writeAt(fd, current->data, current->blockSize, offset) != 0;
+            unpinBlock(file, current);
+        }
+    }
+    if (!failed) {
+        failed = writeTable(fd, &header, descriptors, sync) != 0;
+    }
+    free(descriptors);
+
+    if (close(fd) != 0 || failed) {
+        perror("Error writing file");
+        return 0;
+    }
+    STAT_ADD(file, bytesWritten, (size_t)dirtyCount * file->blockSize + tableSize + sizeof(FileHeader));
+    STAT_ADD(file, allocations, log ? 2 : 1);
+    for (Block *current = file->head; current; current = current->next) {
+        current->flags &= ~BLOCK_DIRTY;
+    }
+    if (file->buffers) {
+        bufferPoolSettle(file->buffers, file->head, -1);
+    }
+    if (log) {
+        walReset(log, disk->generation);
+    }
+    printf("Flushed %d of %d blocks to '%s'.\n", dirtyCount, blockCount, filename);
+    return 1;
+}
+
+void saveFileToDisk(SequentialFile *file, const char *filename) {
+    writeBeginAlone(file);
+    STAT_TIMER(started);
+    saveLatched(file, filename);
+    STAT_RECORD(file, STAT_SAVE, started);
+    writeEnd(file);
+}
+
+int flushFileToDisk(SequentialFile *file, const char *filename, int sync) {
+    writeBeginAlone(file);
+    STAT_TIMER(started);
+    int flushed = flushLatched(file, filename, sync);
+    STAT_RECORD(file, STAT_FLUSH, started);
+    writeEnd(file);
+    return flushed;
+}
+
+// If the log ends with a complete checkpoint, a crash interrupted the
+// flush that followed it: write the logged block images and table into
+// the file again (doing so twice is harmless) and start the log over.
+// Returns 1 if the file was repaired, 0 if there was nothing to repair,
+// -1 on failure.
+static int redoCheckpoint(const char *filename, WriteAheadLog *log) {
+    size_t size;
+    char *contents = walRead(log, &size);
+    size_t pos = sizeof(WalHeader);
+    const WalRecord *record;
+    int generation = 0;
+    int complete = 0;
+
+    while ((record = walNext(log, contents, size, &pos))) {
+        if (record->type == WAL_CHECKPOINT) {
+            generation = record->id;
+            complete = 1;
+        }
+    }
+    if (!complete) {
+        free(contents);
+        return 0;
+    }
+
+    int fd = open(filename, O_WRONLY);
+    int failed = fd < 0;
+    pos = sizeof(WalHeader);
+    while (!failed && (record = walNext(log, contents, size, &pos)) && record->type != WAL_CHECKPOINT) {
+        const char *payload = (const char *)(record + 1);
+        if (record->type == WAL_BLOCK) {
+            failed = writeAt(fd, payload, record->size, FILE_HEADER_SIZE + (off_t)record->id * record->size) != 0;
+        } else if (record->type == WAL_TABLE) {
+            failed = writeTable(fd, (const FileHeader *)payload,
+                                (const BlockDescriptor *)(payload + sizeof(FileHeader)), 1) != 0;
+        }
+    }
+    free(contents);
+
+    if (fd >= 0 && close(fd) != 0) {
+        failed = 1;
+    }
+    if (failed || !walReset(log, (unsigned int)generation)) {
+        perror("Error recovering file from its log");
+        return -1;
+    }
+    printf("Recovered an interrupted flush of '%s' from its log.\n", filename);
+    return 1;
+}
+
+// Apply the operations logged since the file was last flushed, then trim
+// the log after the last intact one so new operations follow it
+static void replayLog(SequentialFile *file, WriteAheadLog *log) {
+    size_t size;
+    char *contents = walRead(log, &size);
+    size_t pos = sizeof(WalHeader);
+    size_t end = pos;
+    const WalRecord *record;
+    int replayed = 0;
+
+    while ((record = walNext(log, contents, size, &pos)) && record->type <= WAL_DELETE) {
+        const char *payload = (const char *)(record + 1);
+        if (record->type == WAL_INSERT) {
+            Record *copy = (Record *)arenaAlloc(file->arena, sizeof(Record) + record->size);
+            copy->id = record->id;
+            copy->size = record->size;
+            copy->flags = 0;
+            copy->slack = 0;
+            memcpy(copy->data, payload, record->size);
+            insertRecord(file, copy);
+            arenaReset(file->arena);
+        } else if (record->type == WAL_UPDATE) {
+            updateRecord(file, record->id, payload);
+        } else {
+            deleteRecord(file, record->id);
+        }
+        end = pos;
+        replayed++;
+    }
+    free(contents);
+
+    if (end < size) {
+        walTruncate(log, end);
+    }
+    if (replayed > 0) {
+        printf("Replayed %d logged operations.\n", replayed);
+    }
+}
+
+// Decompression of a compressed file's blocks while their stored bytes are
+// still being read. Reads complete in any order; `arrived` is how many
+// bytes from the start of `stored` are all in.
+typedef struct {
+    Block **blocks;
+    const BlockDescriptor *descriptors;
+    const char *stored;
+    size_t *starts;         // Where each block's bytes begin in `stored`
+    int count;
+    int next;               // Next block to decompress
+    size_t arrived;
+    int readFailed;
+    int failed;             // A block is corrupt
+    pthread_mutex_t lock;
+    pthread_cond_t progress;    // Signalled when `arrived` grows or reading fails
+} DecompressJob;
+
+// Take the next block and decompress it once its bytes have arrived,
+// until none is left
+static void *decompressRun(void *arg) {
+    DecompressJob *job = (DecompressJob *)arg;
+
+    pthread_mutex_lock(&job->lock);
+    while (job->next < job->count && !job->readFailed && !job->failed) {
+        int i = job->next++;
+        int size = job->descriptors[i].storedSize;
+        while (job->arrived < job->starts[i] + size && !job->readFailed) {
+            pthread_cond_wait(&job->progress, &job->lock);
+        }
+        if (job->readFailed) {
+            break;
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        Block *block = job->blocks[i];
+        const char *source = job->stored + job->starts[i];
+        int intact = 1;
+        if (size == block->blockSize) {
+            memcpy(block->data, source, size);
+        } else {
+            intact = codecDecompress(source, size, block->data, block->blockSize) == block->blockSize;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        if (!intact) {
+            job->failed = 1;
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+// Read the `count` blocks of a compressed file, stored back to back from
+// FILE_HEADER_SIZE in `storedSize` bytes, and decompress them. The stored
+// bytes are read in requests kept in flight while up to one thread per
+// LOAD_BLOCKS_PER_THREAD blocks (and per online CPU) decompresses those
+// already in; the calling thread joins them once it has read everything.
+// Returns 1 on success, 0 if reading fails or a block is corrupt.
+static int readCompressedBlocks(int fd, Block **blocks, const BlockDescriptor *descriptors, int count,
+                                size_t storedSize) {
+    DecompressJob job;
+    char *stored = (char *)malloc(storedSize ? storedSize : 1);
+
+    job.blocks = blocks;
+    job.descriptors = descriptors;
+    job.stored = stored;
+    job.starts = (size_t *)malloc((count + 1) * sizeof(size_t));
+    job.count = count;
+    job.next = 0;
+    job.arrived = 0;
+    job.readFailed = 0;
+    job.failed = 0;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.progress, NULL);
+    size_t start = 0;
+    for (int i = 0; i < count; i++) {
+        job.starts[i] = start;
+        start += descriptors[i].storedSize;
+    }
+
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > count / LOAD_BLOCKS_PER_THREAD) {
+        threads = count / LOAD_BLOCKS_PER_THREAD;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    pthread_t *handles = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    char *started = (char *)calloc(threads, 1);
+    for (int i = 0; i < threads && count > 0; i++) {
+        started[i] = pthread_create(&handles[i], NULL, decompressRun, &job) == 0;
+    }
+
+    // Reads may complete out of order, so `arrived` only moves past
+    // requests that are all done
+    size_t requests = (storedSize + AIO_REQUEST_SIZE - 1) / AIO_REQUEST_SIZE;
+    char *done = (char *)calloc(requests ? requests : 1, 1);
+    size_t submitted = 0;
+    size_t prefix = 0;
+    AsyncIo *io = aioOpen(fd);
+    int readFailed = 0;
+    while (prefix < requests) {
+        while (submitted < requests) {
+            size_t offset = submitted * AIO_REQUEST_SIZE;
+            size_t size = storedSize - offset < AIO_REQUEST_SIZE ? storedSize - offset : AIO_REQUEST_SIZE;
+            if (!aioSubmit(io, 0, stored + offset, size, FILE_HEADER_SIZE + (off_t)offset, (void *)submitted)) {
+                break;
+            }
+            submitted++;
+        }
+
+        void *tag;
+        if (aioWait(io, &tag) <= 0) {
+            readFailed = 1;
+            break;
+        }
+        done[(size_t)tag] = 1;
+        while (prefix < requests && done[prefix]) {
+            prefix++;
+        }
+        pthread_mutex_lock(&job.lock);
+        job.arrived = prefix == requests ? storedSize : prefix * AIO_REQUEST_SIZE;
+        pthread_cond_broadcast(&job.progress);
+        pthread_mutex_unlock(&job.lock);
+    }
+    aioClose(io);
+    if (readFailed) {
+        pthread_mutex_lock(&job.lock);
+        job.readFailed = 1;
+        pthread_cond_broadcast(&job.progress);
+        pthread_mutex_unlock(&job.lock);
+    }
+
+    decompressRun(&job);
+    for (int i = 0; i < threads; i++) {
+        if (started[i]) {
+            pthread_join(handles[i], NULL);
+        }
+    }
+
+    pthread_cond_destroy(&job.progress);
+    pthread_mutex_destroy(&job.lock);
+    free(done);
+    free(started);
+    free(handles);
+    free(job.starts);
+    free(stored);
+    return !job.readFailed && !job.failed;
+}
+
+// Read the blocks of a contiguous file straight into its region, one
+// request per run of blocks that sit side by side both on disk and in
+// the region, keeping the requests in flight together.
+// Returns 1 on success, 0 on failure.
+static int readTableBlocks(int fd, const BlockTable *table) {
+    AsyncIo *io = aioOpen(fd);
+    size_t blockSize = table->blockSize;
+    int failed = 0;
+
+    for (int i = 0; i < table->count && !failed;) {
+        Block *first = table->blocks[i];
+        int run = 1;
+        while (i + run < table->count && (run + 1) * blockSize <= AIO_REQUEST_SIZE &&
+               table->blocks[i + run]->diskBlock == first->diskBlock + run &&
+               table->blocks[i + run]->data == first->data + run * blockSize) {
+            run++;
+        }
+        while (aioFull(io)) {
+            failed |= aioWait(io, NULL) <= 0;
+        }
+        aioSubmit(io, 0, first->data, run * blockSize, FILE_HEADER_SIZE + (off_t)first->diskBlock * blockSize,
+                  NULL);
+        i += run;
+    }
+    failed |= !aioDrain(io);
+    aioClose(io);
+    return !failed;
+}
+
+static int readAt(int fd, void *buffer, size_t size, off_t offset) {
+    char *bytes = (char *)buffer;
+    while (size > 0) {
+        ssize_t count = pread(fd, bytes, size, offset);
+        if (count <= 0) {
+            return -1;
+        }
+        bytes += count;
+        size -= count;
+        offset += count;
+    }
+    return 0;
+}
+
+// Open `filename`, paging its blocks through a buffer pool of `budget`
+// bytes unless `budget` is 0 (see loadFileFromDisk and openPagedFile)
+static SequentialFile *openFile(const char *filename, size_t budget) {
+    STAT_TIMER(started);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         perror("Error opening file for reading");
         return NULL;
     }
 
-    // Read header information
-    int blockSize, isContiguous, isOrdered, isFixed, allowOverlap;
-    fread(&blockSize, sizeof(int), 1, fp);
-    fread(&isContiguous, sizeof(int), 1, fp);
-    fread(&isOrdered, sizeof(int), 1, fp);
-    fread(&isFixed, sizeof(int), 1, fp);
-    fread(&allowOverlap, sizeof(int), 1, fp);
+    struct stat st;
+    FileHeader header;
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header.magic != FILE_MAGIC) {
+        printf("Error: '%s' is not a sequential file\n", filename);
+        close(fd);
+        return NULL;
+    }
+    if (header.version != FILE_VERSION) {
+        printf("Error: '%s' has unsupported format version %d\n", filename, header.version);
+        close(fd);
+        return NULL;
+    }
+
+    // Finish a flush a crash interrupted before looking at the file
+    WriteAheadLog *log = NULL;
+    if (header.flags & FILE_FLAG_LOGGED) {
+        log = openLog(filename);
+        int redone = log ? redoCheckpoint(filename, log) : -1;
+        if (redone < 0 || (redone > 0 && (fstat(fd, &st) != 0 ||
+                                          pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)))) {
+            walClose(log);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    // Compressed blocks take as many bytes as they do, so their descriptors
+    // are found from the end of the file
+    int compressed = (header.flags & FILE_FLAG_COMPRESSED) != 0;
+    off_t tableSize = (off_t)header.blockCount * (off_t)sizeof(BlockDescriptor);
+    off_t blocksEnd = compressed ? st.st_size - tableSize
+                                 : FILE_HEADER_SIZE + (off_t)header.diskBlockCount * header.blockSize;
+    if (header.blockSize <= 0 || header.blockCount < 0 || header.diskBlockCount < header.blockCount ||
+        blocksEnd < FILE_HEADER_SIZE || st.st_size < blocksEnd + tableSize) {
+        printf("Error: '%s' is truncated\n", filename);
+        walClose(log);
+        close(fd);
+        return NULL;
+    }
+    if (budget && (compressed || (header.flags & FILE_FLAG_CONTIGUOUS))) {
+        printf("Error: '%s' cannot be paged; only uncompressed List files can\n", filename);
+        walClose(log);
+        close(fd);
+        return NULL;
+    }
+
+    BlockDescriptor *descriptors = (BlockDescriptor *)malloc(tableSize ? tableSize : 1);
+    int corrupt = readAt(fd, descriptors, tableSize, blocksEnd) != 0 ||
+                  computeChecksum(&header, descriptors) != header.checksum;
+    off_t storedBytes = 0;
+    for (int i = 0; i < header.blockCount && !corrupt; i++) {
+        corrupt = descriptors[i].diskBlock < 0 || descriptors[i].diskBlock >= header.diskBlockCount ||
+                  (compressed && (descriptors[i].storedSize <= 0 || descriptors[i].storedSize > header.blockSize));
+        storedBytes += descriptors[i].storedSize;
+    }
+    if (compressed && !corrupt) {
+        corrupt = storedBytes != blocksEnd - FILE_HEADER_SIZE;
+    }
+    if (corrupt) {
+        printf("Error: '%s' failed its checksum\n", filename);
+        free(descriptors);
+        walClose(log);
+        close(fd);
+        return NULL;
+    }
+
+    // Blocks read in now, or paged in later, need no mapping
+    char *mapping = NULL;
+    if (!budget && !compressed && !(header.flags & FILE_FLAG_CONTIGUOUS)) {
+        mapping = (char *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            perror("Error mapping file");
+            free(descriptors);
+            walClose(log);
+            close(fd);
+            return NULL;
+        }
+    }
 
     // Initialize the file
-    SequentialFile *file = initializeFile(blockSize, isContiguous, isOrdered, isFixed, allowOverlap);
+    SequentialFile *file = initializeFile(header.blockSize,
+                                          (header.flags & FILE_FLAG_CONTIGUOUS) != 0,
+                                          (header.flags & FILE_FLAG_ORDERED) != 0,
+                                          (header.flags & FILE_FLAG_FIXED) != 0,
+                                          (header.flags & FILE_FLAG_OVERLAP) != 0);
+    if (!file) {
+        if (mapping) {
+            munmap(mapping, st.st_size);
+        }
+        free(descriptors);
+        walClose(log);
+        close(fd);
+        return NULL;
+    }
+    if (mapping) {
+        file->mapping = mapping;
+        file->mappingSize = st.st_size;
+    }
+    if (file->isFixed && !setRecordSize(file, header.recordSize)) {
+        printf("Error: '%s' has an invalid record size\n", filename);
+        freeFile(file);
+        free(descriptors);
+        walClose(log);
+        close(fd);
+        return NULL;
+    }
+    // A contiguous file's blocks all take a slot of its region
+    if (file->table && !tableReserve(file->table, header.blockCount)) {
+        printf("Error: No memory for the %d blocks of '%s'\n", header.blockCount, filename);
+        freeFile(file);
+        free(descriptors);
+        walClose(log);
+        close(fd);
+        return NULL;
+    }
+    setUpdateSlack(file, header.updateSlack);
+    file->isCompressed = compressed;
+    attachFile(file, filename);
+    file->disk.blockCount = header.diskBlockCount;
+    file->disk.generation = header.generation;
 
-    // Read blocks
+    // Wrap the mapped blocks, in chain order. Contiguous files take theirs
+    // from the table's region instead, so they end up side by side, and
+    // compressed blocks are given memory to be decompressed into; both are
+    // filled once every block exists, as the region may still move. Paged
+    // blocks have no data until they are pinned.
+    char *used = (char *)calloc(header.diskBlockCount ? header.diskBlockCount : 1, 1);
+    Block **blocks = compressed ? (Block **)malloc((header.blockCount + 1) * sizeof(Block *)) : NULL;
     Block *current = NULL;
-    while (!feof(fp)) {
-        int usedSpace;
-        if (fread(&usedSpace, sizeof(int), 1, fp) != 1) break;
-
-        Block *newBlock = createBlock(blockSize);
-        fread(newBlock->data, sizeof(char), usedSpace, fp);
-        newBlock->freeSpace = blockSize - usedSpace;
+    for (int i = 0; i < header.blockCount; i++) {
+        int diskBlock = descriptors[i].diskBlock;
+        Block *newBlock;
+        if (file->table || compressed) {
+            newBlock = file->table ? poolAllocTableBlock(file->pool, tableAllocData(file->table))
+                                   : poolAllocBlock(file->pool);
+            newBlock->flags &= ~BLOCK_DIRTY;
+            if (file->table) {
+                tableInsert(file->table, i, newBlock);
+            }
+            if (compressed) {
+                blocks[i] = newBlock;
+            }
+        } else if (budget) {
+            newBlock = poolAllocPagedBlock(file->pool);
+        } else {
+            char *data = mapping + FILE_HEADER_SIZE + (size_t)diskBlock * header.blockSize;
+            newBlock = poolAllocMappedBlock(file->pool, data);
+        }
+        newBlock->freeSpace = descriptors[i].freeSpace;
+        newBlock->deadSpace = descriptors[i].deadSpace;
+        newBlock->diskBlock = diskBlock;
+        used[diskBlock] = 1;
 
         if (!file->head) {
             file->head = newBlock;
@@ -63,21 +924,162 @@ SequentialFile *loadFileFromDisk(const char *filename) {
             current->next = newBlock;
         }
         current = newBlock;
+
+        if (file->directory) {
+            directoryInsertKeys(file->directory, i, newBlock, descriptors[i].minKey, descriptors[i].maxKey);
+        }
     }
+    rebuildFreeSpaceMap(file);
 
-    fclose(fp);
+    int intact = 1;
+    if (compressed) {
+        intact = readCompressedBlocks(fd, blocks, descriptors, header.blockCount, (size_t)storedBytes);
+        free(blocks);
+    } else if (file->table) {
+        intact = readTableBlocks(fd, file->table);
+    }
+    if (budget) {
+        // The pool reads the blocks from the file from now on
+        file->buffers = createBufferPool(fd, filename, file->blockSize, FILE_HEADER_SIZE, budget);
+    } else {
+        close(fd);
+    }
+    free(descriptors);
+    if (!intact) {
+        printf("Error: '%s' has a corrupt block\n", filename);
+        free(used);
+        freeFile(file);
+        walClose(log);
+        return NULL;
+    }
+
+    // Slots no block refers to are free for the next flush
+    for (int slot = header.diskBlockCount - 1; slot >= 0; slot--) {
+        if (!used[slot]) {
+            releaseDiskBlock(file, slot);
+        }
+    }
+    free(used);
+
+    // The index holds in-memory locations, so it is rebuilt rather than saved
+    if (header.flags & FILE_FLAG_INDEXED) {
+        enableIndex(file);
+    }
+
+    // A log from another generation is left over from before the file was
+    // last saved in full, and everything in it is already in the file
+    if (log) {
+        if (log->generation == header.generation) {
+            replayLog(file, log);
+        } else {
+            walReset(log, header.generation);
+        }
+        file->log = log;
+    }
+
+    // Built once the log is replayed, from the records as they end up
+    if (header.flags & FILE_FLAG_PAYLOAD_INDEXED) {
+        enablePayloadIndex(file);
+    }
+
+    // Blocks read up front count too; mapped and paged ones are read later
+    off_t bytesRead = sizeof(header) + tableSize;
+    if (compressed) {
+        bytesRead += storedBytes;
+    } else if (file->table) {
+        bytesRead += (off_t)header.blockCount * header.blockSize;
+    }
+    STAT_ADD(file, bytesRead, bytesRead);
+    STAT_ADD(file, allocations, compressed ? 4 : 2);
+    STAT_RECORD(file, STAT_LOAD, started);
     return file;
 }
 
+// Open a saved file without reading it: the file is mapped privately and
+// every Block::data points straight into the mapping, so pages are only
+// read from disk when a record in them is first touched (and copied only
+// when modified). Only the header and the block descriptors are read here,
+// plus the log of a logged file. Contiguous files are the exception: their
+// blocks are read into the region of their table (see block_table.h). So
+// are compressed files, whose blocks are decompressed in parallel as they
+// arrive. Both read through async_io.h, many requests at a time.
+SequentialFile *loadFileFromDisk(const char *filename) {
+    return openFile(filename, 0);
+}
 
+// Open a saved List file whose blocks are paged in on demand, keeping at
+// most `budget` bytes of them in memory (see buffer_pool.h), so files
+// larger than memory can be used. Only the header, the descriptors and
+// whatever the first operations need are read here; a block costs its
+// Block struct and bookkeeping while it is not in memory. Contiguous and
+// compressed files cannot be paged.
+SequentialFile *openPagedFile(const char *filename, size_t budget) {
+    return openFile(filename, budget ? budget : 1);
+}
 
 // Function to delete the sequential file from disk
 int deleteFileFromDisk(const char *filename) {
     if (remove(filename) == 0) {
+        char logName[4096];
+        snprintf(logName, sizeof(logName), "%s.wal", filename);
+        remove(logName); // Its log, if it has one
         printf("File '%s' deleted successfully.\n", filename);
         return 1; // Success
     } else {
         perror("Error deleting file");
         return 0; // Failure
     }
-}
\ No newline at end of file
+}
+
+// Start logging every change to a saved file, so changes made after the
+// last flush survive a crash. The file must have been saved first; the
+// log lives next to it and is reopened with it.
+// Returns 1 on success, 0 on failure.
+int enableWriteAheadLog(SequentialFile *file) {
+    int enabled = 0;
+
+    writeBeginAlone(file);
+    if (!file->disk.path) {
+        printf("Error: The file must be saved before it can be logged\n");
+    } else {
+        if (!file->log) {
+            file->log = openLog(file->disk.path);
+        }
+        // The flush marks the file as logged and ties the log to it
+        enabled = file->log && flushLatched(file, file->disk.path, 1);
+    }
+    writeEnd(file);
+    return enabled;
+}
+
+// Make the logged operations durable (group commit) and, once the log has
+// grown past WAL_CHECKPOINT_SIZE, fold it into the file with a flush.
+// Returns 1 on success, 0 on failure.
+int commitFile(SequentialFile *file) {
+    int committed = 1;
+
+    writeBeginAlone(file);
+    if (file->log) {
+        committed = walCommit(file->log);
+        if (committed && file->log->end >= WAL_CHECKPOINT_SIZE) {
+            committed = flushLatched(file, file->disk.path, 1);
+        }
+    }
+    writeEnd(file);
+    return committed;
+}
+
+// Save the file's blocks compressed from now on (see persistence.h and
+// block_codec.h). A compressed file is always written in full, so every
+// flush, and every checkpoint of its log, costs a full save.
+void enableCompression(SequentialFile *file) {
+    writeBeginAlone(file);
+    if (file->buffers) {
+        // Paged blocks are read back from their slots, which compressed
+        // files do not have
+        printf("Error: A paged file cannot be compressed\n");
+    } else {
+        file->isCompressed = 1;
+    }
+    writeEnd(file);
+}
@@ -3,17 +3,70 @@
 #include "record.h"
 
 Record *createRecord(int id, const char *data) {
-    Record *record = (Record *)malloc(sizeof(Record));
+    int size = strlen(data) + 1;
+    Record *record = (Record *)malloc(sizeof(Record) + size);
     record->id = id;
-    record->size = strlen(data) + 1;
-    record->data = (char *)malloc(record->size);
-    strcpy(record->data, data);
+    record->size = size;
+    record->flags = 0;
+    record->slack = 0;
+    memcpy(record->data, data, size);
     return record;
 }
 
 void freeRecord(Record *record) {
-    if (record) {
-        free(record->data);
-        free(record);
+    free(record);
+}
+
+// Like createRecord, but allocated from `arena` and released with it
+Record *createArenaRecord(Arena *arena, int id, const char *data) {
+    int size = strlen(data) + 1;
+    Record *record = (Record *)arenaAlloc(arena, sizeof(Record) + size);
+    record->id = id;
+    record->size = size;
+    record->flags = 0;
+    record->slack = 0;
+    memcpy(record->data, data, size);
+    return record;
+}
+
+void initRecordBatch(RecordBatch *batch) {
+    batch->data = NULL;
+    batch->used = 0;
+    batch->capacity = 0;
+    batch->count = 0;
+}
+
+void recordBatchAdd(RecordBatch *batch, int id, const char *data) {
+    int size = strlen(data) + 1;
+    size_t space = RECORD_SPACE(size);
+
+    if (batch->used + space > batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity : 4096;
+        while (batch->used + space > capacity) {
+            capacity *= 2;
+        }
+        batch->data = (char *)realloc(batch->data, capacity);
+        batch->capacity = capacity;
     }
+
+    Record *record = (Record *)(batch->data + batch->used);
+    record->id = id;
+    record->size = size;
+    record->flags = 0;
+    record->slack = 0;
+    memcpy(record->data, data, size);
+
+    batch->used += space;
+    batch->count++;
+}
+
+// Empty the batch but keep its buffer for reuse
+void recordBatchClear(RecordBatch *batch) {
+    batch->used = 0;
+    batch->count = 0;
+}
+
+void freeRecordBatch(RecordBatch *batch) {
+    free(batch->data);
+    initRecordBatch(batch);
 }
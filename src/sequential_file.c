@@ -1,274 +1,1656 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include "sequential_file.h"
+#include "cursor.h"
+#include "parallel_scan.h"
+
+// Run the statement that follows on every copy of the file in turn, as a
+// single write (see enableConcurrency)
+#define FOR_EACH_COPY(copy, file) \
+    for (SequentialFile *copy = writeBegin(file); copy; copy = writeNext((file), copy))
+
+// Returns NULL, after printing why, if a block of `blockSize` bytes could
+// not hold even a one-byte record.
 SequentialFile *initializeFile(int blockSize, int isContiguous, int isOrdered, int isFixed, int allowOverlap) {
+    // Keep blocks 8-byte aligned when they are laid out back to back on disk
+    blockSize = (blockSize + 7) & ~7;
+    if (blockSize <= 0 || (isFixed ? blockKeyCapacity(blockSize, RECORD_SPACE(1)) < 1 : !blockCanHold(blockSize, 1))) {
+        printf("Error: A %d-byte block is too small to hold a record\n", blockSize);
+        return NULL;
+    }
+
     SequentialFile *file = (SequentialFile *)malloc(sizeof(SequentialFile));
     file->head = NULL;
+    file->tail = NULL;
     file->blockSize = blockSize;
     file->isContiguous = isContiguous;
     file->isOrdered = isOrdered;
     file->isFixed = isFixed;
     file->allowOverlap = allowOverlap;
+    file->index = NULL;
+    file->payloadIndex = NULL;
+    file->directory = isOrdered ? createDirectory() : NULL;
+    file->freeMap = isOrdered ? NULL : createFreeSpaceMap();
+    file->table = isContiguous ? createBlockTable(file->blockSize) : NULL;
+    file->mapping = NULL;
+    file->mappingSize = 0;
+    memset(&file->disk, 0, sizeof(DiskState));
+    file->log = NULL;
+    file->isCompressed = 0;
+    file->compactCursor = NULL;
+    file->recordSize = 0;
+    file->updateSlack = 0;
+    file->pool = createBlockPool(file->blockSize, 0);
+    file->buffers = NULL;
+    file->arena = createArena();
+    file->shared = NULL;
+    file->latch = NULL;
+    file->original = NULL;
+    memset(&file->stats, 0, sizeof(FileCounters));
+    file->counters = &file->stats;
+    // Blocks too small for FIXED_RECORD_SIZE get the longest records they hold
+    if (isFixed) {
+        int size = FIXED_RECORD_SIZE;
+        while (!setRecordSize(file, size)) {
+            size--;
+        }
+    }
     return file;
 }
 
-// void insertRecord(SequentialFile *file, Record *record) {
-//     Block *current = file->head;
-
-//     // Create first block if the file is empty
-//     if (!current) {
-//         file->head = createBlock(file->blockSize);
-//         current = file->head;
-//     }
+// Store every record of a fixed-length file in `size` bytes of data, with
+// the ids in a key column per block (see block.h); longer records are
+// rejected. Only possible while the file has no blocks.
+// Returns 1 on success, 0 if the size cannot be used.
+int setRecordSize(SequentialFile *file, int size) {
+    if (!file->isFixed || file->head || size <= 0 ||
+        blockKeyCapacity(file->blockSize, RECORD_SPACE(size)) < 1) {
+        return 0;
+    }
+    FOR_EACH_COPY(copy, file) {
+        copy->recordSize = size;
+        copy->pool->recordSpace = RECORD_SPACE(size);
+    }
+    return 1;
+}
 
-//     while (current) {
-//         // If record fits in the current block
-//         if (record->size <= current->freeSpace) {
-//             memcpy(current->data + (current->blockSize - current->freeSpace), record, record->size);
-//             current->freeSpace -= record->size;
-//             return;
-//         } 
+// Reserve `bytes` (rounded up to a multiple of 4) after the data of every
+// record inserted into a variable-length file from now on, so updates
+// that grow the record by up to that much rewrite it in place. Slack is
+// only reserved where the block has room for it. Fixed-length records
+// already have their stride and take none.
+// Returns 1 on success, 0 if the amount cannot be used.
+int setUpdateSlack(SequentialFile *file, int bytes) {
+    if (bytes < 0 || bytes > RECORD_MAX_SLACK) {
+        return 0;
+    }
+    FOR_EACH_COPY(copy, file) {
+        copy->updateSlack = (bytes + 3) & ~3;
+    }
+    return 1;
+}
 
-//         // If overlap is allowed, split the record
-//         if (file->allowOverlap && current->freeSpace > 0) {
-//             int partSize = current->freeSpace;
-//             memcpy(current->data + (current->blockSize - current->freeSpace), record, partSize);
-//             current->freeSpace = 0;
+// Print why a write failed. A read copy fails the same way when the write
+// is repeated on it, and stays quiet.
+static void writeError(const SequentialFile *file, const char *format, ...) {
+    if (file->original) return;
 
-//             // Adjust the record for the remaining part
-//             record->size -= partSize;
-//             record->data += partSize;
-//         }
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
 
-//         // Move to the next block or create a new block
-//         if (!current->next) {
-//             current->next = createBlock(file->blockSize);
-//         }
-//         current = current->next;
-//     }
-// }
+// Whether a record with `size` bytes of data can be stored in the file,
+// printing why not
+static int recordFits(const SequentialFile *file, int id, int size) {
+    if (file->isFixed && size > file->recordSize) {
+        writeError(file, "Error: Record %d is longer than the file's %d-byte records\n", id, file->recordSize);
+        return 0;
+    }
+    if (!file->allowOverlap && !blockCanHold(file->blockSize, size)) {
+        writeError(file, "Error: Record %d is too large for a %d-byte block\n", id, file->blockSize);
+        return 0;
+    }
+    return 1;
+}
 
+// Whether `id` can be inserted, printing why not: an indexed file holds
+// every id once
+static int isNewId(const SequentialFile *file, int id) {
+    if (file->index && hashIndexGet(file->index, id)) {
+        writeError(file, "Error: Record %d already exists\n", id);
+        return 0;
+    }
+    return 1;
+}
 
-void insertRecord(SequentialFile *file, Record *record) {
-    Block *current = file->head;
+// Whether a record with `size` bytes of data has to be split across blocks
+static int needsSpan(const SequentialFile *file, int size) {
+    return !file->isFixed && !blockCanHold(file->blockSize, size);
+}
 
-    // Create first block if the file is empty
-    if (!current) {
-        file->head = createBlock(file->blockSize);
-        current = file->head;
+// Make sure a contiguous file's region has room for every block an insert
+// of a record with `size` bytes of data may add, printing why not: up to
+// two splits and a block of its own, or for a spanned record a split, a
+// fresh block and one per piece. The region then never has to grow, and
+// fail, halfway through the insert.
+static int reserveBlocks(SequentialFile *file, int id, int size) {
+    if (!file->table) {
+        return 1;
+    }
+    int blocks = 3;
+    if (needsSpan(file, size)) {
+        int piece = blockMaxPieceSize(file->blockSize);
+        blocks += (size + piece - 1) / piece;
+    }
+    if (!tableReserve(file->table, blocks)) {
+        writeError(file, "Error: No memory for the blocks of record %d\n", id);
+        return 0;
     }
+    return 1;
+}
 
-    while (current) {
-        // Calculate total space needed for the record
-        int totalSpace = sizeof(Record) + record->size;
-        
-        // If record fits in the current block
-        if (totalSpace <= current->freeSpace) {
-            char *insertPoint = current->data + (current->blockSize - current->freeSpace);
-            
-            // Create a new record in the block
-            Record *newRecord = (Record *)insertPoint;
-            newRecord->id = record->id;
-            newRecord->size = record->size;
-            
-            // Allocate and copy the data
-            newRecord->data = (char *)malloc(record->size);
-            memcpy(newRecord->data, record->data, record->size);
-            
-            current->freeSpace -= totalSpace;
-            return;
-        }
+// Whether `record` is the live first or middle piece of a spanned record,
+// which must stay the last slot of its block
+static int continues(const Record *record) {
+    return (record->flags & (RECORD_CONTINUED | RECORD_DELETED)) == RECORD_CONTINUED;
+}
 
-        // Move to next block or create new one
-        if (!current->next) {
-            current->next = createBlock(file->blockSize);
+// Records that span blocks are joined here by searchRecord, one buffer
+// per thread so concurrent readers do not share it
+static __thread char *joinBuffer;
+static __thread int joinCapacity;
+
+// Updates that move a record stage its new version here, one buffer per
+// thread, so they do not allocate once it is large enough
+static __thread char *moveBuffer;
+static __thread int moveCapacity;
+
+// Data of a record about to change, read back for the payload index
+static __thread char *payloadBuffer;
+static __thread int payloadCapacity;
+
+// Free space a record with `size` bytes of data needs in one of the file's blocks
+static int spaceNeeded(const SequentialFile *file, int size) {
+    return blockSpaceNeeded(file->pool->recordSpace, size);
+}
+
+// Build the primary-key index and keep it maintained from now on. Ids are
+// unique while the file is indexed: inserts of an id the file already
+// holds are rejected. Returns 1 on success, 0 if the file holds an id more
+// than once, in which case it is left without an index.
+int enableIndex(SequentialFile *file) {
+    int enabled = 0;
+    FOR_EACH_COPY(copy, file) {
+        if (!copy->index) {
+            copy->index = createHashIndex(0);
+        }
+        enabled = rebuildIndex(copy);
+        if (!enabled) {
+            freeHashIndex(copy->index);
+            copy->index = NULL;
         }
-        current = current->next;
     }
+    return enabled;
 }
 
+void disableIndex(SequentialFile *file) {
+    FOR_EACH_COPY(copy, file) {
+        freeHashIndex(copy->index);
+        copy->index = NULL;
+    }
+}
 
-int updateRecord(SequentialFile *file, int id, const char *newData) {
-    Block *current = file->head;
-
-    while (current) {
-        char *ptr = current->data;
-        int remaining = current->blockSize - current->freeSpace;
-        
-        while (remaining > sizeof(Record)) {
-            Record *record = (Record *)ptr;
-            
-            if (record->id == -1 || record->size <= 0) {
-                break;
+// Repopulate the index from the blocks in a single pass. Returns 1 on
+// success, 0, after printing why, if an id turns up twice.
+int rebuildIndex(SequentialFile *file) {
+    if (!file->index) return 1;
+
+    hashIndexClear(file->index);
+    for (Block *current = file->head; current; current = current->next) {
+        pinBlock(file, current);
+        int count = blockRecordCount(current);
+        for (int slot = 0; slot < count; slot++) {
+            Record *record = blockRecordAt(current, slot);
+            if (record->flags & (RECORD_DELETED | RECORD_CONTINUATION)) {
+                continue;
             }
-            
-            if (record->id == id) {
-                int newSize = strlen(newData) + 1;
-                int totalSpaceNeeded = sizeof(Record) + newSize;
-                int oldTotalSpace = sizeof(Record) + record->size;
-                
-                // Calculate the actual space difference needed
-                int spaceDifference = totalSpaceNeeded - oldTotalSpace;
-                
-                // If new data fits in the current space or we have enough free space
-                if (spaceDifference <= current->freeSpace) {
-                    // Free old data and allocate new
-                    free(record->data);
-                    record->data = (char *)malloc(newSize);
-                    strcpy(record->data, newData);
-                    record->size = newSize;
-                    
-                    // Update the block's free space only if we're using more space
-                    if (spaceDifference > 0) {
-                        current->freeSpace -= spaceDifference;
-                    } else {
-                        // If new data is smaller, we gain some free space
-                        current->freeSpace -= spaceDifference;
-                    }
-                    return 1;
-                } else {
-                    printf("Error: Not enough space for the update\n");
-                    return 0;
-                }
+            if (hashIndexGet(file->index, record->id)) {
+                writeError(file, "Error: Record %d is stored more than once; the index needs unique ids\n", record->id);
+                unpinBlock(file, current);
+                return 0;
             }
-            
-            // Move to next record
-            ptr += sizeof(Record) + record->size;
-            remaining -= (sizeof(Record) + record->size);
+            hashIndexPut(file->index, record->id, current, blockRecordOffset(current, slot));
         }
-        current = current->next;
+        unpinBlock(file, current);
     }
-    return 0;
+    return 1;
 }
 
-int deleteRecord(SequentialFile *file, int id) {
-    Block *current = file->head;
-
-    while (current) {
-        char *ptr = current->data;
-        int remaining = current->blockSize - current->freeSpace;
-        
-        while (remaining > 0) {
-            Record *record = (Record *)ptr;
-            if (record->id == id && record->id != -1) {
-                record->id = -1; // Mark as deleted
-                return 1; // Success
+// Build the secondary index on record data and keep it maintained from now on
+void enablePayloadIndex(SequentialFile *file) {
+    FOR_EACH_COPY(copy, file) {
+        if (!copy->payloadIndex) {
+            copy->payloadIndex = createPayloadIndex();
+        }
+        rebuildPayloadIndex(copy);
+    }
+}
+
+void disablePayloadIndex(SequentialFile *file) {
+    FOR_EACH_COPY(copy, file) {
+        freePayloadIndex(copy->payloadIndex);
+        copy->payloadIndex = NULL;
+    }
+}
+
+// Repopulate the payload index from the records, spanned ones joined. The
+// blocks are walked directly rather than through a cursor, which would
+// read whichever copy of a shared file readers are in.
+void rebuildPayloadIndex(SequentialFile *file) {
+    if (!file->payloadIndex) return;
+
+    char *buffer = NULL;
+    int capacity = 0;
+    payloadIndexClear(file->payloadIndex);
+    for (Block *current = file->head; current; current = current->next) {
+        pinSpan(file, current);
+        int count = blockRecordCount(current);
+        for (int slot = 0; slot < count; slot++) {
+            Record *record = blockRecordAt(current, slot);
+            if (!(record->flags & (RECORD_DELETED | RECORD_CONTINUATION))) {
+                record = blockJoinRecord(current, record, &buffer, &capacity);
+                payloadIndexAdd(file->payloadIndex, record->id, record->data);
             }
-            ptr += sizeof(Record) + record->size;
-            remaining -= (sizeof(Record) + record->size);
         }
-        current = current->next;
+        unpinSpan(file, current);
     }
-    return 0; // Record not found
+    free(buffer);
 }
 
+// Recompute the fence keys of every block, e.g. after loading from disk
+void rebuildDirectory(SequentialFile *file) {
+    if (!file->directory) return;
 
-Record *searchRecord(SequentialFile *file, int key) {
-    Block *current = file->head;
-
-    while (current) {
-        char *ptr = current->data;
-        int remaining = current->blockSize - current->freeSpace;
-        
-        while (remaining > 0) {
-            Record *record = (Record *)ptr;
-            if (record->id == key && record->id != -1) {
+    directoryClear(file->directory);
+    for (Block *current = file->head; current; current = current->next) {
+        pinBlock(file, current);
+        directoryInsert(file->directory, file->directory->count, current);
+        unpinBlock(file, current);
+    }
+}
+
+// Recompute the tail pointer and, for unordered files, the free-space map
+void rebuildFreeSpaceMap(SequentialFile *file) {
+    if (file->freeMap) {
+        fsmClear(file->freeMap);
+    }
+
+    file->tail = NULL;
+    for (Block *current = file->head; current; current = current->next) {
+        if (file->freeMap) {
+            current->fsmBucket = -1;
+            fsmUpdate(file->freeMap, current);
+        }
+        file->tail = current;
+    }
+}
+
+// Hand a disk slot back so the next incremental flush can reuse it
+void releaseDiskBlock(SequentialFile *file, int diskBlock) {
+    DiskState *disk = &file->disk;
+
+    if (disk->freeCount == disk->freeCapacity) {
+        disk->freeCapacity = disk->freeCapacity ? disk->freeCapacity * 2 : 16;
+        disk->freeBlocks = (int *)realloc(disk->freeBlocks, disk->freeCapacity * sizeof(int));
+    }
+    disk->freeBlocks[disk->freeCount++] = diskBlock;
+}
+
+// Free a block dropped from the file, releasing its disk slot
+void releaseBlock(SequentialFile *file, Block *block) {
+    if (block->diskBlock >= 0) {
+        releaseDiskBlock(file, block->diskBlock);
+    }
+    if (block->flags & BLOCK_TABLE) {
+        tableFreeData(file->table, block->data);
+    }
+    if (file->buffers) {
+        bufferPoolDrop(file->buffers, block);
+    }
+    poolFreeBlock(file->pool, block);
+    STAT_ADD(file, blocksFreed, 1);
+}
+
+// The block at `position` in file order, or NULL past the last one. O(1)
+// for contiguous files, a walk down the chain for lists.
+Block *fileBlockAt(SequentialFile *file, int position) {
+    if (file->table) {
+        return position >= 0 && position < file->table->count ? file->table->blocks[position] : NULL;
+    }
+
+    Block *block = position >= 0 ? file->head : NULL;
+    for (; block && position > 0; position--) {
+        block = block->next;
+    }
+    return block;
+}
+
+// Keep `block` in memory until unpinBlock. Blocks of a paged file are
+// read in when needed and may be evicted while unpinned (see
+// buffer_pool.h); other blocks always stay put, so this does nothing.
+void pinBlock(SequentialFile *file, Block *block) {
+    if (file->buffers) {
+        bufferPoolPin(file->buffers, block);
+    }
+}
+
+void unpinBlock(SequentialFile *file, Block *block) {
+    if (file->buffers) {
+        bufferPoolUnpin(file->buffers, block);
+    }
+}
+
+// Pin `block` along with the blocks holding the other pieces of the
+// record its last slot starts, so any record it starts can be joined
+void pinSpan(SequentialFile *file, Block *block) {
+    pinBlock(file, block);
+    if (!file->buffers) return;
+
+    int count = blockRecordCount(block);
+    Record *record = count > 0 ? blockRecordAt(block, count - 1) : NULL;
+    while (record && (record->flags & RECORD_CONTINUED)) {
+        block = block->next;
+        pinBlock(file, block);
+        record = blockRecordAt(block, 0);
+    }
+}
+
+void unpinSpan(SequentialFile *file, Block *block) {
+    if (!file->buffers) return;
+
+    int count = blockRecordCount(block);
+    Record *record = count > 0 ? blockRecordAt(block, count - 1) : NULL;
+    for (;;) {
+        Block *next = record && (record->flags & RECORD_CONTINUED) ? block->next : NULL;
+        unpinBlock(file, block);
+        if (!next) break;
+        block = next;
+        record = blockRecordAt(block, 0);
+    }
+}
+
+// Pin `block` (may be NULL) until the running write ends. Writes touch a
+// few blocks here and there and drop all of their pins at once with
+// unpinTouched, before the write ends.
+static Block *touchBlock(SequentialFile *file, Block *block) {
+    if (file->buffers && block) {
+        bufferPoolTouch(file->buffers, block);
+    }
+    return block;
+}
+
+static void unpinTouched(SequentialFile *file) {
+    if (file->buffers) {
+        bufferPoolUnpinTouched(file->buffers);
+    }
+}
+
+// A new empty block; the data of a contiguous file's blocks comes from its
+// table, and that of a paged file's from a frame. The block must be linked
+// in before the next one is allocated.
+static Block *allocBlock(SequentialFile *file) {
+    STAT_ADD(file, blocksAllocated, 1);
+    if (file->table) {
+        // Inserts reserve their slots before they change anything
+        // (reserveBlocks); running out here would leave one half done
+        char *data = tableAllocData(file->table);
+        if (!data) {
+            printf("Error: No memory for a block of the file\n");
+            abort();
+        }
+        return poolAllocTableBlock(file->pool, data);
+    }
+    if (file->buffers) {
+        Block *block = touchBlock(file, poolAllocPagedBlock(file->pool));
+        blockFormat(block);
+        return block;
+    }
+    return poolAllocBlock(file->pool);
+}
+
+// Link `block` into the chain right after `prev` (at the head when NULL)
+static void linkBlockAfter(SequentialFile *file, Block *prev, Block *block) {
+    if (file->table) {
+        tableInsert(file->table, prev ? prev->position + 1 : 0, block);
+    }
+    if (prev) {
+        block->next = prev->next;
+        prev->next = block;
+    } else {
+        block->next = file->head;
+        file->head = block;
+    }
+    if (!block->next) {
+        file->tail = block;
+    }
+}
+
+// A copy of `file` for readers to use while a write changes the file: the
+// same blocks in the same order, with the same settings, directory,
+// free-space map and indexes, so that every write changes both alike.
+// The copy is not saved or logged. NULL if there is no memory for it.
+static SequentialFile *copyForReaders(SequentialFile *file) {
+    SequentialFile *copy = initializeFile(file->blockSize, file->isContiguous, file->isOrdered, file->isFixed,
+                                          file->allowOverlap);
+    if (file->isFixed) {
+        setRecordSize(copy, file->recordSize);
+    }
+    copy->updateSlack = file->updateSlack;
+
+    int blockCount = 0;
+    for (Block *block = file->head; block; block = block->next) {
+        blockCount++;
+    }
+    if (copy->table && !tableReserve(copy->table, blockCount)) {
+        freeFile(copy);
+        return NULL;
+    }
+    for (Block *block = file->head; block; block = block->next) {
+        Block *mirror = allocBlock(copy);
+        memcpy(mirror->data, block->data, file->blockSize);
+        mirror->freeSpace = block->freeSpace;
+        mirror->deadSpace = block->deadSpace;
+        linkBlockAfter(copy, copy->tail, mirror);
+        if (block == file->compactCursor) {
+            copy->compactCursor = mirror;
+        }
+    }
+
+    // Rebuilt on both sides, so the two start out alike
+    rebuildDirectory(file);
+    rebuildDirectory(copy);
+    rebuildFreeSpaceMap(file);
+    rebuildFreeSpaceMap(copy);
+    if (file->index) {
+        enableIndex(copy);
+    }
+    if (file->payloadIndex) {
+        enablePayloadIndex(copy);
+    }
+    copy->original = file;
+    copy->counters = &file->stats;
+    return copy;
+}
+
+// Make the file safe to use from several threads: any number of readers
+// (lookups, cursors, scans) run side by side with one write at a time,
+// and never wait for it. The file gets a read copy (left-right scheme):
+// readers use whichever of the two a write is not changing, and each
+// write is made to both in turn (FOR_EACH_COPY), flipping readers over to
+// the copy it finished first. A write thus costs twice as much, and it
+// waits for the readers of the copy it changes second, which includes
+// open cursors. Saves, flushes and the log only involve the file itself
+// (writeBeginAlone). Paged files, whose blocks are not all in memory, and
+// files there is no memory to copy, fall back to a writer-preferring
+// reader-writer latch over the file, under which readers do wait.
+// Call it before the file is shared, from the thread that owns it.
+void enableConcurrency(SequentialFile *file) {
+    if (file->shared || file->latch) return;
+
+    SequentialFile *copy = file->buffers ? NULL : copyForReaders(file);
+    if (copy) {
+        ReadCopies *shared = (ReadCopies *)calloc(1, sizeof(ReadCopies));
+        shared->copies[0] = file;
+        shared->copies[1] = copy;
+        pthread_mutex_init(&shared->writer, NULL);
+        file->shared = shared;
+        return;
+    }
+
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    file->latch = (pthread_rwlock_t *)malloc(sizeof(pthread_rwlock_t));
+    pthread_rwlock_init(file->latch, &attr);
+    pthread_rwlockattr_destroy(&attr);
+}
+
+// The copy of the file to read, until readEnd. A reader counts itself into
+// the readable copy, and checks that it still is readable, so a write
+// that flips readers over meanwhile knows to wait for it. None of this is
+// reentrant: a thread reading the file (e.g. through an open cursor) must
+// not write to it.
+SequentialFile *readBegin(SequentialFile *file) {
+    ReadCopies *shared = file->shared;
+    if (!shared) {
+        if (file->latch) pthread_rwlock_rdlock(file->latch);
+        return file;
+    }
+    for (;;) {
+        int readable = __atomic_load_n(&shared->readable, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&shared->readers[readable], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&shared->readable, __ATOMIC_SEQ_CST) == readable) {
+            return shared->copies[readable];
+        }
+        __atomic_fetch_sub(&shared->readers[readable], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void readEnd(SequentialFile *file, SequentialFile *copy) {
+    ReadCopies *shared = file->shared;
+    if (!shared) {
+        if (file->latch) pthread_rwlock_unlock(file->latch);
+        return;
+    }
+    __atomic_fetch_sub(&shared->readers[copy == shared->copies[1]], 1, __ATOMIC_SEQ_CST);
+}
+
+// Wait until no reader is left in copy `index`; readers arriving meanwhile
+// go to the other one
+static void waitForReaders(ReadCopies *shared, int index) {
+    while (__atomic_load_n(&shared->readers[index], __ATOMIC_SEQ_CST) > 0) {
+        sched_yield();
+    }
+}
+
+// The copy readers are not in. While the write is repeated on the read
+// copy, it counts into counters of its own, which nothing reads.
+static SequentialFile *writableCopy(ReadCopies *shared) {
+    SequentialFile *copy = shared->copies[!shared->readable];
+    if (copy->original) {
+        copy->counters = &copy->stats;
+    }
+    return copy;
+}
+
+// The first copy a write changes; writeNext then hands out the second,
+// and NULL once the write is over (see FOR_EACH_COPY)
+SequentialFile *writeBegin(SequentialFile *file) {
+    ReadCopies *shared = file->shared;
+    if (!shared) {
+        if (file->latch) pthread_rwlock_wrlock(file->latch);
+        return file;
+    }
+    pthread_mutex_lock(&shared->writer);
+    shared->changed = 0;
+    return writableCopy(shared);
+}
+
+SequentialFile *writeNext(SequentialFile *file, SequentialFile *copy) {
+    ReadCopies *shared = file->shared;
+    if (!shared) {
+        if (file->latch) pthread_rwlock_unlock(file->latch);
+        return NULL;
+    }
+    if (copy->original) {
+        copy->counters = &copy->original->stats;
+    }
+    if (++shared->changed == 2) {
+        // Readers stay where they are: some may have entered either copy
+        pthread_mutex_unlock(&shared->writer);
+        return NULL;
+    }
+    int index = copy == shared->copies[1];
+    __atomic_store_n(&shared->readable, index, __ATOMIC_SEQ_CST);
+    waitForReaders(shared, !index);
+    return writableCopy(shared);
+}
+
+// Hold the file itself alone until writeEnd, its readers moved over to the
+// read copy meanwhile: for saves, flushes and the log, which the read
+// copy has no part in
+void writeBeginAlone(SequentialFile *file) {
+    ReadCopies *shared = file->shared;
+    if (!shared) {
+        if (file->latch) pthread_rwlock_wrlock(file->latch);
+        return;
+    }
+    pthread_mutex_lock(&shared->writer);
+    if (shared->readable == 0) {
+        __atomic_store_n(&shared->readable, 1, __ATOMIC_SEQ_CST);
+        waitForReaders(shared, 0);
+    }
+}
+
+void writeEnd(SequentialFile *file) {
+    ReadCopies *shared = file->shared;
+    if (!shared) {
+        if (file->latch) pthread_rwlock_unlock(file->latch);
+        return;
+    }
+    pthread_mutex_unlock(&shared->writer);
+}
+
+// Re-point the index at every live record of a block whose records moved
+static void indexBlock(SequentialFile *file, Block *block) {
+    if (!file->index) return;
+
+    int count = blockRecordCount(block);
+    for (int slot = 0; slot < count; slot++) {
+        Record *record = blockRecordAt(block, slot);
+        if (!(record->flags & (RECORD_DELETED | RECORD_CONTINUATION))) {
+            hashIndexPut(file->index, record->id, block, blockRecordOffset(block, slot));
+        }
+    }
+}
+
+// Two-level search of an ordered file: binary search the directory for the
+// block, then the block's slot array for the record. The block is left
+// pinned when the record is found.
+static Record *findOrdered(SequentialFile *file, int id, Block **blockOut, int *slotOut) {
+    BlockDirectory *directory = file->directory;
+    int pos = directoryFind(directory, id);
+
+    if (pos < 0) {
+        return NULL;
+    }
+
+    // Duplicates of a key may continue into the following blocks
+    for (; pos < directory->count && directory->entries[pos].minKey <= id; pos++) {
+        Block *block = directory->entries[pos].block;
+        pinBlock(file, block);
+        STAT_ADD(file, blocksWalked, 1);
+        if (!blockMayHoldKey(block, id)) {
+            STAT_ADD(file, blocksSkipped, 1);
+            unpinBlock(file, block);
+            continue;
+        }
+        int count = blockRecordCount(block);
+
+        for (int slot = blockLowerBound(block, id); slot < count; slot++) {
+            Record *record = blockRecordAt(block, slot);
+            STAT_ADD(file, recordsExamined, 1);
+            if (record->id != id) {
+                unpinBlock(file, block);
+                return NULL;
+            }
+            if (record->flags & RECORD_DELETED) {
+                STAT_ADD(file, tombstonesSkipped, 1);
+            } else if (!(record->flags & RECORD_CONTINUATION)) {
+                if (blockOut) *blockOut = block;
+                if (slotOut) *slotOut = slot;
                 return record;
             }
-            ptr += sizeof(Record) + record->size;
-            remaining -= (sizeof(Record) + record->size);
         }
-        current = current->next;
+        unpinBlock(file, block);
     }
+    return NULL;
+}
 
+// Locate the live record with the given id. On success the containing
+// block and slot are stored through `blockOut` / `slotOut` when non-NULL,
+// and the block is pinned until the caller unpins it.
+static Record *findRecord(SequentialFile *file, int id, Block **blockOut, int *slotOut) {
+    if (file->index) {
+        IndexEntry *entry = hashIndexGet(file->index, id);
+        if (!entry) {
+            return NULL;
+        }
+        pinBlock(file, entry->block);
+        STAT_ADD(file, blocksWalked, 1);
+        STAT_ADD(file, recordsExamined, 1);
+        if (blockOut) *blockOut = entry->block;
+        if (slotOut) *slotOut = blockFindSlot(entry->block, entry->offset);
+        return (Record *)(entry->block->data + entry->offset);
+    }
+
+    if (file->isOrdered) {
+        return findOrdered(file, id, blockOut, slotOut);
+    }
+
+    // Contiguous files are scanned by position, in region order once packed
+    Block *current = file->table ? fileBlockAt(file, 0) : file->head;
+    // Counted once at the end, so concurrent lookups rarely share a write
+    int walked = 0;
+    int examined = 0;
+    int skipped = 0;
+    for (int position = 1; current; position++) {
+        pinBlock(file, current);
+        walked++;
+        // The block's filter rules most blocks out without their records
+        if (!blockMayHoldKey(current, id)) {
+            skipped++;
+        } else {
+            int offset = blockFindKey(current, id);
+            if (offset >= 0) {
+                int slot = blockFindSlot(current, offset);
+                STAT_ADD(file, blocksWalked, walked);
+                STAT_ADD(file, blocksSkipped, skipped);
+                STAT_ADD(file, recordsExamined, examined + slot + 1);
+                if (blockOut) *blockOut = current;
+                if (slotOut) *slotOut = slot;
+                return (Record *)(current->data + offset);
+            }
+            examined += blockRecordCount(current);
+        }
+        unpinBlock(file, current);
+        current = file->table ? fileBlockAt(file, position) : current->next;
+    }
+    STAT_ADD(file, blocksWalked, walked);
+    STAT_ADD(file, blocksSkipped, skipped);
+    STAT_ADD(file, recordsExamined, examined);
     return NULL;
 }
 
-void searchRecordsByRange(SequentialFile *file, int startKey, int endKey) {
-    Block *current = file->head;
-    int recordsFound = 0;
+// Reclaim the dead space of an unordered file's block
+static void compactBlock(SequentialFile *file, Block *block) {
+    blockCompact(block);
+    indexBlock(file, block);
+    fsmUpdate(file->freeMap, block);
+}
+
+// Move the records from `slot` on out of the block at directory position
+// `pos` into a new block linked right after it. Deleted records are not
+// moved, so when none from `slot` on is live the block is only cut short
+// and NULL is returned: an empty block would have no fence keys.
+static Block *splitBlock(SequentialFile *file, int pos, int slot) {
+    Block *block = file->directory->entries[pos].block;
+    Block *right = allocBlock(file);
+
+    blockSplit(block, right, slot);
+    if (blockRecordCount(right) == 0) {
+        releaseBlock(file, right);
+        directoryRefresh(file->directory, pos);
+        indexBlock(file, block);
+        return NULL;
+    }
+    linkBlockAfter(file, block, right);
+    STAT_ADD(file, blockSplits, 1);
+
+    directoryRefresh(file->directory, pos);
+    directoryInsert(file->directory, pos + 1, right);
+    indexBlock(file, block);
+    indexBlock(file, right);
+    return right;
+}
+
+// Move an insert position of an ordered file that falls right after the
+// first piece of a spanned record past its other pieces, so the pieces
+// stay together. Returns the slot, and updates the directory position.
+static int skipSpans(SequentialFile *file, int *pos, int slot) {
+    Block *block = touchBlock(file, file->directory->entries[*pos].block);
+
+    while (slot > 0 && continues(blockRecordAt(block, slot - 1))) {
+        block = touchBlock(file, block->next);
+        (*pos)++;
+        slot = 1;
+    }
+    return slot;
+}
+
+// Ordered files keep every block's slots sorted and the blocks themselves
+// in key order, splitting a block when the record does not fit.
+static void insertOrdered(SequentialFile *file, const Record *record) {
+    BlockDirectory *directory = file->directory;
+    int pos = directoryFind(directory, record->id);
+
+    if (pos < 0) {
+        linkBlockAfter(file, NULL, allocBlock(file));
+        directoryInsert(directory, 0, file->head);
+        pos = 0;
+    }
+
+    int slot = skipSpans(file, &pos, blockUpperBound(touchBlock(file, directory->entries[pos].block), record->id));
+    Block *block = directory->entries[pos].block;
+    int offset = blockInsertRecord(block, slot, record, file->updateSlack);
+
+    if (offset < 0) {
+        // Reclaim deleted records, then split the block around its middle
+        blockCompact(block);
+        indexBlock(file, block);
+        directoryRefresh(directory, pos);
+
+        int count = blockRecordCount(block);
+        if (count >= 2) {
+            Block *right = splitBlock(file, pos, count / 2);
+            if (right && record->id >= blockRecordAt(right, 0)->id) {
+                block = right;
+                pos++;
+            }
+        }
+
+        slot = skipSpans(file, &pos, blockUpperBound(block, record->id));
+        block = directory->entries[pos].block;
+        offset = blockInsertRecord(block, slot, record, file->updateSlack);
+
+        // A large record may still not fit: split right at its position,
+        // or give it a block of its own when it belongs at the end
+        if (offset < 0 && slot < blockRecordCount(block)) {
+            splitBlock(file, pos, slot);
+            offset = blockInsertRecord(block, slot, record, file->updateSlack);
+        }
+        if (offset < 0) {
+            Block *own = allocBlock(file);
+            offset = blockInsertRecord(own, 0, record, file->updateSlack);
+            linkBlockAfter(file, block, own);
+            directoryInsert(directory, ++pos, own);
+            block = own;
+        }
+    }
+
+    directoryRefresh(directory, pos);
+    if (file->index) {
+        hashIndexPut(file->index, record->id, block, offset);
+    }
+}
+
+// Store a record too large for one block in pieces (see block.h). The
+// first piece takes the free space at the end of a block, the others go
+// into new blocks linked right after it; the last piece leaves the rest
+// of its block to later records. Ordered files split the block at the
+// record's position first, so the pieces stay in key order.
+static void insertSpanned(SequentialFile *file, const Record *record) {
+    BlockDirectory *directory = file->directory;
+    Block *block = touchBlock(file, file->tail);
+    int pos = -1;
+
+    if (directory && directory->count > 0) {
+        pos = directoryFind(directory, record->id);
+        int slot = skipSpans(file, &pos, blockUpperBound(touchBlock(file, directory->entries[pos].block), record->id));
+        block = directory->entries[pos].block;
+        if (slot < blockRecordCount(block)) {
+            splitBlock(file, pos, slot);
+        }
+    }
+    if (block && block->deadSpace > 0) {
+        blockCompact(block);
+        indexBlock(file, block);
+        if (directory) {
+            directoryRefresh(directory, pos);
+        }
+    }
+    // The block may have filled up or been compacted since it was last
+    // bucketed, and is passed over below
+    if (block && file->freeMap) {
+        fsmUpdate(file->freeMap, block);
+    }
+    if (!block || blockPieceSize(block->freeSpace) < SPAN_MIN_PIECE) {
+        Block *fresh = allocBlock(file);
+        linkBlockAfter(file, block, fresh);
+        if (directory) {
+            directoryInsert(directory, ++pos, fresh);
+        }
+        block = fresh;
+    }
+
+    Record *piece = (Record *)malloc(sizeof(Record) + file->blockSize);
+    STAT_ADD(file, allocations, 1);
+    const char *data = record->data;
+    int left = record->size;
+
+    for (;;) {
+        int size = blockPieceSize(block->freeSpace);
+        if (size > left) {
+            size = left;
+        }
+        piece->id = record->id;
+        piece->size = size;
+        piece->slack = 0;
+        piece->flags = (data != record->data ? RECORD_CONTINUATION : 0) | (size < left ? RECORD_CONTINUED : 0);
+        memcpy(piece->data, data, size);
+
+        int offset = blockInsertRecord(block, blockRecordCount(block), piece, 0);
+        if (data == record->data && file->index) {
+            hashIndexPut(file->index, record->id, block, offset);
+        }
+        if (directory) {
+            directoryRefresh(directory, pos);
+        }
+        if (file->freeMap) {
+            fsmUpdate(file->freeMap, block);
+        }
+
+        data += size;
+        left -= size;
+        if (left == 0) {
+            break;
+        }
+        Block *next = allocBlock(file);
+        linkBlockAfter(file, block, next);
+        if (directory) {
+            directoryInsert(directory, ++pos, next);
+        }
+        block = next;
+    }
+    free(piece);
+}
+
+// Put a record that was checked and logged into the file. Returns 1 once
+// it is stored, 0 if no block would take it.
+static int placeRecord(SequentialFile *file, const Record *record) {
+    if (needsSpan(file, record->size)) {
+        insertSpanned(file, record);
+        return 1;
+    }
+    if (file->isOrdered) {
+        insertOrdered(file, record);
+        return 1;
+    }
+
+    // Append to the tail while it has room; otherwise reuse space freed by
+    // deletes and updates, and only then grow the file by one block
+    int needed = spaceNeeded(file, record->size);
+    Block *block = touchBlock(file, file->tail);
+
+    if (!block || block->freeSpace < needed) {
+        block = touchBlock(file, fsmFind(file->freeMap, needed));
+        if (block && block->freeSpace < needed) {
+            compactBlock(file, block);
+        }
+        // A stale bucket can promise more than compaction frees; grow the
+        // file then rather than overfill the block
+        if (block && block->freeSpace < needed) {
+            block = NULL;
+        }
+    }
+    if (!block) {
+        block = allocBlock(file);
+        linkBlockAfter(file, file->tail, block);
+    }
+
+    // The first piece of a spanned record has to stay the last slot
+    int slot = blockRecordCount(block);
+    if (slot > 0 && continues(blockRecordAt(block, slot - 1))) {
+        slot--;
+    }
+    int offset = blockInsertRecord(block, slot, record, file->updateSlack);
+    fsmUpdate(file->freeMap, block);
+    if (offset < 0) {
+        writeError(file, "Error: No room for record %d in a %d-byte block\n", record->id, file->blockSize);
+        return 0;
+    }
+    if (file->index) {
+        hashIndexPut(file->index, record->id, block, offset);
+    }
+    return 1;
+}
+
+static void insertRecordLatched(SequentialFile *file, const Record *record) {
+    if (!recordFits(file, record->id, record->size) || !isNewId(file, record->id) ||
+        !reserveBlocks(file, record->id, record->size)) {
+        return;
+    }
+    // Logged once it is in place, so a failed insert is never replayed
+    if (!placeRecord(file, record)) {
+        return;
+    }
+    if (file->log) {
+        walAppend(file->log, WAL_INSERT, record->id, record->data, record->size);
+    }
+    if (file->payloadIndex) {
+        payloadIndexAdd(file->payloadIndex, record->id, record->data);
+    }
+}
+
+void insertRecord(SequentialFile *file, Record *record) {
+    STAT_TIMER(started);
+    FOR_EACH_COPY(copy, file) {
+        insertRecordLatched(copy, record);
+        unpinTouched(copy);
+    }
+    STAT_RECORD(file, STAT_INSERT, started);
+}
+
+
+// Append to the tail block, starting a new block once less than `reserve`
+// bytes would be left free in it. Used by bulk loads, which bypass the
+// free-space map lookup and, for ordered files, the key routing; the map
+// still follows every block they fill.
+static void appendRecord(SequentialFile *file, const Record *record, int reserve) {
+    Block *block = touchBlock(file, file->tail);
+    int needed = spaceNeeded(file, record->size);
+
+    if (!block || block->freeSpace < needed ||
+        (blockRecordCount(block) > 0 && block->freeSpace - needed < reserve)) {
+        block = allocBlock(file);
+        linkBlockAfter(file, file->tail, block);
+        if (file->directory) {
+            directoryInsert(file->directory, file->directory->count, block);
+        }
+    }
+
+    int offset = blockInsertRecord(block, blockRecordCount(block), record, file->updateSlack);
+    if (file->freeMap) {
+        fsmUpdate(file->freeMap, block);
+    }
+    if (file->directory) {
+        directoryRefresh(file->directory, file->directory->count - 1);
+    }
+    if (file->index) {
+        hashIndexPut(file->index, record->id, block, offset);
+    }
+}
+
+// Log and index a record of a batch once it is in place, so only the
+// records actually inserted are logged, indexed and counted
+static void batchPlaced(SequentialFile *file, const Record *record) {
+    if (file->log) {
+        walAppend(file->log, WAL_INSERT, record->id, record->data, record->size);
+    }
+    if (file->payloadIndex) {
+        payloadIndexAdd(file->payloadIndex, record->id, record->data);
+    }
+}
+
+// Orders records by id, and records with the same id as they were staged,
+// so the first of them is the one inserted into an indexed file
+static int compareRecordIds(const void *a, const void *b) {
+    const Record *left = *(const Record *const *)a;
+    const Record *right = *(const Record *const *)b;
+    if (left->id != right->id) {
+        return (left->id > right->id) - (left->id < right->id);
+    }
+    return (left > right) - (left < right);
+}
+
+// Insert `n` records packed back to back (see RecordBatch). Unordered files
+// pack them straight into blocks at the tail. Ordered files sort the batch
+// once; when it sorts after every existing key the blocks are built bottom-up
+// at BULK_FILL_PERCENT, otherwise the records are merged in key order.
+// Returns the number of records inserted.
+static size_t insertBatchLatched(SequentialFile *file, const Record *records, size_t n) {
+    const Record **sorted = NULL;
+    size_t staged = 0;
+    size_t count = 0;
+
+    if (file->isOrdered) {
+        sorted = (const Record **)malloc(n * sizeof(Record *));
+        STAT_ADD(file, allocations, 1);
+    }
+
+    const Record *record = records;
+    for (size_t i = 0; i < n; i++, record = NEXT_RECORD(record)) {
+        if (!recordFits(file, record->id, record->size)) {
+            continue;
+        }
+        if (sorted) {
+            sorted[staged++] = record;
+            continue;
+        }
+        if (!isNewId(file, record->id) || !reserveBlocks(file, record->id, record->size)) {
+            continue;
+        }
+        if (count == 0 && file->index) {
+            hashIndexReserve(file->index, file->index->count + n);
+        }
+        if (needsSpan(file, record->size)) {
+            insertSpanned(file, record);
+        } else {
+            appendRecord(file, record, 0);
+        }
+        unpinTouched(file);
+        batchPlaced(file, record);
+        count++;
+    }
+
+    // appendRecord and insertSpanned bucketed every block they filled
+    if (!sorted) {
+        return count;
+    }
+
+    if (file->index) {
+        hashIndexReserve(file->index, file->index->count + staged);
+    }
+    qsort(sorted, staged, sizeof(Record *), compareRecordIds);
+
+    BlockDirectory *directory = file->directory;
+    if (staged > 0 && (directory->count == 0 ||
+                       sorted[0]->id >= directory->entries[directory->count - 1].maxKey)) {
+        int reserve = file->blockSize * (100 - BULK_FILL_PERCENT) / 100;
+        for (size_t i = 0; i < staged; i++) {
+            if (!isNewId(file, sorted[i]->id) || !reserveBlocks(file, sorted[i]->id, sorted[i]->size)) {
+                continue;
+            }
+            if (needsSpan(file, sorted[i]->size)) {
+                insertSpanned(file, sorted[i]);
+            } else {
+                appendRecord(file, sorted[i], reserve);
+            }
+            unpinTouched(file);
+            batchPlaced(file, sorted[i]);
+            count++;
+        }
+    } else {
+        for (size_t i = 0; i < staged; i++) {
+            if (isNewId(file, sorted[i]->id) && reserveBlocks(file, sorted[i]->id, sorted[i]->size) &&
+                placeRecord(file, sorted[i])) {
+                batchPlaced(file, sorted[i]);
+                count++;
+            }
+            unpinTouched(file);
+        }
+    }
+
+    free(sorted);
+    return count;
+}
+
+size_t insertRecordsBatch(SequentialFile *file, const Record *records, size_t n) {
+    STAT_TIMER(started);
+    size_t count = 0;
+    FOR_EACH_COPY(copy, file) {
+        count = insertBatchLatched(copy, records, n);
+    }
+    STAT_RECORD(file, STAT_BATCH_INSERT, started);
+    return count;
+}
+
 
+// Mark the record at `slot` of `block` deleted, with all of its pieces
+static void removeRecord(SequentialFile *file, Block *block, int slot) {
+    int id = blockRecordAt(block, slot)->id;
+
+    for (;;) {
+        Record *piece = blockRecordAt(block, slot);
+        blockDeleteRecord(block, slot);
+        if (file->freeMap) {
+            fsmUpdate(file->freeMap, block);
+        }
+        if (!(piece->flags & RECORD_CONTINUED)) {
+            break;
+        }
+        block = touchBlock(file, block->next);
+        slot = 0;
+    }
+    if (file->index) {
+        hashIndexRemove(file->index, id);
+    }
+}
+
+// Drop the record starting with `record`, a slot of the pinned `block`,
+// from the payload index before it changes. The index is keyed by data,
+// so the record's data is read back, from all of its pieces.
+static void unindexPayload(SequentialFile *file, Block *block, const Record *record) {
+    if (!file->payloadIndex) return;
+
+    pinSpan(file, block);
+    int size = blockRecordLength(block, record);
+    if (payloadCapacity < size + 1) {
+        payloadCapacity = size + 1;
+        payloadBuffer = (char *)realloc(payloadBuffer, payloadCapacity);
+        STAT_ADD(file, allocations, 1);
+    }
+    blockReadData(block, record, payloadBuffer, size);
+    payloadBuffer[size] = '\0';
+    unpinSpan(file, block);
+    payloadIndexRemove(file->payloadIndex, record->id, payloadBuffer);
+}
+
+// Rewrite a record in place when the new data fits the room it has, its
+// slack included. Otherwise the record moves to wherever an insert would
+// put it, in pieces if it needs them, and the index and directory follow
+// it, so an update only fails for data the file cannot hold at all.
+static int updateRecordLatched(SequentialFile *file, int id, const char *newData) {
+    int size = strlen(newData) + 1;
+    // Reserving may move a contiguous file's blocks, so it comes first
+    if (!reserveBlocks(file, id, size)) {
+        return 0;
+    }
+
+    Block *block;
+    int slot;
+    Record *record = findRecord(file, id, &block, &slot);
+
+    if (!record) {
+        return 0;
+    }
+    if (!recordFits(file, id, size)) {
+        unpinBlock(file, block);
+        return 0;
+    }
+    unindexPayload(file, block, record);
+
+    // A record that spans blocks, or has to from now on, is stored anew
+    int offset = -1;
+    if (!(record->flags & RECORD_CONTINUED) && !needsSpan(file, size)) {
+        offset = blockUpdateRecord(block, slot, newData, size);
+    }
+
+    // Compacting away dead records may make room for the larger copy.
+    // Ordered files only compact on insert, where their directory is known.
+    if (offset < 0 && file->freeMap && block->deadSpace > 0 && !(record->flags & RECORD_CONTINUED)) {
+        // Compaction drops the deleted slots ahead of ours
+        int liveSlot = 0;
+        for (int i = 0; i < slot; i++) {
+            if (!(blockRecordAt(block, i)->flags & RECORD_DELETED)) liveSlot++;
+        }
+        compactBlock(file, block);
+        slot = liveSlot;
+        offset = blockUpdateRecord(block, slot, newData, size);
+    }
+
+    if (offset < 0) {
+        if (moveCapacity < (int)sizeof(Record) + size) {
+            moveCapacity = (int)sizeof(Record) + size;
+            moveBuffer = (char *)realloc(moveBuffer, moveCapacity);
+            STAT_ADD(file, allocations, 1);
+        }
+        Record *moved = (Record *)moveBuffer;
+        moved->id = id;
+        moved->size = size;
+        moved->flags = 0;
+        moved->slack = 0;
+        memcpy(moved->data, newData, size);
+        removeRecord(file, block, slot);
+        if (!placeRecord(file, moved)) {
+            // The old version is gone already; log that much
+            if (file->log) {
+                walAppend(file->log, WAL_DELETE, id, NULL, 0);
+            }
+            unpinBlock(file, block);
+            return 0;
+        }
+        STAT_ADD(file, recordsRelocated, 1);
+    } else {
+        if (file->freeMap) {
+            fsmUpdate(file->freeMap, block);
+        }
+        if (file->index) {
+            hashIndexPut(file->index, id, block, offset);
+        }
+    }
+    if (file->payloadIndex) {
+        payloadIndexAdd(file->payloadIndex, id, newData);
+    }
+    if (file->log) {
+        walAppend(file->log, WAL_UPDATE, id, newData, size);
+    }
+    unpinBlock(file, block);
+    return 1;
+}
+
+int updateRecord(SequentialFile *file, int id, const char *newData) {
+    STAT_TIMER(started);
+    int updated = 0;
+    FOR_EACH_COPY(copy, file) {
+        updated = updateRecordLatched(copy, id, newData);
+        unpinTouched(copy);
+    }
+    STAT_RECORD(file, STAT_UPDATE, started);
+    return updated;
+}
+
+static int deleteRecordLatched(SequentialFile *file, int id) {
+    Block *block;
+    int slot;
+    Record *record = findRecord(file, id, &block, &slot);
+
+    if (!record) {
+        return 0; // Record not found
+    }
+    unindexPayload(file, block, record);
+    removeRecord(file, block, slot); // Mark as deleted
+    unpinBlock(file, block);
+    if (file->log) {
+        walAppend(file->log, WAL_DELETE, id, NULL, 0);
+    }
+    return 1; // Success
+}
+
+int deleteRecord(SequentialFile *file, int id) {
+    STAT_TIMER(started);
+    int deleted = 0;
+    FOR_EACH_COPY(copy, file) {
+        deleted = deleteRecordLatched(copy, id);
+        unpinTouched(copy);
+    }
+    STAT_RECORD(file, STAT_DELETE, started);
+    return deleted;
+}
+
+
+// The record found in `block` in one piece, as searchRecord returns it,
+// releasing the pin findRecord left on the block
+static Record *joinFound(SequentialFile *file, Block *block, const Record *record) {
+    Record *joined;
+    int capacity = joinCapacity;
+
+    pinSpan(file, block);
+    if (file->buffers) {
+        joined = blockCopyRecord(block, record, &joinBuffer, &joinCapacity);
+    } else {
+        joined = blockJoinRecord(block, record, &joinBuffer, &joinCapacity);
+    }
+    if (joinCapacity != capacity) {
+        STAT_ADD(file, allocations, 1);
+    }
+    unpinSpan(file, block);
+    unpinBlock(file, block);
+    return joined;
+}
+
+// A record stored in one block is returned in place; one that spans
+// blocks is joined into a buffer of the calling thread, valid until its
+// next lookup of a spanned record. With concurrency enabled the record may
+// be changed or moved by the next write; copyRecord or a cursor give a
+// stable view. Records of a paged file are always copied into the buffer,
+// as their block may be evicted once the lookup is over.
+Record *searchRecord(SequentialFile *file, int key) {
+    Block *block;
+    STAT_TIMER(started);
+    SequentialFile *copy = readBegin(file);
+    Record *record = findRecord(copy, key, &block, NULL);
+    if (record) {
+        record = joinFound(copy, block, record);
+    }
+    readEnd(file, copy);
+    STAT_RECORD(file, STAT_LOOKUP, started);
+    return record;
+}
+
+// Copy the data of record `id` into `data`, NUL-terminated and cut to
+// `capacity` bytes. Unlike searchRecord the copy stays valid while other
+// threads write to the file. Returns the record's data size, or -1 if
+// there is no such record.
+int copyRecord(SequentialFile *file, int id, char *data, int capacity) {
+    Block *block;
+    STAT_TIMER(started);
+    SequentialFile *copy = readBegin(file);
+    Record *record = findRecord(copy, id, &block, NULL);
+    int size = -1;
+    if (record) {
+        pinSpan(copy, block);
+        if (capacity > 0) {
+            size = blockReadData(block, record, data, capacity - 1);
+            data[size < capacity - 1 ? size : capacity - 1] = '\0';
+        } else {
+            size = blockRecordLength(block, record);
+        }
+        unpinSpan(copy, block);
+        unpinBlock(copy, block);
+    }
+    readEnd(file, copy);
+    STAT_RECORD(file, STAT_LOOKUP, started);
+    return size;
+}
+
+// Data searched for by a scan of a file without a payload index
+typedef struct {
+    const char *data;
+    size_t length;
+    RecordBatch *results;
+} PayloadQuery;
+
+static int payloadEquals(const Record *record, void *arg) {
+    return strcmp(record->data, ((PayloadQuery *)arg)->data) == 0;
+}
+
+static int payloadStartsWith(const Record *record, void *arg) {
+    PayloadQuery *query = (PayloadQuery *)arg;
+    return strncmp(record->data, query->data, query->length) == 0;
+}
+
+static void addToResults(const Record *record, void *arg) {
+    recordBatchAdd(((PayloadQuery *)arg)->results, record->id, record->data);
+}
+
+// Append copies of the records whose data is `data` to `results`, so they
+// stay valid whatever later happens to the file. With the payload index
+// they come straight from its hash table; without it the whole file is
+// scanned. Returns the number of records found.
+size_t searchRecordsByPayload(SequentialFile *file, const char *data, RecordBatch *results) {
+    STAT_TIMER(started);
+    SequentialFile *copy = readBegin(file);
+    if (!copy->payloadIndex) {
+        readEnd(file, copy);
+        PayloadQuery query = {data, 0, results};
+        return parallelScan(file, INT_MIN, INT_MAX, payloadEquals, addToResults, &query, 0);
+    }
+    size_t found = payloadIndexFind(copy->payloadIndex, data, results);
+    readEnd(file, copy);
+    STAT_RECORD(file, STAT_LOOKUP, started);
+    return found;
+}
+
+// Like searchRecordsByPayload, for the records whose data starts with
+// `prefix`: in data order from the payload index, in file order from a
+// scan without it
+size_t searchRecordsByPayloadPrefix(SequentialFile *file, const char *prefix, RecordBatch *results) {
+    STAT_TIMER(started);
+    SequentialFile *copy = readBegin(file);
+    if (!copy->payloadIndex) {
+        readEnd(file, copy);
+        PayloadQuery query = {prefix, strlen(prefix), results};
+        return parallelScan(file, INT_MIN, INT_MAX, payloadStartsWith, addToResults, &query, 0);
+    }
+    size_t found = payloadIndexFindPrefix(copy->payloadIndex, prefix, results);
+    readEnd(file, copy);
+    STAT_RECORD(file, STAT_LOOKUP, started);
+    return found;
+}
+
+static void printRow(const Record *record, void *arg) {
+    (void)arg;
+    printf("| %-10d | %-15s |\n", record->id, record->data);
+}
+
+void searchRecordsByRange(SequentialFile *file, int startKey, int endKey) {
     // Print header for results
     printf("\nRecords with keys between %d and %d:\n", startKey, endKey);
     printf("+------------+-----------------+\n");
     printf("| Record ID  | Data            |\n");
     printf("+------------+-----------------+\n");
 
-    while (current) {
-        char *ptr = current->data;
-        int remaining = current->blockSize - current->freeSpace;
-        
-        while (remaining >= sizeof(Record)) {
-            Record *record = (Record *)ptr;
-            
-            // Check if record is valid and within range
-            if (record->id != -1 && record->id >= startKey && record->id <= endKey) {
-                printf("| %-10d | %-15s |\n", record->id, record->data);
-                recordsFound++;
-            }
-            
-            // Move to next record
-            int recordSize = sizeof(Record) + record->size;
-            ptr += recordSize;
-            remaining -= recordSize;
-        }
-        current = current->next;
-    }
+    // Large files are searched on all cores; rows still come out in order
+    size_t recordsFound = parallelScan(file, startKey, endKey, NULL, printRow, NULL, 0);
     
     printf("+------------+-----------------+\n");
     
     if (recordsFound == 0) {
         printf("No records found within the specified range.\n");
     } else {
-        printf("Total records found: %d\n", recordsFound);
+        printf("Total records found: %zu\n", recordsFound);
     }
 }
 
 
-void reorganizeFile(SequentialFile *file) {
-    if (file->isOrdered) return; // Skip for ordered files
+// Compact `block`, the block after `prev`, and then drop it if nothing
+// live is left in it or merge it into `prev` if both fit together within
+// COMPACT_FILL_PERCENT. Records only ever move to the end of the block
+// before them, so ordered files stay in key order. Returns 1 if the block
+// is kept.
+static int compactOneBlock(SequentialFile *file, Block *prev, Block *block) {
+    BlockDirectory *directory = file->directory;
+    int pos = -1;
+    touchBlock(file, prev);
+    touchBlock(file, block);
+    STAT_ADD(file, blocksWalked, 1);
+    if (directory) {
+        // The directory lists the blocks in table order
+        pos = !prev ? 0 : file->table ? prev->position + 1 : directoryPosition(directory, prev) + 1;
+    }
+
+    if (block->deadSpace > 0) {
+        blockCompact(block);
+        indexBlock(file, block);
+    }
+
+    int count = blockRecordCount(block);
+    int capacity = blockCapacity(block);
+    int live = capacity - block->freeSpace;
+    int merge = count > 0 && prev && live <= prev->freeSpace &&
+                capacity - prev->freeSpace + live <= capacity * COMPACT_FILL_PERCENT / 100;
+
+    // The pieces of a spanned record stay where they are
+    if (merge && (continues(blockRecordAt(prev, blockRecordCount(prev) - 1)) ||
+                  (blockRecordAt(block, 0)->flags & RECORD_CONTINUATION))) {
+        merge = 0;
+    }
+
+    if (count > 0 && !merge) {
+        if (directory) {
+            directoryRefresh(directory, pos);
+        }
+        if (file->freeMap) {
+            fsmUpdate(file->freeMap, block);
+        }
+        return 1;
+    }
+
+    for (int slot = 0; slot < count; slot++) {
+        Record *record = blockRecordAt(block, slot);
+        int offset = blockInsertRecord(prev, blockRecordCount(prev), record, record->slack);
+        if (file->index) {
+            hashIndexPut(file->index, record->id, prev, offset);
+        }
+    }
+    if (merge && directory) {
+        directoryRefresh(directory, pos - 1);
+    }
+    if (merge && file->freeMap) {
+        fsmUpdate(file->freeMap, prev);
+    }
 
-    // Temporary storage
-    int totalSize = 0;
-    Block *current = file->head;
-    while (current) {
-        totalSize += (current->blockSize - current->freeSpace);
-        current = current->next;
+    // Unlink and free the now empty block
+    if (prev) {
+        prev->next = block->next;
+    } else {
+        file->head = block->next;
+    }
+    if (file->tail == block) {
+        file->tail = prev;
+    }
+    if (file->table) {
+        tableRemove(file->table, block->position);
     }
+    if (directory) {
+        directoryRemove(directory, pos);
+    }
+    if (file->freeMap) {
+        fsmRemove(file->freeMap, block);
+    }
+    releaseBlock(file, block);
+    return 0;
+}
+
+// Advance the running compaction pass by up to `maxBlocks` blocks. Each
+// step only touches one block and the one before it, so passes can be
+// spread over many calls between other operations; blocks are only ever
+// freed here, so the cursor stays valid in between. Returns 1 once the
+// pass has reached the end of the file (the next call starts a new pass),
+// 0 while blocks remain.
+static int compactFileLatched(SequentialFile *file, int maxBlocks) {
+    for (int step = 0; step < maxBlocks; step++) {
+        Block *prev = file->compactCursor;
+        Block *block = prev ? prev->next : file->head;
 
-    char *tempData = (char *)malloc(totalSize);
-    int offset = 0;
+        if (!block) {
+            break;
+        }
+        if (compactOneBlock(file, prev, block)) {
+            file->compactCursor = block;
+        }
+        unpinTouched(file);
+    }
 
-    current = file->head;
-    while (current) {
-        memcpy(tempData + offset, current->data, current->blockSize - current->freeSpace);
-        offset += (current->blockSize - current->freeSpace);
-        current = current->next;
+    Block *cursor = file->compactCursor;
+    if (!(cursor ? cursor->next : file->head)) {
+        file->compactCursor = NULL;
+        return 1;
     }
+    return 0;
+}
 
-    // Reorganize blocks
-    current = file->head;
-    offset = 0;
-    while (current) {
-        int toCopy = (current->blockSize < totalSize - offset) ? current->blockSize : totalSize - offset;
-        memcpy(current->data, tempData + offset, toCopy);
-        current->freeSpace = current->blockSize - toCopy;
-        offset += toCopy;
-        current = current->next;
+int compactFile(SequentialFile *file, int maxBlocks) {
+    STAT_TIMER(started);
+    int finished = 0;
+    FOR_EACH_COPY(copy, file) {
+        finished = compactFileLatched(copy, maxBlocks);
     }
+    STAT_RECORD(file, STAT_COMPACT, started);
+    return finished;
+}
 
-    free(tempData);
+// Reclaim all dead space at once with a full compaction pass. The blocks
+// of a contiguous file are then laid out in file order again.
+void reorganizeFile(SequentialFile *file) {
+    STAT_TIMER(started);
+    FOR_EACH_COPY(copy, file) {
+        copy->compactCursor = NULL;
+        while (!compactFileLatched(copy, COMPACT_STEP_BLOCKS)) {
+        }
+        if (copy->table) {
+            tablePack(copy->table);
+        }
+    }
+    STAT_RECORD(file, STAT_COMPACT, started);
 }
 
+// Snapshot the file's counters (see file_stats.h) along with how full its
+// blocks are. The gauges come from each block's space accounting, so the
+// blocks of a paged file are not read in.
+void getFileStats(SequentialFile *file, FileStats *stats) {
+    memset(stats, 0, sizeof(FileStats));
+#ifndef NO_FILE_STATS
+    stats->countersEnabled = 1;
+#endif
+    SequentialFile *copy = readBegin(file);
+    statCopyCounters(&stats->counters, &file->stats);
+    for (Block *block = copy->head; block; block = block->next) {
+        int capacity = blockCapacity(block);
+        stats->blocks++;
+        stats->capacityBytes += capacity;
+        stats->freeBytes += block->freeSpace;
+        stats->deadBytes += block->deadSpace;
+        stats->liveBytes += capacity - block->freeSpace - block->deadSpace;
+    }
+    if (stats->capacityBytes > 0) {
+        stats->fillFactor = (double)stats->liveBytes / stats->capacityBytes;
+    }
+    if (stats->liveBytes + stats->deadBytes > 0) {
+        stats->tombstoneRatio = (double)stats->deadBytes / (stats->liveBytes + stats->deadBytes);
+    }
+    if (file->buffers) {
+        pthread_mutex_lock(&file->buffers->lock);
+        stats->pageHits = file->buffers->hits;
+        stats->pageMisses = file->buffers->misses;
+        stats->pageEvictions = file->buffers->evictions;
+        stats->pageWriteBacks = file->buffers->writeBacks;
+        pthread_mutex_unlock(&file->buffers->lock);
+    }
+    readEnd(file, copy);
+}
 
+// Readers may still be counting, so the counters are cleared one by one
+void resetFileStats(SequentialFile *file) {
+    writeBeginAlone(file);
+    statClearCounters(&file->stats);
+    writeEnd(file);
+}
 
 void freeFile(SequentialFile *file) {
-    Block *current = file->head;
-    while (current) {
-        Block *next = current->next;
-        freeBlock(current);
-        current = next;
+    // Blocks go with their pool, slab by slab
+    freeBlockPool(file->pool);
+    freeBufferPool(file->buffers);
+    freeArena(file->arena);
+    freeHashIndex(file->index);
+    freePayloadIndex(file->payloadIndex);
+    freeDirectory(file->directory);
+    freeFreeSpaceMap(file->freeMap);
+    freeBlockTable(file->table);
+    if (file->mapping) {
+        munmap(file->mapping, file->mappingSize);
+    }
+    walClose(file->log);
+    free(file->disk.path);
+    free(file->disk.freeBlocks);
+    if (file->shared) {
+        freeFile(file->shared->copies[1]);
+        pthread_mutex_destroy(&file->shared->writer);
+        free(file->shared);
+    }
+    if (file->latch) {
+        pthread_rwlock_destroy(file->latch);
+        free(file->latch);
     }
     free(file);
 }
@@ -276,30 +1658,18 @@ void freeFile(SequentialFile *file) {
 
 // Function to print the sequential file in a human-readable format
 void printFile(SequentialFile *file) {
-    Block *current = file->head;
+    Cursor cursor;
     
     printf("\nSequential File Contents:\n");
     printf("+------------+-----------------+\n");
     printf("| Record ID  | Data            |\n");
     printf("+------------+-----------------+\n");
 
-    while (current) {
-        char *ptr = current->data;
-        int remaining = current->blockSize - current->freeSpace;
-        
-        while (remaining > 0) {
-            Record *record = (Record *)ptr;
-            if (record->id != -1) {  // Only print non-deleted records
-                printf("| %-10d | %-15s |\n", record->id, record->data);
-            }
-            // Move pointer to next record
-            ptr += sizeof(Record) + record->size;
-            remaining -= (sizeof(Record) + record->size);
-            
-            if (remaining < sizeof(Record)) break;
-        }
-        current = current->next;
+    cursorOpen(&cursor, file);
+    for (Record *record; (record = cursorNext(&cursor)); ) {
+        printf("| %-10d | %-15s |\n", record->id, record->data);
     }
+    cursorClose(&cursor);
     printf("+------------+-----------------+\n");
 }
 
@@ -309,26 +1679,14 @@ Record *binarySearchInFile(SequentialFile *file, int key) {
         return NULL;
     }
 
-    Block *current = file->head;
-
-    while (current) {
-        int left = 0;
-        int right = (current->blockSize - current->freeSpace) / sizeof(Record) - 1;
-        Record *records = (Record *)(current->data);
-
-        while (left <= right) {
-            int mid = (left + right) / 2;
-            if (records[mid].id == key) {
-                return &records[mid];
-            } else if (records[mid].id < key) {
-                left = mid + 1;
-            } else {
-                right = mid - 1;
-            }
-        }
-
-        current = current->next;
+    Block *block;
+    STAT_TIMER(started);
+    SequentialFile *copy = readBegin(file);
+    Record *record = findOrdered(copy, key, &block, NULL);
+    if (record) {
+        record = joinFound(copy, block, record);
     }
-
-    return NULL; // Not found
+    readEnd(file, copy);
+    STAT_RECORD(file, STAT_LOOKUP, started);
+    return record;
 }
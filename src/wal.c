@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "wal.h"
+
+#define WAL_PAYLOAD_SPACE(size) (((size_t)(size) + 3) & ~(size_t)3)
+
+static unsigned int recordChecksum(unsigned int generation, const WalRecord *record, const void *payload) {
+    unsigned int hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)&generation;
+
+    for (size_t i = 0; i < sizeof(generation); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    bytes = (const unsigned char *)&record->type;
+    for (size_t i = 0; i < sizeof(WalRecord) - offsetof(WalRecord, type); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    bytes = (const unsigned char *)payload;
+    for (int i = 0; i < record->size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int writeAll(int fd, const char *bytes, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0) {
+            return -1;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+// Open the log at `path`, creating it if needed. The header is read but
+// not trusted: callers compare `generation` with the data file and either
+// replay the log or reset it.
+WriteAheadLog *walOpen(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("Error opening log");
+        return NULL;
+    }
+
+    WriteAheadLog *log = (WriteAheadLog *)malloc(sizeof(WriteAheadLog));
+    WalHeader header;
+    struct stat st;
+
+    log->fd = fd;
+    log->generation = 0;
+    log->end = sizeof(WalHeader);
+    if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && header.magic == WAL_MAGIC &&
+        fstat(fd, &st) == 0) {
+        log->generation = header.generation;
+        log->end = st.st_size;
+    }
+    log->buffer = NULL;
+    log->used = 0;
+    log->capacity = 0;
+    log->pending = 0;
+    return log;
+}
+
+// Make whatever is still buffered durable and close the log
+void walClose(WriteAheadLog *log) {
+    if (log) {
+        walCommit(log);
+        close(log->fd);
+        free(log->buffer);
+        free(log);
+    }
+}
+
+// Empty the log and start it over for `generation`, dropping anything
+// still buffered. Returns 1 on success, 0 on failure.
+int walReset(WriteAheadLog *log, unsigned int generation) {
+    WalHeader header = {WAL_MAGIC, generation};
+
+    log->used = 0;
+    log->pending = 0;
+    log->generation = generation;
+    log->end = sizeof(WalHeader);
+    if (ftruncate(log->fd, 0) != 0 || writeAll(log->fd, (const char *)&header, sizeof(header), 0) != 0 ||
+        fdatasync(log->fd) != 0) {
+        perror("Error resetting log");
+        return 0;
+    }
+    return 1;
+}
+
+// Write out the buffered records without waiting for them to be durable
+static int walWrite(WriteAheadLog *log) {
+    if (log->used == 0) {
+        return 0;
+    }
+    if (writeAll(log->fd, log->buffer, log->used, log->end) != 0) {
+        perror("Error writing log");
+        return -1;
+    }
+    log->end += log->used;
+    log->used = 0;
+    return 0;
+}
+
+// Buffer a record. Operations become durable with the next group commit,
+// which happens once WAL_GROUP_COMMIT of them are pending or on walCommit.
+void walAppend(WriteAheadLog *log, int type, int id, const void *data, int size) {
+    size_t space = sizeof(WalRecord) + WAL_PAYLOAD_SPACE(size);
+
+    if (log->used + space > log->capacity) {
+        if (log->used > 0 && log->used + space > WAL_BUFFER_SIZE) {
+            walWrite(log);
+        }
+        if (log->used + space > log->capacity) {
+            size_t capacity = log->capacity ? log->capacity : WAL_BUFFER_SIZE;
+            while (log->used + space > capacity) {
+                capacity *= 2;
+            }
+            log->buffer = (char *)realloc(log->buffer, capacity);
+            log->capacity = capacity;
+        }
+    }
+
+    WalRecord *record = (WalRecord *)(log->buffer + log->used);
+    record->type = type;
+    record->id = id;
+    record->size = size;
+    if (size > 0) {
+        memcpy(record + 1, data, size);
+    }
+    memset((char *)(record + 1) + size, 0, WAL_PAYLOAD_SPACE(size) - size);
+    record->checksum = recordChecksum(log->generation, record, record + 1);
+    log->used += space;
+
+    if (type <= WAL_DELETE && ++log->pending >= WAL_GROUP_COMMIT) {
+        walCommit(log);
+    }
+}
+
+// Write the buffered records and wait until they are durable.
+// Returns 1 on success, 0 on failure.
+int walCommit(WriteAheadLog *log) {
+    if (log->used == 0 && log->pending == 0) {
+        return 1;
+    }
+    if (walWrite(log) != 0) {
+        return 0;
+    }
+    if (fdatasync(log->fd) != 0) {
+        perror("Error syncing log");
+        return 0;
+    }
+    log->pending = 0;
+    return 1;
+}
+
+// Read the whole log file into memory; the caller frees the result
+char *walRead(WriteAheadLog *log, size_t *size) {
+    struct stat st;
+    if (fstat(log->fd, &st) != 0) {
+        *size = 0;
+        return NULL;
+    }
+
+    char *contents = (char *)malloc(st.st_size ? st.st_size : 1);
+    ssize_t done = pread(log->fd, contents, st.st_size, 0);
+    *size = done > 0 ? (size_t)done : 0;
+    return contents;
+}
+
+// The record at `*pos` in `contents` (start at sizeof(WalHeader)), moving
+// `*pos` past it, or NULL at the end of the log or at the first record
+// that is truncated or fails its checksum
+const WalRecord *walNext(const WriteAheadLog *log, const char *contents, size_t size, size_t *pos) {
+    if (*pos + sizeof(WalRecord) > size) {
+        return NULL;
+    }
+
+    const WalRecord *record = (const WalRecord *)(contents + *pos);
+    if (record->size < 0 || WAL_PAYLOAD_SPACE(record->size) > size - *pos - sizeof(WalRecord) ||
+        recordChecksum(log->generation, record, record + 1) != record->checksum) {
+        return NULL;
+    }
+    *pos += sizeof(WalRecord) + WAL_PAYLOAD_SPACE(record->size);
+    return record;
+}
+
+// Cut the log file down to its first `size` bytes, e.g. to drop a torn
+// tail, so new records are appended after the last valid one
+int walTruncate(WriteAheadLog *log, size_t size) {
+    log->used = 0;
+    log->pending = 0;
+    log->end = size;
+    if (ftruncate(log->fd, size) != 0 || fdatasync(log->fd) != 0) {
+        perror("Error truncating log");
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,40 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include "sequential_file.h"
+
+// Minimal harness shared by the regression tests: CHECK reports a failed
+// condition with its location and carries on, checkResult sums up.
+
+static int checkFailures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        checkFailures++; \
+    } \
+} while (0)
+
+// The library reports every operation on stdout; the tests only report
+// failures, on stderr
+static inline void quietLibrary(void) {
+    if (!freopen("/dev/null", "w", stdout)) {
+        perror("freopen");
+    }
+}
+
+// Print the outcome of the test program `name`; returns its exit status
+static inline int checkResult(const char *name) {
+    fprintf(stderr, "%s: %s\n", name, checkFailures ? "FAILED" : "ok");
+    return checkFailures != 0;
+}
+
+// Insert a record with `id` and `data` into `file`
+static inline void insertData(SequentialFile *file, int id, const char *data) {
+    Record *record = createRecord(id, data);
+    insertRecord(file, record);
+    freeRecord(record);
+}
+
+#endif // CHECK_H
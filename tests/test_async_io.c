@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "persistence.h"
+#include "async_io.h"
+
+#define RECORDS 8000
+#define CHUNK 4096
+#define CHUNKS 100
+
+// The bytes a test writes at `offset`
+static char expectedByte(size_t offset) {
+    return (char)(offset * 7 + offset / CHUNK);
+}
+
+// More requests than the queue holds, written then read back out of
+// order; completions carry their tags, and a read past the end fails
+static void testRequests(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_async_io_%d.dat", (int)getpid());
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    char *buffer = (char *)malloc((size_t)CHUNKS * CHUNK);
+    for (size_t i = 0; i < (size_t)CHUNKS * CHUNK; i++) {
+        buffer[i] = expectedByte(i);
+    }
+
+    AsyncIo *io = aioOpen(fd);
+    CHECK(aioWait(io, NULL) == -1);
+    int seen[CHUNKS] = {0};
+    void *tag;
+    for (int chunk = 0; chunk < CHUNKS; chunk++) {
+        while (aioFull(io)) {
+            CHECK(aioWait(io, &tag) == 1);
+            seen[(long)tag]++;
+        }
+        CHECK(aioSubmit(io, 1, buffer + (size_t)chunk * CHUNK, CHUNK, (off_t)chunk * CHUNK, (void *)(long)chunk));
+    }
+    while (aioWait(io, &tag) >= 0) {
+        seen[(long)tag]++;
+    }
+    for (int chunk = 0; chunk < CHUNKS; chunk++) {
+        CHECK(seen[chunk] == 1);
+    }
+
+    // Read back from the last chunk to the first
+    memset(buffer, 0, (size_t)CHUNKS * CHUNK);
+    for (int chunk = CHUNKS - 1; chunk >= 0; chunk--) {
+        while (aioFull(io)) {
+            CHECK(aioWait(io, NULL) == 1);
+        }
+        aioSubmit(io, 0, buffer + (size_t)chunk * CHUNK, CHUNK, (off_t)chunk * CHUNK, NULL);
+    }
+    CHECK(aioDrain(io));
+    int intact = 1;
+    for (size_t i = 0; i < (size_t)CHUNKS * CHUNK; i++) {
+        intact &= buffer[i] == expectedByte(i);
+    }
+    CHECK(intact);
+
+    CHECK(aioSubmit(io, 0, buffer, CHUNK, (off_t)CHUNKS * CHUNK - CHUNK / 2, NULL));
+    CHECK(aioWait(io, NULL) == 0);
+    aioClose(io);
+    close(fd);
+    unlink(path);
+    free(buffer);
+}
+
+// Data of record `id`, mostly letters that compress poorly
+static void recordData(char *data, size_t size, int id) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+/";
+    int length = snprintf(data, size, "record %d ", id);
+    unsigned state = (unsigned)id * 2654435761u + 1;
+    for (int end = length + 40 + id % 50; length < end && length < (int)size - 1; length++) {
+        state = state * 1103515245u + 12345u;
+        data[length] = letters[(state >> 16) % 64];
+    }
+    data[length] = '\0';
+}
+
+// A file saved and loaded back, over several requests, holds every record
+// it held; a file cut short fails to load
+static void testRoundTrip(int isContiguous, int isCompressed) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_async_io_%d.bin", (int)getpid());
+    SequentialFile *file = initializeFile(4096, isContiguous, 0, 0, 0);
+    if (isCompressed) {
+        enableCompression(file);
+    }
+    char data[128];
+    for (int id = 0; id < RECORDS; id++) {
+        recordData(data, sizeof(data), id);
+        insertData(file, id, data);
+    }
+    saveFileToDisk(file, path);
+    freeFile(file);
+
+    file = loadFileFromDisk(path);
+    CHECK(file != NULL);
+    if (file) {
+        char copy[128];
+        int matched = 0;
+        for (int id = 0; id < RECORDS; id++) {
+            recordData(data, sizeof(data), id);
+            matched += copyRecord(file, id, copy, sizeof(copy)) > 0 && strcmp(copy, data) == 0;
+        }
+        CHECK(matched == RECORDS);
+        freeFile(file);
+    }
+
+    // Drop the last blocks
+    struct stat info;
+    CHECK(stat(path, &info) == 0 && info.st_size > 2 * AIO_REQUEST_SIZE);
+    CHECK(truncate(path, info.st_size - 3 * 4096) == 0);
+    file = loadFileFromDisk(path);
+    CHECK(file == NULL);
+    if (file) {
+        freeFile(file);
+    }
+    deleteFileFromDisk(path);
+}
+
+static void runAll(void) {
+    testRequests();
+    testRoundTrip(0, 0);
+    testRoundTrip(1, 0);
+    testRoundTrip(0, 1);
+}
+
+// Have the system calls in `calls` fail with `error` for good
+static int denyCalls(const int *calls, int count, int error) {
+    struct sock_filter filter[2 * 8 + 2];
+    int length = 0;
+    filter[length++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+    for (int i = 0; i < count; i++) {
+        filter[length++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, calls[i], 0, 1);
+        filter[length++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | error);
+    }
+    filter[length++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    struct sock_fprog program = {(unsigned short)length, filter};
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+}
+
+// Run every test in a child process that lacks io_uring, and, with
+// `noThreads`, cannot start threads either; returns whether it passed
+static int runWithout(int noThreads) {
+    fflush(NULL);
+    pid_t child = fork();
+    if (child == 0) {
+        int calls[] = {__NR_io_uring_setup, __NR_clone, __NR_clone3};
+        if (!denyCalls(calls, noThreads ? 3 : 1, noThreads ? EAGAIN : ENOSYS)) {
+            // Without seccomp there is nothing to test
+            _exit(0);
+        }
+        AsyncIo *io = aioOpen(-1);
+        CHECK(io->ring < 0 && io->threadCount == (noThreads ? 0 : AIO_THREADS));
+        aioClose(io);
+        runAll();
+        _exit(checkFailures != 0);
+    }
+    int status;
+    return child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(void) {
+    quietLibrary();
+    runAll();
+    // The thread pool, then transfers on the spot
+    CHECK(runWithout(0));
+    CHECK(runWithout(1));
+    return checkResult("async_io");
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "check.h"
+#include "persistence.h"
+
+// Runs the `sequential_file` program built next to the tests, as `make
+// test` does from the top of the tree
+
+#define PROGRAM "./sequential_file"
+#define OUTPUT_SIZE 4096
+
+static char scriptPath[64], outPath[64], errPath[64], savePath[64];
+static char out[OUTPUT_SIZE], err[OUTPUT_SIZE];
+
+static void readAll(const char *path, char *buffer) {
+    size_t size = 0;
+    FILE *in = fopen(path, "r");
+    if (in) {
+        size = fread(buffer, 1, OUTPUT_SIZE - 1, in);
+        fclose(in);
+    }
+    buffer[size] = '\0';
+}
+
+// Run the program with `options`, the script written to a file and handed
+// over as `input` (a shell redirection or argument naming scriptPath);
+// returns its exit status and leaves its output in `out` and `err`
+static int run(const char *options, const char *input, const char *script) {
+    FILE *file = fopen(scriptPath, "w");
+    if (file) {
+        fputs(script, file);
+        fclose(file);
+    }
+    char command[512];
+    snprintf(command, sizeof(command), "%s %s %s >%s 2>%s", PROGRAM, options, input, outPath, errPath);
+    int status = system(command);
+    readAll(outPath, out);
+    readAll(errPath, err);
+    return status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Every command of a clean script acknowledges or prints its results, in
+// order, consecutive inserts as one batch, and the program exits with 0
+static void testScript(void) {
+    char script[1024], expected[1024];
+    snprintf(script, sizeof(script),
+             "# A comment, then a blank line\n"
+             "\n"
+             "insert 1 one\n"
+             "insert 2 two words\n"
+             "  insert 3 three\n"
+             "get 2\n"
+             "update 2 zwei\n"
+             "range 1 3\n"
+             "delete 3\n"
+             "insert 4 four\n"
+             "find one\n"
+             "prefix f\n"
+             "save %s\n"
+             "load %s\n"
+             "get 4\n",
+             savePath, savePath);
+    snprintf(expected, sizeof(expected),
+             "inserted 3\n"
+             "2\ttwo words\n"
+             "updated 2\n"
+             "1\tone\n2\tzwei\n3\tthree\n"
+             "found 3\n"
+             "deleted 3\n"
+             "inserted 1\n"
+             "1\tone\n"
+             "found 1\n"
+             "4\tfour\n"
+             "found 1\n"
+             "saved %s\n"
+             "loaded %s\n"
+             "4\tfour\n",
+             savePath, savePath);
+
+    char input[80];
+    snprintf(input, sizeof(input), "--batch %s", scriptPath);
+    CHECK(run("--payload-index", input, script) == 0);
+    CHECK(strcmp(out, expected) == 0);
+    CHECK(err[0] == '\0');
+
+    // Without the index the searches scan, to the same results
+    CHECK(run("", input, script) == 0);
+    CHECK(strcmp(out, expected) == 0);
+    deleteFileFromDisk(savePath);
+}
+
+// A script comes from stdin without a path or with "-", and quiet runs
+// print nothing but the records found
+static void testStdinAndQuiet(void) {
+    const char *script = "insert 7 seven\ninsert 8 eight\nget 8\nrange 0 100\ndelete 7\nget 8\n";
+    char input[80];
+    snprintf(input, sizeof(input), "<%s", scriptPath);
+
+    CHECK(run("--batch", input, script) == 0);
+    CHECK(strcmp(out, "inserted 2\n8\teight\n7\tseven\n8\teight\nfound 2\ndeleted 7\n8\teight\n") == 0);
+    CHECK(run("--batch -", input, script) == 0);
+    CHECK(strncmp(out, "inserted 2\n", 11) == 0);
+
+    CHECK(run("--quiet", input, script) == 0);
+    CHECK(strcmp(out, "8\teight\n7\tseven\n8\teight\n8\teight\n") == 0);
+    CHECK(err[0] == '\0');
+}
+
+// Each failed command is reported with its line number, the commands
+// after it still run, and the program exits with 1
+static void testErrors(void) {
+    const char *script =
+        "insert 1 one\n"
+        "insert nothing\n"
+        "get 2\n"
+        "\n"
+        "frobnicate 3\n"
+        "range 9 1\n"
+        "update 5 five\n"
+        "delete 6\n"
+        "get\n"
+        "get 1\n";
+    char input[80];
+    snprintf(input, sizeof(input), "--batch %s", scriptPath);
+
+    CHECK(run("--quiet", input, script) == 1);
+    CHECK(strcmp(out, "1\tone\n") == 0);
+    CHECK(strcmp(err,
+                 "Line 2: insert needs an id\n"
+                 "Line 3: record 2 not found\n"
+                 "Line 5: invalid command 'frobnicate 3'\n"
+                 "Line 6: invalid command 'range 9 1'\n"
+                 "Line 7: error updating record 5\n"
+                 "Line 8: record 6 not found\n"
+                 "Line 9: invalid command 'get'\n") == 0);
+
+    // The inserts before the bad line were still inserted
+    CHECK(run("--batch", input, script) == 1);
+    CHECK(strstr(out, "inserted 1\n") == out);
+
+    // A failed load keeps the file it had
+    CHECK(run("--quiet", input, "insert 1 one\nload /nonexistent/file.bin\nget 1\n") == 1);
+    CHECK(strcmp(out, "1\tone\n") == 0);
+    CHECK(strstr(err, "Line 2: error loading '/nonexistent/file.bin'\n") != NULL);
+}
+
+// A script that cannot be opened and unknown options fail before any
+// command runs
+static void testBadInvocations(void) {
+    char input[80];
+    snprintf(input, sizeof(input), "--batch %s.missing", scriptPath);
+    CHECK(run("", input, "") == 1);
+    CHECK(out[0] == '\0' && strstr(err, "Error opening script") == err);
+
+    CHECK(run("--frobnicate", "--batch", "") == 1);
+    CHECK(strstr(err, "Usage: ") == err);
+}
+
+int main(void) {
+    quietLibrary();
+    int pid = (int)getpid();
+    snprintf(scriptPath, sizeof(scriptPath), "/tmp/test_batch_%d.txt", pid);
+    snprintf(outPath, sizeof(outPath), "/tmp/test_batch_%d.out", pid);
+    snprintf(errPath, sizeof(errPath), "/tmp/test_batch_%d.err", pid);
+    snprintf(savePath, sizeof(savePath), "/tmp/test_batch_%d.bin", pid);
+
+    testScript();
+    testStdinAndQuiet();
+    testErrors();
+    testBadInvocations();
+
+    unlink(scriptPath);
+    unlink(outPath);
+    unlink(errPath);
+    return checkResult("batch");
+}
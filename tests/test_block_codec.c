@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "block_codec.h"
+#include "sequential_file.h"
+#include "persistence.h"
+
+#define MAX_SIZE (64 * 1024)
+
+static char source[MAX_SIZE];
+static char packed[CODEC_BOUND(MAX_SIZE)];
+static char unpacked[MAX_SIZE];
+
+// Compress and decompress the first `size` bytes of `source`; returns
+// the compressed size
+static int roundTrip(int size) {
+    int packedSize = codecCompress(source, size, packed, CODEC_BOUND(size));
+    CHECK(packedSize > 0 || size == 0);
+    CHECK(packedSize <= CODEC_BOUND(size));
+    CHECK(codecDecompress(packed, packedSize, unpacked, size) == size);
+    CHECK(memcmp(source, unpacked, size) == 0);
+    return packedSize;
+}
+
+// Repetitive data shrinks, random data stays within the bound, and both
+// come back byte for byte
+static void testRoundTrips(void) {
+    memset(source, 0, MAX_SIZE);
+    CHECK(roundTrip(MAX_SIZE) < MAX_SIZE / 100);
+
+    for (int i = 0; i < MAX_SIZE; i++) {
+        source[i] = "sequential file "[i % 16] + (i / 4096);
+    }
+    CHECK(roundTrip(MAX_SIZE) < MAX_SIZE / 4);
+
+    srand(18);
+    for (int i = 0; i < MAX_SIZE; i++) {
+        source[i] = (char)rand();
+    }
+    roundTrip(MAX_SIZE);
+
+    // Short inputs, too short for any match, and every size near the
+    // minimum match and end-of-block limits
+    for (int size = 0; size <= 40; size++) {
+        roundTrip(size);
+    }
+    memset(source, 'a', 40);
+    for (int size = 0; size <= 40; size++) {
+        roundTrip(size);
+    }
+
+    // Literal and match runs of 15 and more need length bytes
+    for (int i = 0; i < 4096; i++) {
+        source[i] = i < 300 ? (char)rand() : (char)(i % 7);
+    }
+    roundTrip(4096);
+}
+
+// Output written by any LZ4 block encoder decodes: "abcd", a match of 8
+// at distance 4 that overlaps its own output, then a final literal
+static void testKnownBlock(void) {
+    const char block[] = {0x44, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x10, 'e'};
+    char out[32];
+    CHECK(codecDecompress(block, sizeof(block), out, sizeof(out)) == 13);
+    CHECK(memcmp(out, "abcdabcdabcde", 13) == 0);
+}
+
+// Malformed input is rejected instead of read or written out of bounds
+static void testMalformed(void) {
+    const char block[] = {0x44, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x10, 'e'};
+    char out[32];
+
+    CHECK(codecDecompress(block, 3, out, sizeof(out)) == -1);
+    CHECK(codecDecompress(block, 6, out, sizeof(out)) == -1);
+    CHECK(codecDecompress(block, sizeof(block), out, 8) == -1);
+
+    const char farMatch[] = {0x44, 'a', 'b', 'c', 'd', 0x09, 0x00, 0x10, 'e'};
+    CHECK(codecDecompress(farMatch, sizeof(farMatch), out, sizeof(out)) == -1);
+    const char noDistance[] = {0x44, 'a', 'b', 'c', 'd', 0x00, 0x00, 0x10, 'e'};
+    CHECK(codecDecompress(noDistance, sizeof(noDistance), out, sizeof(out)) == -1);
+
+    // Too little room for the compressed output
+    memset(source, 'q', 1000);
+    CHECK(codecCompress(source, 1000, packed, 4) == 0);
+}
+
+// A compressed file saves and loads with its records intact
+static void testCompressedFile(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_block_codec_%d.bin", (int)getpid());
+
+    SequentialFile *file = initializeFile(1024, 0, 0, 0, 1);
+    enableCompression(file);
+    char data[64];
+    for (int id = 0; id < 500; id++) {
+        snprintf(data, sizeof(data), "record %d of a compressed file", id);
+        Record *record = createRecord(id, data);
+        insertRecord(file, record);
+        freeRecord(record);
+    }
+    saveFileToDisk(file, path);
+    freeFile(file);
+
+    file = loadFileFromDisk(path);
+    CHECK(file != NULL);
+    if (file) {
+        CHECK(file->isCompressed);
+        for (int id = 0; id < 500; id++) {
+            snprintf(data, sizeof(data), "record %d of a compressed file", id);
+            Record *record = searchRecord(file, id);
+            CHECK(record && strcmp(record->data, data) == 0);
+        }
+        freeFile(file);
+    }
+    deleteFileFromDisk(path);
+}
+
+int main(void) {
+    quietLibrary();
+    testRoundTrips();
+    testKnownBlock();
+    testMalformed();
+    testCompressedFile();
+    return checkResult("block_codec");
+}
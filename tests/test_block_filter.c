@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "persistence.h"
+
+#define RECORDS 2000
+
+// Every stored id passes the filter of its block; returns how many were
+// looked at
+static int checkFilters(SequentialFile *file) {
+    int checked = 0;
+    for (Block *block = file->head; block; block = block->next) {
+        int count = blockRecordCount(block);
+        for (int slot = 0; slot < count; slot++) {
+            Record *record = blockRecordAt(block, slot);
+            if (!(record->flags & RECORD_DELETED)) {
+                CHECK(blockMayHoldKey(block, record->id));
+                checked++;
+            }
+        }
+    }
+    return checked;
+}
+
+// Ids in [low, high] of the step-th ids that pass the block's filter
+static int passing(const Block *block, int low, int high, int step) {
+    int count = 0;
+    for (int id = low; id <= high; id += step) {
+        count += blockMayHoldKey(block, id);
+    }
+    return count;
+}
+
+// A block's filter passes its ids, and rules most others out, before and
+// after a split and a compaction
+static void testBlock(void) {
+    Block *block = createBlock(512);
+    Block *right = createBlock(512);
+    int count = 0;
+    for (int id = 0; ; id += 10) {
+        Record *record = createRecord(id, "filtered");
+        int offset = blockInsertRecord(block, count, record, 0);
+        freeRecord(record);
+        if (offset < 0) break;
+        count++;
+    }
+    CHECK(count > 10);
+    int last = (count - 1) * 10;
+    for (int id = 0; id <= last; id += 10) {
+        CHECK(blockMayHoldKey(block, id));
+    }
+    // Ids between the stored ones, within the block's key range
+    CHECK(passing(block, 5, last, 10) < count / 2);
+    CHECK(!blockMayHoldKey(block, -10) && !blockMayHoldKey(block, last + 10));
+
+    blockSplit(block, right, count / 2);
+    for (int id = 0; id <= last; id += 10) {
+        CHECK(blockMayHoldKey(id < count / 2 * 10 ? block : right, id));
+    }
+    // The left half drops the ids it gave away
+    CHECK(passing(block, count / 2 * 10, last, 10) < count / 4);
+
+    // Deleted ids leave the filter once the block is compacted
+    for (int slot = 0; slot < blockRecordCount(right); slot += 2) {
+        blockDeleteRecord(right, slot);
+    }
+    blockCompact(right);
+    int kept = blockRecordCount(right);
+    for (int slot = 0; slot < kept; slot++) {
+        CHECK(blockMayHoldKey(right, blockRecordAt(right, slot)->id));
+    }
+    CHECK(passing(right, count / 2 * 10, last, 20) < kept / 2 + 1);
+    freeBlock(block);
+    freeBlock(right);
+}
+
+// Even ids, inserted out of order into small blocks
+static SequentialFile *filledFile(int isContiguous, int isOrdered) {
+    SequentialFile *file = initializeFile(256, isContiguous, isOrdered, 0, 0);
+    for (int i = 0; i < RECORDS; i++) {
+        insertData(file, (int)((long)i * 7919 % RECORDS) * 2, "filtered");
+    }
+    return file;
+}
+
+// Odd ids were never stored; ids in `deleted` (may be NULL) were removed
+static void checkLookups(SequentialFile *file, const char *deleted) {
+    for (int id = 0; id < 2 * RECORDS; id++) {
+        Record *record = searchRecord(file, id);
+        if (id % 2 || (deleted && deleted[id / 2])) {
+            CHECK(record == NULL);
+        } else {
+            CHECK(record && record->id == id);
+        }
+    }
+}
+
+// Ids pass the filters of their blocks after the splits of ordered
+// inserts, after compaction and after a save and load, and lookups of
+// absent ids skip blocks on their filter and come back empty
+static void testFile(int isContiguous, int isOrdered) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_block_filter_%d.bin", (int)getpid());
+    static char deleted[RECORDS];
+    SequentialFile *file = filledFile(isContiguous, isOrdered);
+    FileStats stats;
+
+    CHECK(checkFilters(file) == RECORDS);
+    getFileStats(file, &stats);
+    CHECK(!isOrdered || !stats.countersEnabled || stats.counters.blockSplits > 0);
+    resetFileStats(file);
+    checkLookups(file, NULL);
+    getFileStats(file, &stats);
+    CHECK(!stats.countersEnabled || stats.counters.blocksSkipped > 0);
+
+    for (int i = 0; i < RECORDS; i++) {
+        deleted[i] = i % 3 == 0;
+        if (deleted[i]) {
+            CHECK(deleteRecord(file, i * 2));
+        }
+    }
+    reorganizeFile(file);
+    CHECK(checkFilters(file) == RECORDS - (RECORDS + 2) / 3);
+    checkLookups(file, deleted);
+
+    saveFileToDisk(file, path);
+    freeFile(file);
+    file = loadFileFromDisk(path);
+    CHECK(file != NULL);
+    if (file) {
+        CHECK(checkFilters(file) == RECORDS - (RECORDS + 2) / 3);
+        checkLookups(file, deleted);
+        freeFile(file);
+    }
+    deleteFileFromDisk(path);
+}
+
+int main(void) {
+    quietLibrary();
+    testBlock();
+    testFile(0, 0);
+    testFile(1, 0);
+    testFile(0, 1);
+    return checkResult("block_filter");
+}
@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "block_pool.h"
+#include "arena.h"
+
+// Blocks come out formatted, with aligned data, and freed ones are reused
+static void testBlocks(void) {
+    BlockPool *pool = createBlockPool(1000, 0);
+    Block *blocks[100];
+
+    for (int i = 0; i < 100; i++) {
+        blocks[i] = poolAllocBlock(pool);
+        CHECK(blocks[i]->blockSize == 1000);
+        CHECK(blockRecordCount(blocks[i]) == 0);
+        CHECK(blocks[i]->freeSpace == blockCapacity(blocks[i]));
+        CHECK((uintptr_t)blocks[i]->data % POOL_ALIGNMENT == 0);
+        memset(blocks[i]->data, i, 1000);
+    }
+    // Data of different blocks never overlaps
+    for (int i = 0; i < 100; i++) {
+        CHECK(blocks[i]->data[0] == (char)i && blocks[i]->data[999] == (char)i);
+    }
+
+    Block *freed = blocks[42];
+    char *data = freed->data;
+    poolFreeBlock(pool, freed);
+    Block *again = poolAllocBlock(pool);
+    CHECK(again == freed && again->data == data);
+    CHECK(blockRecordCount(again) == 0);
+
+    freeBlockPool(pool);
+}
+
+// Blocks around data held elsewhere give nothing back to the data slabs
+static void testWrappedBlocks(void) {
+    BlockPool *pool = createBlockPool(256, 0);
+    char *outside = (char *)malloc(256);
+    memset(outside, 0, 256);
+
+    Block *mapped = poolAllocMappedBlock(pool, outside);
+    CHECK(mapped->data == outside && (mapped->flags & BLOCK_MAPPED));
+    poolFreeBlock(pool, mapped);
+
+    Block *block = poolAllocBlock(pool);
+    CHECK(block->data != outside);
+
+    free(outside);
+    freeBlockPool(pool);
+}
+
+// Fixed-length pools hand their record stride to every block
+static void testRecordSpace(void) {
+    BlockPool *pool = createBlockPool(256, RECORD_SPACE(12));
+    Block *block = poolAllocBlock(pool);
+    CHECK(block->recordSpace == RECORD_SPACE(12));
+    freeBlockPool(pool);
+}
+
+// Allocations are aligned and disjoint, and a reset reuses the chunks
+static void testArena(void) {
+    Arena *arena = createArena();
+
+    char *first = (char *)arenaAlloc(arena, 3);
+    char *second = (char *)arenaAlloc(arena, 5);
+    CHECK((uintptr_t)first % 8 == 0 && (uintptr_t)second % 8 == 0);
+    CHECK(second >= first + 3);
+
+    // Larger than a chunk, then enough small ones to need another chunk
+    char *large = (char *)arenaAlloc(arena, ARENA_CHUNK_SIZE * 2);
+    memset(large, 'x', ARENA_CHUNK_SIZE * 2);
+    for (int i = 0; i < 2000; i++) {
+        memset(arenaAlloc(arena, 100), 'y', 100);
+    }
+    CHECK(large[ARENA_CHUNK_SIZE * 2 - 1] == 'x');
+
+    ArenaChunk *chunks = arena->chunks;
+    arenaReset(arena);
+    CHECK(arena->chunks == chunks && arena->current == chunks);
+    CHECK(arenaAlloc(arena, 3) == first);
+
+    freeArena(arena);
+}
+
+int main(void) {
+    testBlocks();
+    testWrappedBlocks();
+    testRecordSpace();
+    testArena();
+    return checkResult("block_pool");
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "block_table.h"
+
+#define BLOCK_SIZE 64
+#define BLOCKS 1000
+
+// Sanitizers reserve address space of their own and abort when they run
+// out of it, so they cannot run under a lowered RLIMIT_AS
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define CAN_LIMIT_ADDRESS_SPACE 0
+#else
+#define CAN_LIMIT_ADDRESS_SPACE 1
+#endif
+
+static Block blocks[BLOCKS];
+
+// A new block at position `pos` with its data filled with `byte`
+static void addBlock(BlockTable *table, int i, int pos, int byte) {
+    char *data = tableAllocData(table);
+    CHECK(data != NULL);
+    blockInit(&blocks[i], data, BLOCK_SIZE, BLOCK_TABLE);
+    memset(data, byte, BLOCK_SIZE);
+    tableInsert(table, pos, &blocks[i]);
+}
+
+// Whether block i still holds `byte` in a slot of the region
+static int holds(const BlockTable *table, int i, int byte) {
+    const char *data = blocks[i].data;
+    if (data < table->region || data >= table->region + (size_t)table->slotCapacity * BLOCK_SIZE ||
+        (data - table->region) % BLOCK_SIZE != 0) {
+        return 0;
+    }
+    for (int j = 0; j < BLOCK_SIZE; j++) {
+        if (data[j] != (char)byte) return 0;
+    }
+    return 1;
+}
+
+// The region doubles as blocks are added, and blocks keep their data and
+// follow the region wherever mremap moves it
+static void testGrowth(void) {
+    BlockTable *table = createBlockTable(BLOCK_SIZE);
+    int capacity = 0;
+    int growths = 0;
+
+    for (int i = 0; i < BLOCKS; i++) {
+        addBlock(table, i, i, i);
+        if (table->slotCapacity != capacity) {
+            CHECK(table->slotCapacity == (capacity ? capacity * 2 : TABLE_FIRST_SLOTS));
+            capacity = table->slotCapacity;
+            growths++;
+        }
+    }
+    CHECK(growths == 7 && table->slotCapacity == 1024);
+    CHECK(table->count == BLOCKS && table->slotCount == BLOCKS);
+    for (int i = 0; i < BLOCKS; i++) {
+        CHECK(holds(table, i, i));
+        CHECK(blocks[i].position == i);
+    }
+    CHECK(tableIsPacked(table));
+    freeBlockTable(table);
+}
+
+// A reservation grows the region once, up front, counting dropped slots,
+// and the blocks it was made for then never move it
+static void testReserve(void) {
+    BlockTable *table = createBlockTable(BLOCK_SIZE);
+
+    CHECK(tableReserve(table, 100));
+    CHECK(table->slotCapacity == 128 && table->slotCount == 0);
+    char *region = table->region;
+    for (int i = 0; i < 100; i++) {
+        addBlock(table, i, i, i);
+    }
+    CHECK(table->region == region && table->slotCapacity == 128);
+
+    // 28 unused slots and 10 dropped ones are room for 38 blocks
+    for (int i = 90; i < 100; i++) {
+        tableFreeData(table, blocks[i].data);
+        tableRemove(table, blocks[i].position);
+    }
+    CHECK(table->count == 90 && table->freeCount == 10);
+    CHECK(tableReserve(table, 38));
+    CHECK(table->slotCapacity == 128);
+    CHECK(tableReserve(table, 39));
+    CHECK(table->slotCapacity == 256);
+    for (int i = 0; i < 90; i++) {
+        CHECK(holds(table, i, i));
+    }
+    freeBlockTable(table);
+}
+
+// Dropped slots are reused before the region grows, positions follow
+// inserts and removals, and tablePack puts block i back in slot i
+static void testReuseAndPack(void) {
+    BlockTable *table = createBlockTable(BLOCK_SIZE);
+
+    // Each block goes in front, so the file order is the reverse of the slots
+    for (int i = 0; i < 20; i++) {
+        addBlock(table, i, 0, i);
+    }
+    CHECK(!tableIsPacked(table));
+    for (int pos = 0; pos < 20; pos++) {
+        CHECK(table->blocks[pos] == &blocks[19 - pos] && blocks[19 - pos].position == pos);
+    }
+
+    char *dropped = blocks[7].data;
+    tableFreeData(table, dropped);
+    tableRemove(table, blocks[7].position);
+    CHECK(table->count == 19);
+    for (int pos = 0; pos < 19; pos++) {
+        CHECK(table->blocks[pos]->position == pos);
+    }
+    addBlock(table, 7, 5, 77);
+    CHECK(blocks[7].data == dropped && blocks[7].position == 5);
+    CHECK(table->slotCount == 20);
+
+    tablePack(table);
+    CHECK(tableIsPacked(table));
+    for (int pos = 0; pos < 20; pos++) {
+        CHECK(table->blocks[pos]->data == table->region + (size_t)pos * BLOCK_SIZE);
+    }
+    for (int i = 0; i < 20; i++) {
+        CHECK(holds(table, i, i == 7 ? 77 : i));
+    }
+    freeBlockTable(table);
+}
+
+// Address space in use by the process, from /proc
+static size_t addressSpace(void) {
+    unsigned long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%lu", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+    return (size_t)pages * 4096;
+}
+
+// Once the region of a contiguous file cannot grow any further, inserts
+// fail cleanly and the records already in the file stay intact
+static void testRegionExhausted(void) {
+    if (!CAN_LIMIT_ADDRESS_SPACE) return;
+
+    enum { LARGE_BLOCK = 64 * 1024 };
+    SequentialFile *file = initializeFile(LARGE_BLOCK, 1, 0, 0, 0);
+    char *data = (char *)malloc(LARGE_BLOCK / 2);
+    memset(data, 'r', LARGE_BLOCK / 2 - 1);
+    data[LARGE_BLOCK / 2 - 1] = '\0';
+    Record *record = createRecord(0, data);
+    struct rlimit saved, limited;
+    size_t used = addressSpace();
+
+    CHECK(getrlimit(RLIMIT_AS, &saved) == 0 && used > 0);
+    limited = saved;
+    limited.rlim_cur = used + 48 * 1024 * 1024;
+    if (used == 0 || setrlimit(RLIMIT_AS, &limited) != 0) {
+        freeRecord(record);
+        free(data);
+        freeFile(file);
+        return;
+    }
+
+    // A block per record; stop at the first insert that fails
+    int inserted = 0;
+    for (int id = 0; id < 10000; id++) {
+        record->id = id;
+        insertRecord(file, record);
+        if (searchRecord(file, id) == NULL) {
+            break;
+        }
+        inserted++;
+    }
+    setrlimit(RLIMIT_AS, &saved);
+
+    CHECK(inserted > 0 && inserted < 10000);
+    CHECK(file->table->count == file->table->slotCount - file->table->freeCount);
+    for (int id = 0; id < inserted; id++) {
+        Record *found = searchRecord(file, id);
+        CHECK(found && found->size == LARGE_BLOCK / 2 && found->data[0] == 'r');
+    }
+    // With the limit lifted the file grows again
+    record->id = inserted;
+    insertRecord(file, record);
+    CHECK(searchRecord(file, inserted) != NULL);
+
+    freeRecord(record);
+    free(data);
+    freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testGrowth();
+    testReserve();
+    testReuseAndPack();
+    testRegionExhausted();
+    return checkResult("block_table");
+}
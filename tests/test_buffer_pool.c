@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "check.h"
+#include "buffer_pool.h"
+#include "sequential_file.h"
+#include "persistence.h"
+
+#define BLOCK_SIZE 256
+#define BLOCKS 20
+#define FRAMES 8
+
+static char path[64];
+static Block blocks[BLOCKS];
+
+// A file of BLOCKS slots, slot i filled with byte i, and a pool of
+// FRAMES frames over it whose blocks are all paged out
+static BufferPool *createPool(void) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    char image[BLOCK_SIZE];
+    for (int i = 0; i < BLOCKS; i++) {
+        memset(image, i, BLOCK_SIZE);
+        CHECK(write(fd, image, BLOCK_SIZE) == BLOCK_SIZE);
+        blockInit(&blocks[i], NULL, BLOCK_SIZE, BLOCK_PAGED);
+        blocks[i].diskBlock = i;
+    }
+    return createBufferPool(fd, path, BLOCK_SIZE, 0, FRAMES * BLOCK_SIZE);
+}
+
+static int holds(const Block *block, int byte) {
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (block->data[i] != (char)byte) return 0;
+    }
+    return 1;
+}
+
+static void touch(BufferPool *pool, int i) {
+    bufferPoolPin(pool, &blocks[i]);
+    CHECK(holds(&blocks[i], i));
+    bufferPoolUnpin(pool, &blocks[i]);
+}
+
+// Blocks are read in on their first pin and found in memory afterwards;
+// once the budget is used up, new blocks evict old ones
+static void testHitsAndMisses(void) {
+    BufferPool *pool = createPool();
+
+    for (int i = 0; i < FRAMES; i++) {
+        touch(pool, i);
+    }
+    CHECK(pool->misses == FRAMES && pool->hits == 0 && pool->frameCount == FRAMES);
+    touch(pool, 3);
+    CHECK(pool->hits == 1 && pool->misses == FRAMES);
+
+    for (int i = FRAMES; i < BLOCKS; i++) {
+        touch(pool, i);
+    }
+    CHECK(pool->frameCount == FRAMES);
+    CHECK(pool->evictions == BLOCKS - FRAMES);
+    CHECK(pool->writeBacks == 0);
+    int resident = 0;
+    for (int i = 0; i < BLOCKS; i++) {
+        resident += blocks[i].data != NULL;
+    }
+    CHECK(resident == FRAMES);
+
+    freeBufferPool(pool);
+}
+
+// The CLOCK hand passes over a block pinned since it last went by, once
+static void testSecondChance(void) {
+    BufferPool *pool = createPool();
+
+    for (int i = 0; i < FRAMES; i++) {
+        touch(pool, i);
+    }
+    // A full sweep clears every reference bit, then block 0 goes
+    touch(pool, FRAMES);
+    CHECK(blocks[0].data == NULL);
+
+    // Block 1 was used again, so block 2 goes instead
+    touch(pool, 1);
+    touch(pool, FRAMES + 1);
+    CHECK(blocks[1].data != NULL);
+    CHECK(blocks[2].data == NULL);
+
+    freeBufferPool(pool);
+}
+
+// Pinned blocks stay put; with every frame pinned the pool grows, and
+// returns to its budget once they are unpinned
+static void testPinned(void) {
+    BufferPool *pool = createPool();
+
+    for (int i = 0; i < FRAMES; i++) {
+        bufferPoolPin(pool, &blocks[i]);
+    }
+    bufferPoolPin(pool, &blocks[FRAMES]);
+    CHECK(pool->frameCount == FRAMES + 1);
+    CHECK(pool->evictions == 0);
+    for (int i = 0; i <= FRAMES; i++) {
+        CHECK(holds(&blocks[i], i));
+        bufferPoolUnpin(pool, &blocks[i]);
+    }
+    CHECK(pool->frameCount == FRAMES);
+
+    // Pins are counted: a block pinned twice needs two unpins
+    bufferPoolPin(pool, &blocks[0]);
+    bufferPoolPin(pool, &blocks[0]);
+    bufferPoolUnpin(pool, &blocks[0]);
+    size_t evictions = pool->evictions;
+    for (int i = 1; i < BLOCKS; i++) {
+        touch(pool, i);
+    }
+    CHECK(pool->frameCount == FRAMES && pool->evictions > evictions);
+    CHECK(holds(&blocks[0], 0));
+    bufferPoolUnpin(pool, &blocks[0]);
+
+    freeBufferPool(pool);
+}
+
+// A dirty block is evicted to the spill file, not the saved file, and
+// read back from there until a save makes it clean
+static void testDirtyEviction(void) {
+    BufferPool *pool = createPool();
+
+    bufferPoolPin(pool, &blocks[0]);
+    memset(blocks[0].data, 'd', BLOCK_SIZE);
+    blocks[0].flags |= BLOCK_DIRTY;
+    bufferPoolUnpin(pool, &blocks[0]);
+
+    for (int i = 1; i < BLOCKS; i++) {
+        touch(pool, i);
+    }
+    CHECK(blocks[0].data == NULL);
+    CHECK(pool->writeBacks == 1 && blocks[0].spillSlot >= 0);
+
+    char image[BLOCK_SIZE];
+    int fd = open(path, O_RDONLY);
+    CHECK(pread(fd, image, BLOCK_SIZE, 0) == BLOCK_SIZE && image[0] == 0);
+    close(fd);
+
+    bufferPoolPin(pool, &blocks[0]);
+    CHECK(holds(&blocks[0], 'd'));
+    bufferPoolUnpin(pool, &blocks[0]);
+
+    blocks[0].flags &= ~BLOCK_DIRTY;
+    bufferPoolSettle(pool, &blocks[0], -1);
+    CHECK(blocks[0].spillSlot == -1 && pool->spillFreeCount == 1);
+
+    freeBufferPool(pool);
+}
+
+// A paged file answers from a few frames, and its changes survive eviction
+// and a flush
+static void testPagedFile(void) {
+    SequentialFile *file = initializeFile(BLOCK_SIZE, 0, 0, 0, 0);
+    char data[32];
+    for (int id = 0; id < 2000; id++) {
+        snprintf(data, sizeof(data), "paged %d", id);
+        Record *record = createRecord(id, data);
+        insertRecord(file, record);
+        freeRecord(record);
+    }
+    saveFileToDisk(file, path);
+    freeFile(file);
+
+    file = openPagedFile(path, FRAMES * BLOCK_SIZE);
+    CHECK(file && file->buffers);
+    if (!file) return;
+    enableIndex(file);
+    for (int id = 0; id < 2000; id += 2) {
+        snprintf(data, sizeof(data), "changed %d", id);
+        CHECK(updateRecord(file, id, data));
+    }
+    for (int id = 0; id < 2000; id++) {
+        snprintf(data, sizeof(data), id % 2 ? "paged %d" : "changed %d", id);
+        char copy[32];
+        CHECK(copyRecord(file, id, copy, sizeof(copy)) > 0 && strcmp(copy, data) == 0);
+    }
+    CHECK(file->buffers->frameCount == FRAMES);
+    CHECK(file->buffers->evictions > 0 && file->buffers->writeBacks > 0);
+    CHECK(flushFileToDisk(file, path, 1));
+    freeFile(file);
+
+    file = loadFileFromDisk(path);
+    CHECK(file != NULL);
+    if (file) {
+        for (int id = 0; id < 2000; id++) {
+            snprintf(data, sizeof(data), id % 2 ? "paged %d" : "changed %d", id);
+            Record *record = searchRecord(file, id);
+            CHECK(record && strcmp(record->data, data) == 0);
+        }
+        freeFile(file);
+    }
+}
+
+int main(void) {
+    quietLibrary();
+    snprintf(path, sizeof(path), "/tmp/test_buffer_pool_%d.bin", (int)getpid());
+    testHitsAndMisses();
+    testSecondChance();
+    testPinned();
+    testDirtyEviction();
+    testPagedFile();
+    deleteFileFromDisk(path);
+    return checkResult("buffer_pool");
+}
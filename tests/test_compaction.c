@@ -0,0 +1,127 @@
+#include <string.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "cursor.h"
+
+static int countBlocks(const SequentialFile *file) {
+    int count = 0;
+    for (Block *block = file->head; block; block = block->next) {
+        count++;
+    }
+    return count;
+}
+
+// Fill a file, then delete all records but every `keep`th
+static SequentialFile *thinnedFile(int isOrdered, int isContiguous, int keep) {
+    SequentialFile *file = initializeFile(256, isContiguous, isOrdered, 0, 0);
+    enableIndex(file);
+    for (int id = 0; id < 400; id++) {
+        insertData(file, id, "compaction test data");
+    }
+    for (int id = 0; id < 400; id++) {
+        if (id % keep != 0) {
+            deleteRecord(file, id);
+        }
+    }
+    return file;
+}
+
+static void checkSurvivors(SequentialFile *file, int keep) {
+    for (int id = 0; id < 400; id++) {
+        Record *record = searchRecord(file, id);
+        if (id % keep == 0) {
+            CHECK(record && record->id == id && strcmp(record->data, "compaction test data") == 0);
+        } else {
+            CHECK(record == NULL);
+        }
+    }
+
+    // Nothing dead is left, and a scan sees every survivor once
+    int seen = 0;
+    Cursor cursor;
+    cursorOpen(&cursor, file);
+    for (Record *record; (record = cursorNext(&cursor)); ) {
+        CHECK(record->id % keep == 0);
+        seen++;
+    }
+    cursorClose(&cursor);
+    CHECK(seen == (400 + keep - 1) / keep);
+    for (Block *block = file->head; block; block = block->next) {
+        CHECK(block->deadSpace == 0);
+    }
+}
+
+// A pass advances a few blocks per call and finishes at the end of the file
+static void testIncremental(void) {
+    SequentialFile *file = thinnedFile(0, 0, 5);
+    int before = countBlocks(file);
+
+    int calls = 1;
+    while (!compactFile(file, 1)) {
+        calls++;
+    }
+    CHECK(calls > 1);
+    CHECK(countBlocks(file) < before);
+    checkSurvivors(file, 5);
+
+    // Finished passes start over
+    CHECK(file->compactCursor == NULL);
+    freeFile(file);
+}
+
+// Merged blocks keep ordered files in key order, and their directory and
+// index current
+static void testOrdered(void) {
+    SequentialFile *file = thinnedFile(1, 0, 3);
+    int before = countBlocks(file);
+    reorganizeFile(file);
+    CHECK(countBlocks(file) < before);
+    CHECK(file->directory->count == countBlocks(file));
+    checkSurvivors(file, 3);
+
+    int last = -1;
+    Cursor cursor;
+    cursorOpen(&cursor, file);
+    for (Record *record; (record = cursorNext(&cursor)); ) {
+        CHECK(record->id > last);
+        last = record->id;
+    }
+    cursorClose(&cursor);
+
+    disableIndex(file);
+    Record *record = binarySearchInFile(file, 300);
+    CHECK(record && record->id == 300);
+    CHECK(binarySearchInFile(file, 299) == NULL);
+    freeFile(file);
+}
+
+// Contiguous files drop freed slots from their table
+static void testContiguous(void) {
+    SequentialFile *file = thinnedFile(0, 1, 7);
+    reorganizeFile(file);
+    CHECK(file->table->count == countBlocks(file));
+    checkSurvivors(file, 7);
+    freeFile(file);
+}
+
+// Deleting everything leaves no blocks behind
+static void testEmpty(void) {
+    SequentialFile *file = thinnedFile(0, 0, 1000);
+    deleteRecord(file, 0);
+    reorganizeFile(file);
+    CHECK(file->head == NULL && file->tail == NULL);
+
+    insertData(file, 1, "after");
+    Record *record = searchRecord(file, 1);
+    CHECK(record && strcmp(record->data, "after") == 0);
+    freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testIncremental();
+    testOrdered();
+    testContiguous();
+    testEmpty();
+    return checkResult("compaction");
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "cursor.h"
+
+#define RECORDS 1000
+#define READERS 4
+#define ROUNDS 300
+
+// Whether the two blocks hold the same records at the same offsets; the
+// bytes of free space and of dropped records may differ
+static int blocksAlike(const Block *block, const Block *mirror) {
+    int count = blockRecordCount(block);
+    if (block->freeSpace != mirror->freeSpace || block->deadSpace != mirror->deadSpace ||
+        count != blockRecordCount(mirror)) {
+        return 0;
+    }
+    for (int slot = 0; slot < count; slot++) {
+        const Record *record = blockRecordAt(block, slot);
+        const Record *other = blockRecordAt(mirror, slot);
+        if (blockRecordOffset(block, slot) != blockRecordOffset(mirror, slot) || record->id != other->id ||
+            record->flags != other->flags || record->size != other->size || record->slack != other->slack ||
+            memcmp(record->data, other->data, record->size) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Whether both copies of a shared file hold the same blocks in the same order
+static int copiesAlike(SequentialFile *file) {
+    Block *block = file->head;
+    Block *mirror = file->shared->copies[1]->head;
+    for (; block && mirror; block = block->next, mirror = mirror->next) {
+        if (!blocksAlike(block, mirror)) {
+            return 0;
+        }
+    }
+    return block == NULL && mirror == NULL;
+}
+
+static SequentialFile *sharedFile(int isContiguous, int isOrdered) {
+    SequentialFile *file = initializeFile(256, isContiguous, isOrdered, 0, 0);
+    enableIndex(file);
+    for (int id = 0; id < RECORDS; id++) {
+        insertData(file, id, "initial");
+    }
+    enableConcurrency(file);
+    return file;
+}
+
+typedef struct {
+    SequentialFile *file;
+    int opened;     // Set once the cursor is open
+    int release;    // Set to have the cursor closed
+    int seen;       // Records the cursor returned
+} HeldCursor;
+
+static void *holdCursor(void *arg) {
+    HeldCursor *held = (HeldCursor *)arg;
+    Cursor cursor;
+    cursorOpen(&cursor, held->file);
+    __atomic_store_n(&held->opened, 1, __ATOMIC_SEQ_CST);
+    while (!__atomic_load_n(&held->release, __ATOMIC_SEQ_CST)) {
+        sched_yield();
+    }
+    while (cursorNext(&cursor)) {
+        held->seen++;
+    }
+    cursorClose(&cursor);
+    return NULL;
+}
+
+typedef struct {
+    SequentialFile *file;
+    int done;
+} Writer;
+
+static void *insertOne(void *arg) {
+    Writer *writer = (Writer *)arg;
+    insertData(writer->file, RECORDS, "inserted");
+    __atomic_store_n(&writer->done, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+// A write waits for a cursor open in another thread, but lookups do not
+// wait for the write: they see the new record while it is still waiting,
+// and the cursor goes on reading the file as it was when it opened
+static void testReadersDoNotWait(void) {
+    SequentialFile *file = sharedFile(0, 0);
+    CHECK(file->shared != NULL);
+    HeldCursor held = {file, 0, 0, 0};
+    Writer writer = {file, 0};
+    pthread_t cursorThread, writerThread;
+
+    pthread_create(&cursorThread, NULL, holdCursor, &held);
+    while (!__atomic_load_n(&held.opened, __ATOMIC_SEQ_CST)) {
+        sched_yield();
+    }
+    pthread_create(&writerThread, NULL, insertOne, &writer);
+
+    char data[32];
+    while (copyRecord(file, RECORDS, data, sizeof(data)) < 0) {
+        sched_yield();
+    }
+    CHECK(strcmp(data, "inserted") == 0);
+    CHECK(copyRecord(file, 7, data, sizeof(data)) > 0 && strcmp(data, "initial") == 0);
+    CHECK(!__atomic_load_n(&writer.done, __ATOMIC_SEQ_CST));
+
+    __atomic_store_n(&held.release, 1, __ATOMIC_SEQ_CST);
+    pthread_join(cursorThread, NULL);
+    pthread_join(writerThread, NULL);
+    CHECK(held.seen == RECORDS);
+    CHECK(writer.done);
+    CHECK(copiesAlike(file));
+    Record *record = searchRecord(file, RECORDS);
+    CHECK(record && strcmp(record->data, "inserted") == 0);
+    freeFile(file);
+}
+
+typedef struct {
+    SequentialFile *file;
+    int stop;
+    int missing;    // Lookups of ids always present that came back empty
+    int torn;       // Records read back with data no write ever stored
+} Reader;
+
+static void *readLoop(void *arg) {
+    Reader *reader = (Reader *)arg;
+    char data[32];
+    for (int id = 0; !__atomic_load_n(&reader->stop, __ATOMIC_SEQ_CST); id = (id + 7) % RECORDS) {
+        if (copyRecord(reader->file, id, data, sizeof(data)) < 0) {
+            reader->missing++;
+        } else if (strcmp(data, "initial") != 0 && strncmp(data, "round ", 6) != 0) {
+            reader->torn++;
+        }
+    }
+    return NULL;
+}
+
+// Readers on several threads keep finding every record whole while one
+// thread inserts, updates, deletes and compacts, and both copies end up
+// holding the same records in the same places
+static void testWritesUnderLoad(int isContiguous, int isOrdered) {
+    SequentialFile *file = sharedFile(isContiguous, isOrdered);
+    Reader readers[READERS];
+    pthread_t threads[READERS];
+    for (int i = 0; i < READERS; i++) {
+        readers[i] = (Reader){file, 0, 0, 0};
+        pthread_create(&threads[i], NULL, readLoop, &readers[i]);
+    }
+
+    char data[32];
+    for (int round = 0; round < ROUNDS; round++) {
+        snprintf(data, sizeof(data), "round %d", round);
+        insertData(file, RECORDS + round, data);
+        CHECK(updateRecord(file, round % RECORDS, data));
+        if (round % 3 == 0) {
+            CHECK(deleteRecord(file, RECORDS + round));
+        }
+        if (round % 50 == 49) {
+            compactFile(file, COMPACT_STEP_BLOCKS);
+        }
+    }
+    reorganizeFile(file);
+
+    for (int i = 0; i < READERS; i++) {
+        __atomic_store_n(&readers[i].stop, 1, __ATOMIC_SEQ_CST);
+        pthread_join(threads[i], NULL);
+        CHECK(readers[i].missing == 0 && readers[i].torn == 0);
+    }
+    CHECK(copiesAlike(file));
+    for (int round = 0; round < ROUNDS; round++) {
+        snprintf(data, sizeof(data), "round %d", round);
+        Record *record = searchRecord(file, RECORDS + round);
+        CHECK(round % 3 == 0 ? record == NULL : record && strcmp(record->data, data) == 0);
+    }
+    FileStats stats;
+    getFileStats(file, &stats);
+    CHECK(!stats.countersEnabled || statCount(&stats.counters, STAT_INSERT) == RECORDS + ROUNDS);
+    freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testReadersDoNotWait();
+    testWritesUnderLoad(0, 0);
+    testWritesUnderLoad(1, 0);
+    testWritesUnderLoad(0, 1);
+    return checkResult("concurrency");
+}
@@ -0,0 +1,143 @@
+#include <string.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "cursor.h"
+
+// Ids a cursor returns, in order, into `ids`; returns how many
+static int collect(Cursor *cursor, int *ids, int capacity) {
+    int count = 0;
+    for (Record *record; (record = cursorNext(cursor)); ) {
+        if (count < capacity) {
+            ids[count] = record->id;
+        }
+        count++;
+    }
+    cursorClose(cursor);
+    return count;
+}
+
+// Keys inserted out of order into an ordered file: 0, 3, 6, ... 297
+static SequentialFile *orderedFile(void) {
+    SequentialFile *file = initializeFile(256, 0, 1, 0, 0);
+    for (int i = 0; i < 100; i++) {
+        insertData(file, (i * 37 % 100) * 3, "ordered");
+    }
+    return file;
+}
+
+// A full scan returns every live record once, skipping deleted ones
+static void testFullScan(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    for (int id = 0; id < 200; id++) {
+        insertData(file, id, "unordered");
+    }
+    for (int id = 0; id < 200; id += 10) {
+        deleteRecord(file, id);
+    }
+
+    int ids[200];
+    Cursor cursor;
+    cursorOpen(&cursor, file);
+    int count = collect(&cursor, ids, 200);
+    CHECK(count == 180);
+    char seen[200] = {0};
+    for (int i = 0; i < count && i < 200; i++) {
+        CHECK(ids[i] % 10 != 0 && !seen[ids[i]]);
+        seen[ids[i]] = 1;
+    }
+    freeFile(file);
+}
+
+// Range bounds are inclusive, in key order for ordered files
+static void testOrderedRange(void) {
+    SequentialFile *file = orderedFile();
+    int ids[100];
+    Cursor cursor;
+
+    cursorOpenRange(&cursor, file, 30, 60);
+    int count = collect(&cursor, ids, 100);
+    CHECK(count == 11);
+    for (int i = 0; i < count && i < 100; i++) {
+        CHECK(ids[i] == 30 + 3 * i);
+    }
+
+    // Bounds between keys, and ranges outside the file
+    cursorOpenRange(&cursor, file, 31, 35);
+    CHECK(collect(&cursor, ids, 100) == 1 && ids[0] == 33);
+    cursorOpenRange(&cursor, file, 1000, 2000);
+    CHECK(collect(&cursor, ids, 100) == 0);
+    cursorOpenRange(&cursor, file, -50, -1);
+    CHECK(collect(&cursor, ids, 100) == 0);
+    cursorOpenRange(&cursor, file, 60, 30);
+    CHECK(collect(&cursor, ids, 100) == 0);
+
+    cursorOpen(&cursor, file);
+    count = collect(&cursor, ids, 100);
+    CHECK(count == 100);
+    for (int i = 1; i < count && i < 100; i++) {
+        CHECK(ids[i] > ids[i - 1]);
+    }
+    freeFile(file);
+}
+
+// Unordered files filter by key in file order
+static void testUnorderedRange(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    for (int id = 99; id >= 0; id--) {
+        insertData(file, id, "unordered");
+    }
+
+    int ids[100];
+    Cursor cursor;
+    cursorOpenRange(&cursor, file, 10, 19);
+    int count = collect(&cursor, ids, 100);
+    CHECK(count == 10);
+    for (int i = 0; i < count && i < 100; i++) {
+        CHECK(ids[i] == 19 - i);
+    }
+    freeFile(file);
+}
+
+// A record spanning blocks comes back whole
+static void testSpanned(void) {
+    SequentialFile *file = initializeFile(128, 0, 0, 0, 1);
+    char large[600];
+    memset(large, 'z', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+
+    insertData(file, 1, "before");
+    insertData(file, 2, large);
+    insertData(file, 3, "after");
+
+    Cursor cursor;
+    cursorOpen(&cursor, file);
+    Record *record = cursorNext(&cursor);
+    CHECK(record && record->id == 1);
+    record = cursorNext(&cursor);
+    CHECK(record && record->id == 2 && record->size == (int)sizeof(large) && strcmp(record->data, large) == 0);
+    record = cursorNext(&cursor);
+    CHECK(record && record->id == 3 && strcmp(record->data, "after") == 0);
+    CHECK(cursorNext(&cursor) == NULL);
+    cursorClose(&cursor);
+    freeFile(file);
+}
+
+// An empty file yields nothing
+static void testEmpty(void) {
+    SequentialFile *file = initializeFile(256, 1, 0, 0, 0);
+    Cursor cursor;
+    cursorOpen(&cursor, file);
+    CHECK(cursorNext(&cursor) == NULL);
+    cursorClose(&cursor);
+    freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testFullScan();
+    testOrderedRange();
+    testUnorderedRange();
+    testSpanned();
+    testEmpty();
+    return checkResult("cursor");
+}
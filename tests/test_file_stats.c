@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "persistence.h"
+#include "cursor.h"
+#include "parallel_scan.h"
+
+#define RECORDS 500
+
+static FileStats stats;
+
+static void takeStats(SequentialFile *file) {
+    getFileStats(file, &stats);
+}
+
+// Whether every counter is 0
+static int countersClear(const FileCounters *counters) {
+    static const FileCounters zero;
+    return memcmp(counters, &zero, sizeof(FileCounters)) == 0;
+}
+
+static int countAll(const Record *record, void *arg) {
+    (void)record;
+    (void)arg;
+    return 1;
+}
+
+static void ignore(const Record *record, void *arg) {
+    (void)record;
+    (void)arg;
+}
+
+// Latencies land in the bucket of their power of two, and percentiles
+// report the upper bound of the bucket they fall in
+static void testHistogram(void) {
+    FileCounters counters;
+    memset(&counters, 0, sizeof(counters));
+    CHECK(statPercentile(&counters, STAT_LOOKUP, 0.5) == 0);
+
+    statRecordLatency(&counters, STAT_LOOKUP, 0);
+    statRecordLatency(&counters, STAT_LOOKUP, 1);
+    statRecordLatency(&counters, STAT_LOOKUP, 1000);
+    statRecordLatency(&counters, STAT_LOOKUP, 1023);
+    statRecordLatency(&counters, STAT_LOOKUP, 1ull << 40);
+    CHECK(counters.latency[STAT_LOOKUP][0] == 1 && counters.latency[STAT_LOOKUP][1] == 1);
+    CHECK(counters.latency[STAT_LOOKUP][10] == 2);
+    CHECK(counters.latency[STAT_LOOKUP][STAT_BUCKETS - 1] == 1);
+    CHECK(statCount(&counters, STAT_LOOKUP) == 5 && statCount(&counters, STAT_INSERT) == 0);
+    CHECK(counters.totalNs[STAT_LOOKUP] == 2024 + (1ull << 40));
+
+    CHECK(statPercentile(&counters, STAT_LOOKUP, 0.0) == 1);
+    CHECK(statPercentile(&counters, STAT_LOOKUP, 0.5) == 1024);
+    CHECK(statPercentile(&counters, STAT_LOOKUP, 1.0) == 1ull << (STAT_BUCKETS - 1));
+
+    statClearCounters(&counters);
+    CHECK(countersClear(&counters));
+}
+
+// Each kind of operation is counted once per call
+static void testOperations(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_file_stats_%d.bin", (int)getpid());
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    takeStats(file);
+    int enabled = stats.countersEnabled;
+
+    for (int id = 0; id < RECORDS; id++) {
+        insertData(file, id, "counted");
+    }
+    RecordBatch batch;
+    initRecordBatch(&batch);
+    for (int id = RECORDS; id < RECORDS + 10; id++) {
+        recordBatchAdd(&batch, id, "batched");
+    }
+    CHECK(insertRecordsBatch(file, (const Record *)batch.data, batch.count) == 10);
+    freeRecordBatch(&batch);
+    char data[16];
+    for (int id = 0; id < 40; id++) {
+        CHECK(searchRecord(file, id) != NULL);
+        CHECK(copyRecord(file, id, data, sizeof(data)) > 0);
+    }
+    for (int id = 0; id < 30; id++) {
+        CHECK(updateRecord(file, id, "updated"));
+    }
+    for (int id = 0; id < 20; id++) {
+        CHECK(deleteRecord(file, id));
+    }
+    CHECK(parallelScan(file, 0, RECORDS - 1, countAll, ignore, NULL, 2) == RECORDS - 20);
+    compactFile(file, COMPACT_STEP_BLOCKS);
+    reorganizeFile(file);
+    saveFileToDisk(file, path);
+
+    takeStats(file);
+    const FileCounters *counters = &stats.counters;
+    if (enabled) {
+        CHECK(statCount(counters, STAT_INSERT) == RECORDS);
+        CHECK(statCount(counters, STAT_BATCH_INSERT) == 1);
+        CHECK(statCount(counters, STAT_LOOKUP) == 80);
+        CHECK(statCount(counters, STAT_UPDATE) == 30 && statCount(counters, STAT_DELETE) == 20);
+        CHECK(statCount(counters, STAT_SCAN) == 1 && statCount(counters, STAT_COMPACT) == 2);
+        CHECK(statCount(counters, STAT_SAVE) == 1 && statCount(counters, STAT_LOAD) == 0);
+        CHECK(statCount(counters, STAT_FLUSH) == 0);
+        CHECK(counters->totalNs[STAT_INSERT] > 0);
+        CHECK(statPercentile(counters, STAT_INSERT, 0.5) <= statPercentile(counters, STAT_INSERT, 0.99));
+        CHECK(counters->blocksAllocated >= (unsigned long long)stats.blocks);
+        CHECK(counters->blocksAllocated - counters->blocksFreed == (unsigned long long)stats.blocks);
+        CHECK(counters->allocations > 0);
+        struct stat info;
+        CHECK(stat(path, &info) == 0 && counters->bytesWritten == (unsigned long long)info.st_size);
+    } else {
+        CHECK(countersClear(counters));
+    }
+    freeFile(file);
+
+    // A loaded file starts counting afresh, from its load
+    file = loadFileFromDisk(path);
+    CHECK(file != NULL);
+    if (file) {
+        takeStats(file);
+        CHECK(!enabled || (statCount(&stats.counters, STAT_LOAD) == 1 && statCount(&stats.counters, STAT_INSERT) == 0 &&
+                           stats.counters.bytesRead > 0));
+        freeFile(file);
+    }
+    deleteFileFromDisk(path);
+}
+
+// Lookups count the blocks they walk and skip and the slots they examine;
+// cursors count the tombstones they pass over
+static void testWork(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    for (int id = 0; id < RECORDS; id++) {
+        insertData(file, id, "counted");
+    }
+    for (int id = 0; id < RECORDS; id += 10) {
+        CHECK(deleteRecord(file, id));
+    }
+    takeStats(file);
+    int blocks = stats.blocks;
+    int enabled = stats.countersEnabled;
+
+    // An absent id is looked for in every block, and most rule it out unread
+    resetFileStats(file);
+    CHECK(searchRecord(file, RECORDS * 2) == NULL);
+    takeStats(file);
+    CHECK(!enabled || (stats.counters.blocksWalked == (unsigned long long)blocks &&
+                       stats.counters.blocksSkipped == (unsigned long long)blocks &&
+                       stats.counters.recordsExamined == 0));
+
+    resetFileStats(file);
+    Cursor cursor;
+    int live = 0;
+    cursorOpen(&cursor, file);
+    while (cursorNext(&cursor)) {
+        live++;
+    }
+    cursorClose(&cursor);
+    takeStats(file);
+    CHECK(live == RECORDS - RECORDS / 10);
+    CHECK(!enabled || (stats.counters.blocksWalked == (unsigned long long)blocks &&
+                       stats.counters.recordsExamined == RECORDS &&
+                       stats.counters.tombstonesSkipped == RECORDS / 10));
+
+    // Through the index a lookup reads one record of one block
+    enableIndex(file);
+    resetFileStats(file);
+    CHECK(searchRecord(file, 7) != NULL);
+    takeStats(file);
+    CHECK(!enabled || (stats.counters.blocksWalked == 1 && stats.counters.recordsExamined == 1));
+    freeFile(file);
+}
+
+// Resetting zeroes the counters but not the gauges, and counting goes on
+// from there; the gauges follow deletes and compaction
+static void testResetAndGauges(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    for (int id = 0; id < RECORDS; id++) {
+        insertData(file, id, "counted");
+    }
+    takeStats(file);
+    FileStats before = stats;
+    CHECK(before.blocks > 1 && before.deadBytes == 0 && before.tombstoneRatio == 0.0);
+    CHECK(before.liveBytes + before.freeBytes == before.capacityBytes);
+    CHECK(before.fillFactor > 0.5 && before.fillFactor <= 1.0);
+
+    resetFileStats(file);
+    takeStats(file);
+    CHECK(countersClear(&stats.counters));
+    CHECK(stats.blocks == before.blocks && stats.liveBytes == before.liveBytes);
+    insertData(file, RECORDS, "counted");
+    takeStats(file);
+    CHECK(!stats.countersEnabled || statCount(&stats.counters, STAT_INSERT) == 1);
+
+    for (int id = 0; id < RECORDS; id += 2) {
+        CHECK(deleteRecord(file, id));
+    }
+    takeStats(file);
+    CHECK(stats.deadBytes > 0 && stats.tombstoneRatio > 0.3 && stats.tombstoneRatio < 0.7);
+    CHECK(stats.liveBytes + stats.deadBytes + stats.freeBytes == stats.capacityBytes);
+    reorganizeFile(file);
+    takeStats(file);
+    CHECK(stats.deadBytes == 0 && stats.tombstoneRatio == 0.0 && stats.blocks < before.blocks);
+    freeFile(file);
+}
+
+// A shared file counts each operation once, whichever copy ran it, and
+// resets the counts of both
+static void testShared(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    enableConcurrency(file);
+    for (int id = 0; id < 50; id++) {
+        insertData(file, id, "shared");
+    }
+    for (int id = 0; id < 20; id++) {
+        CHECK(searchRecord(file, id) != NULL);
+    }
+    takeStats(file);
+    CHECK(!stats.countersEnabled ||
+          (statCount(&stats.counters, STAT_INSERT) == 50 && statCount(&stats.counters, STAT_LOOKUP) == 20));
+    resetFileStats(file);
+    takeStats(file);
+    CHECK(countersClear(&stats.counters));
+    freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testHistogram();
+    testOperations();
+    testWork();
+    testResetAndGauges();
+    testShared();
+    return checkResult("file_stats");
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "persistence.h"
+
+// Blocks that cannot hold a single record are refused outright
+static void testTinyBlocks(void) {
+    CHECK(initializeFile(16, 0, 0, 0, 0) == NULL);
+    CHECK(initializeFile(16, 0, 0, 1, 0) == NULL);
+    CHECK(initializeFile(0, 0, 0, 0, 0) == NULL);
+}
+
+// Blocks too small for FIXED_RECORD_SIZE still give a usable file, with
+// shorter records, that survives a save and load
+static void testSmallBlocks(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_fixed_records_%d.bin", (int)getpid());
+
+    SequentialFile *file = initializeFile(64, 0, 0, 1, 0);
+    CHECK(file != NULL);
+    if (!file) return;
+    CHECK(file->recordSize > 0 && file->recordSize < FIXED_RECORD_SIZE);
+
+    char data[FIXED_RECORD_SIZE];
+    memset(data, 'k', file->recordSize - 1);
+    data[file->recordSize - 1] = '\0';
+    for (int id = 0; id < 20; id++) {
+        insertData(file, id, data);
+    }
+    Record *record = searchRecord(file, 7);
+    CHECK(record && strcmp(record->data, data) == 0);
+
+    saveFileToDisk(file, path);
+    int recordSize = file->recordSize;
+    freeFile(file);
+
+    file = loadFileFromDisk(path);
+    CHECK(file != NULL);
+    if (file) {
+        CHECK(file->recordSize == recordSize);
+        for (int id = 0; id < 20; id++) {
+            record = searchRecord(file, id);
+            CHECK(record && strcmp(record->data, data) == 0);
+        }
+        freeFile(file);
+    }
+    deleteFileFromDisk(path);
+}
+
+// The default block size keeps the default record size
+static void testDefaultSize(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 1, 0);
+    CHECK(file && file->recordSize == FIXED_RECORD_SIZE);
+    if (file) freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testTinyBlocks();
+    testSmallBlocks();
+    testDefaultSize();
+    return checkResult("fixed_records");
+}
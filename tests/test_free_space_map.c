@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "sequential_file.h"
+
+#define BLOCK_SIZE 256
+
+static void fillBlock(Block *block, int firstId) {
+    Record *record = createRecord(firstId, "filler data for a block");
+    while (blockInsertRecord(block, blockRecordCount(block), record, 0) >= 0) {
+        record->id++;
+    }
+    freeRecord(record);
+}
+
+static int countBlocks(const SequentialFile *file) {
+    int count = 0;
+    for (Block *block = file->head; block; block = block->next) {
+        count++;
+    }
+    return count;
+}
+
+// Every block sits in the bucket its reclaimable space calls for
+static void checkMapCurrent(const SequentialFile *file) {
+    for (Block *block = file->head; block; block = block->next) {
+        int bytes = block->freeSpace + block->deadSpace;
+        if (bytes < (1 << FSM_MIN_SHIFT)) {
+            CHECK(block->fsmBucket == -1);
+            continue;
+        }
+        int low = 1 << (block->fsmBucket + FSM_MIN_SHIFT);
+        CHECK(block->fsmBucket >= 0 && bytes >= low &&
+              (block->fsmBucket == FSM_BUCKETS - 1 || bytes < 2 * low));
+    }
+}
+
+// Blocks move between buckets as their free space changes
+static void testBuckets(void) {
+    FreeSpaceMap *map = createFreeSpaceMap();
+    Block *block = createBlock(BLOCK_SIZE);
+
+    fsmUpdate(map, block);
+    CHECK(fsmFind(map, 64) == block);
+    CHECK(fsmFind(map, BLOCK_SIZE) == NULL);
+
+    fillBlock(block, 0);
+    fsmUpdate(map, block);
+    CHECK(fsmFind(map, 64) == NULL);
+
+    // Deleted records count as reclaimable
+    blockDeleteRecord(block, 0);
+    blockDeleteRecord(block, 1);
+    fsmUpdate(map, block);
+    CHECK(fsmFind(map, 32) == block);
+
+    fsmRemove(map, block);
+    CHECK(fsmFind(map, 32) == NULL);
+
+    freeBlock(block);
+    freeFreeSpaceMap(map);
+}
+
+// A block that filled up without its bucket being updated must not be
+// handed out, even from a bucket above the one searched
+static void testStaleEntry(void) {
+    FreeSpaceMap *map = createFreeSpaceMap();
+    Block *roomy = createBlock(BLOCK_SIZE);
+    Block *stale = createBlock(BLOCK_SIZE);
+
+    fsmUpdate(map, roomy);
+    fsmUpdate(map, stale);
+    fillBlock(stale, 0);
+
+    CHECK(fsmFind(map, 48) == roomy);
+
+    fsmRemove(map, roomy);
+    CHECK(fsmFind(map, 48) == NULL);
+
+    freeBlock(roomy);
+    freeBlock(stale);
+    freeFreeSpaceMap(map);
+}
+
+// Space freed by deletes is reused before the file grows
+static void testFillDeleteReinsert(void) {
+    SequentialFile *file = initializeFile(BLOCK_SIZE, 0, 0, 0, 0);
+    enableIndex(file);
+
+    for (int id = 0; id < 200; id++) {
+        insertData(file, id, "twenty bytes of data");
+    }
+    int blocks = countBlocks(file);
+    for (int id = 0; id < 200; id += 2) {
+        CHECK(deleteRecord(file, id));
+    }
+    for (int id = 200; id < 300; id++) {
+        insertData(file, id, "twenty bytes of data");
+    }
+
+    CHECK(countBlocks(file) == blocks);
+    for (int id = 0; id < 300; id++) {
+        Record *record = searchRecord(file, id);
+        if (id < 200 && id % 2 == 0) {
+            CHECK(record == NULL);
+        } else {
+            CHECK(record && record->id == id && strcmp(record->data, "twenty bytes of data") == 0);
+        }
+    }
+    freeFile(file);
+}
+
+// Batches fill blocks past the tail; each of them is bucketed as it fills
+static void testBatchBuckets(void) {
+    SequentialFile *file = initializeFile(BLOCK_SIZE, 0, 0, 0, 0);
+    RecordBatch batch;
+    initRecordBatch(&batch);
+
+    insertData(file, 0, "lands in a fresh tail");
+    for (int id = 1; id < 100; id++) {
+        recordBatchAdd(&batch, id, id % 3 ? "short" : "a somewhat longer record");
+    }
+    CHECK(insertRecordsBatch(file, (const Record *)batch.data, batch.count) == 99);
+    checkMapCurrent(file);
+
+    for (int id = 0; id < 100; id += 4) {
+        CHECK(deleteRecord(file, id));
+    }
+    checkMapCurrent(file);
+
+    freeRecordBatch(&batch);
+    freeFile(file);
+}
+
+// A spanned record that starts in a new block leaves the tail it passed
+// over bucketed too. Some fill of the tail leaves too little room for a
+// first piece but enough to be tracked; try fills until one does.
+static void testSpannedBuckets(void) {
+    char data[BLOCK_SIZE * 2];
+    RecordBatch batch;
+    initRecordBatch(&batch);
+
+    for (int size = 8; size < 64; size++) {
+        for (int fill = 1; fill < 8; fill++) {
+            SequentialFile *file = initializeFile(BLOCK_SIZE, 0, 0, 0, 1);
+            insertData(file, 0, "lands in a fresh tail");
+
+            recordBatchClear(&batch);
+            memset(data, 'x', size);
+            data[size] = '\0';
+            for (int id = 1; id <= fill; id++) {
+                recordBatchAdd(&batch, id, data);
+            }
+            memset(data, 'y', sizeof(data) - 1);
+            data[sizeof(data) - 1] = '\0';
+            recordBatchAdd(&batch, fill + 1, data);
+
+            CHECK(insertRecordsBatch(file, (const Record *)batch.data, batch.count) == batch.count);
+            checkMapCurrent(file);
+            freeFile(file);
+        }
+    }
+    freeRecordBatch(&batch);
+}
+
+// Random inserts, batches, spanned records and deletes; every record has
+// to read back as last written
+static void testMixedWorkload(void) {
+    enum { IDS = 1500, ROUNDS = 300 };
+    char data[BLOCK_SIZE * 3 + 1];
+    int length[IDS];
+    char state[IDS];  // 0 absent, 1 stored, 2 staged in the batch
+
+    srand(23);
+    SequentialFile *file = initializeFile(BLOCK_SIZE, 0, 0, 0, 1);
+    enableIndex(file);
+    memset(state, 0, sizeof(state));
+
+    RecordBatch batch;
+    initRecordBatch(&batch);
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int n = rand() % 40; n > 0; n--) {
+            int id = rand() % IDS;
+            if (state[id] == 1) {
+                CHECK(deleteRecord(file, id));
+                state[id] = 0;
+                continue;
+            }
+            if (state[id] == 2) {
+                continue;
+            }
+
+            int size = 1 + rand() % (rand() % 5 ? BLOCK_SIZE / 2 : BLOCK_SIZE * 3);
+            memset(data, 'a' + id % 26, size);
+            data[size] = '\0';
+            length[id] = size;
+            if (rand() % 2) {
+                recordBatchAdd(&batch, id, data);
+                state[id] = 2;
+            } else {
+                insertData(file, id, data);
+                state[id] = 1;
+            }
+        }
+        insertRecordsBatch(file, (const Record *)batch.data, batch.count);
+        recordBatchClear(&batch);
+        for (int id = 0; id < IDS; id++) {
+            if (state[id] == 2) state[id] = 1;
+        }
+    }
+    freeRecordBatch(&batch);
+
+    for (int id = 0; id < IDS; id++) {
+        int size = copyRecord(file, id, data, sizeof(data));
+        if (state[id]) {
+            CHECK(size == length[id] + 1 && (int)strlen(data) == length[id] && data[0] == 'a' + id % 26);
+        } else {
+            CHECK(size < 0);
+        }
+    }
+    freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testBuckets();
+    testStaleEntry();
+    testFillDeleteReinsert();
+    testBatchBuckets();
+    testSpannedBuckets();
+    testMixedWorkload();
+    return checkResult("free_space_map");
+}
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "hash_index.h"
+
+#define TABLE_SIZE 16  // Buckets of a new index
+
+static Block dummy;  // Stands in for the blocks entries point at
+
+// Bucket `id` hashes to in a new index
+static int homeOf(int id) {
+    HashIndex *index = createHashIndex(0);
+    hashIndexPut(index, id, &dummy, 0);
+    int home = hashIndexGet(index, id) - index->entries;
+    freeHashIndex(index);
+    return home;
+}
+
+// The first `count` ids from `from` on that hash to bucket `home`
+static void idsAt(int home, int from, int *ids, int count) {
+    for (int id = from; count > 0; id++) {
+        if (homeOf(id) == home) {
+            *ids++ = id;
+            count--;
+        }
+    }
+}
+
+// Each of the `count` ids is found, with the offset it was put with, unless
+// it was removed
+static void checkFound(HashIndex *index, const int *ids, const char *removed, int count) {
+    for (int i = 0; i < count; i++) {
+        IndexEntry *entry = hashIndexGet(index, ids[i]);
+        if (removed[i]) {
+            CHECK(entry == NULL);
+        } else {
+            CHECK(entry && entry->block == &dummy && entry->offset == ids[i]);
+        }
+    }
+}
+
+// One probe cluster that wraps around the end of the table, with entries
+// of several homes interleaved: removing any entry, from its middle, its
+// start or past the wrap, leaves every other one reachable
+static void testWrappedCluster(void) {
+    enum { KEYS = 8 };
+    int last[4], before[2], first[2];
+    idsAt(TABLE_SIZE - 1, 0, last, 4);
+    idsAt(TABLE_SIZE - 2, 0, before, 2);
+    idsAt(0, 0, first, 2);
+    int ids[KEYS] = {last[0], last[1], last[2], before[0], before[1], first[0], last[3], first[1]};
+    int buckets[KEYS] = {15, 0, 1, 14, 2, 3, 4, 5};
+
+    // Removals starting at every entry, in several orders
+    for (int start = 0; start < KEYS; start++) {
+        for (int step = 1; step < KEYS; step += 2) {
+            HashIndex *index = createHashIndex(0);
+            for (int i = 0; i < KEYS; i++) {
+                hashIndexPut(index, ids[i], &dummy, ids[i]);
+            }
+            CHECK(index->capacity == TABLE_SIZE && index->count == KEYS);
+            for (int i = 0; i < KEYS; i++) {
+                CHECK(hashIndexGet(index, ids[i]) - index->entries == buckets[i]);
+            }
+
+            char removed[KEYS] = {0};
+            for (int n = 0, i = start; n < KEYS; n++, i = (i + step) % KEYS) {
+                CHECK(hashIndexRemove(index, ids[i]));
+                CHECK(!hashIndexRemove(index, ids[i]));
+                removed[i] = 1;
+                checkFound(index, ids, removed, KEYS);
+            }
+            CHECK(index->count == 0);
+            freeHashIndex(index);
+        }
+    }
+}
+
+// Random puts, replacements and removes through several growths agree with
+// a plain array
+static void testRandomized(void) {
+    enum { IDS = 4000 };
+    static int ids[IDS];
+    static char removed[IDS];
+    HashIndex *index = createHashIndex(0);
+
+    srand(2);
+    for (int i = 0; i < IDS; i++) {
+        ids[i] = i * 977;
+        removed[i] = 1;
+    }
+    for (int round = 0; round < 20 * IDS; round++) {
+        int i = rand() % IDS;
+        if (removed[i] || rand() % 2) {
+            hashIndexPut(index, ids[i], &dummy, ids[i]);
+            removed[i] = 0;
+        } else {
+            CHECK(hashIndexRemove(index, ids[i]));
+            removed[i] = 1;
+        }
+    }
+    int count = 0;
+    for (int i = 0; i < IDS; i++) {
+        count += !removed[i];
+    }
+    CHECK(index->count == count);
+    checkFound(index, ids, removed, IDS);
+    freeHashIndex(index);
+}
+
+// Data of the record the file returns for `id`, or NULL
+static const char *dataOf(SequentialFile *file, int id) {
+    Record *record = searchRecord(file, id);
+    return record ? record->data : NULL;
+}
+
+// An indexed file keeps the first record inserted with an id, in single
+// and batch inserts alike, and a delete leaves no copy behind
+static void testUniqueIds(int isOrdered) {
+    SequentialFile *file = initializeFile(256, 0, isOrdered, 0, 0);
+    enableIndex(file);
+
+    insertData(file, 5, "first");
+    insertData(file, 5, "second");
+    CHECK(dataOf(file, 5) && strcmp(dataOf(file, 5), "first") == 0);
+
+    RecordBatch batch;
+    initRecordBatch(&batch);
+    recordBatchAdd(&batch, 7, "batched");
+    recordBatchAdd(&batch, 5, "third");
+    recordBatchAdd(&batch, 6, "batched");
+    recordBatchAdd(&batch, 7, "again");
+    CHECK(insertRecordsBatch(file, (const Record *)batch.data, batch.count) == 2);
+    freeRecordBatch(&batch);
+
+    CHECK(dataOf(file, 5) && strcmp(dataOf(file, 5), "first") == 0);
+    CHECK(dataOf(file, 7) && strcmp(dataOf(file, 7), "batched") == 0);
+
+    // Indexed and unindexed lookups agree
+    disableIndex(file);
+    CHECK(dataOf(file, 5) && strcmp(dataOf(file, 5), "first") == 0);
+    CHECK(dataOf(file, 7) && strcmp(dataOf(file, 7), "batched") == 0);
+    CHECK(enableIndex(file));
+
+    CHECK(deleteRecord(file, 5));
+    CHECK(dataOf(file, 5) == NULL);
+    disableIndex(file);
+    CHECK(dataOf(file, 5) == NULL);
+    freeFile(file);
+}
+
+// A file that already holds an id twice cannot be indexed, and keeps
+// answering by scanning
+static void testIndexOverDuplicates(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    insertData(file, 1, "older");
+    insertData(file, 2, "other");
+    insertData(file, 1, "newer");
+
+    CHECK(!enableIndex(file));
+    CHECK(file->index == NULL);
+    CHECK(dataOf(file, 1) && strcmp(dataOf(file, 1), "older") == 0);
+    freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testWrappedCluster();
+    testRandomized();
+    testUniqueIds(0);
+    testUniqueIds(1);
+    testIndexOverDuplicates();
+    return checkResult("hash_index");
+}
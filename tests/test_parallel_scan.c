@@ -0,0 +1,113 @@
+#include <limits.h>
+#include <string.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "parallel_scan.h"
+
+#define RECORDS 20000
+
+typedef struct {
+    int count;
+    int last;       // Id of the previous match
+    int ordered;    // Cleared if a match came before the previous one
+    char seen[RECORDS];
+} Matches;
+
+static int isEven(const Record *record, void *arg) {
+    (void)arg;
+    return record->id % 2 == 0;
+}
+
+static int startsWithB(const Record *record, void *arg) {
+    (void)arg;
+    return record->data[0] == 'b';
+}
+
+static void collect(const Record *record, void *arg) {
+    Matches *matches = (Matches *)arg;
+    if (record->id < matches->last) {
+        matches->ordered = 0;
+    }
+    if (record->id >= 0 && record->id < RECORDS) {
+        CHECK(!matches->seen[record->id]);
+        matches->seen[record->id] = 1;
+    }
+    matches->last = record->id;
+    matches->count++;
+}
+
+static size_t scan(SequentialFile *file, int startKey, int endKey, RecordPredicate predicate,
+                   Matches *matches, int threads) {
+    memset(matches, 0, sizeof(Matches));
+    matches->last = INT_MIN;
+    matches->ordered = 1;
+    size_t found = parallelScan(file, startKey, endKey, predicate, collect, matches, threads);
+    CHECK(found == (size_t)matches->count);
+    return found;
+}
+
+// Enough blocks for several workers; ids inserted out of order
+static SequentialFile *filledFile(int isContiguous, int isOrdered) {
+    SequentialFile *file = initializeFile(256, isContiguous, isOrdered, 0, 0);
+    for (int i = 0; i < RECORDS; i++) {
+        insertData(file, (int)((long)i * 7919 % RECORDS), i % 3 ? "alpha" : "bravo");
+    }
+    return file;
+}
+
+// Any number of workers finds the same matches, each once
+static void testThreads(int isContiguous) {
+    SequentialFile *file = filledFile(isContiguous, 0);
+    Matches matches;
+
+    CHECK(scan(file, INT_MIN, INT_MAX, NULL, &matches, 1) == RECORDS);
+    CHECK(scan(file, INT_MIN, INT_MAX, NULL, &matches, 8) == RECORDS);
+    CHECK(scan(file, INT_MIN, INT_MAX, isEven, &matches, 8) == RECORDS / 2);
+    CHECK(scan(file, 100, 199, NULL, &matches, 8) == 100);
+    CHECK(scan(file, 100, 199, isEven, &matches, 0) == 50);
+    CHECK(scan(file, INT_MIN, INT_MAX, startsWithB, &matches, 4) == (RECORDS + 2) / 3);
+    freeFile(file);
+}
+
+// Matches of ordered files reach the callback in key order
+static void testOrdered(void) {
+    SequentialFile *file = filledFile(0, 1);
+    Matches matches;
+
+    CHECK(scan(file, INT_MIN, INT_MAX, NULL, &matches, 8) == RECORDS);
+    CHECK(matches.ordered);
+    CHECK(scan(file, 5000, 5999, isEven, &matches, 8) == 500);
+    CHECK(matches.ordered);
+    freeFile(file);
+}
+
+// Deleted records never match
+static void testDeleted(void) {
+    SequentialFile *file = filledFile(0, 0);
+    Matches matches;
+    for (int id = 0; id < RECORDS; id += 4) {
+        deleteRecord(file, id);
+    }
+    CHECK(scan(file, INT_MIN, INT_MAX, isEven, &matches, 8) == RECORDS / 4);
+    freeFile(file);
+}
+
+// Empty files, including a contiguous one without a block array yet
+static void testEmpty(void) {
+    Matches matches;
+    for (int isContiguous = 0; isContiguous <= 1; isContiguous++) {
+        SequentialFile *file = initializeFile(256, isContiguous, 0, 0, 0);
+        CHECK(scan(file, INT_MIN, INT_MAX, NULL, &matches, 4) == 0);
+        freeFile(file);
+    }
+}
+
+int main(void) {
+    quietLibrary();
+    testThreads(0);
+    testThreads(1);
+    testOrdered();
+    testDeleted();
+    testEmpty();
+    return checkResult("parallel_scan");
+}
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "payload_index.h"
+
+#define RECORDS 300
+
+// What the file should hold: the data of every id, "" once deleted
+static char model[RECORDS][32];
+
+static void setData(SequentialFile *file, int id, const char *data, int isNew) {
+    if (isNew) {
+        insertData(file, id, data);
+    } else {
+        CHECK(updateRecord(file, id, data));
+    }
+    snprintf(model[id], sizeof(model[id]), "%s", data);
+}
+
+// Orders the model's ids by data, then id, as prefix searches return them
+static int compareModel(const void *a, const void *b) {
+    int left = *(const int *)a, right = *(const int *)b;
+    int order = strcmp(model[left], model[right]);
+    return order ? order : (left > right) - (left < right);
+}
+
+// The results are exactly the live ids of the model whose data starts
+// with `prefix` (the whole data when `exact`), and, unless `exact`, in
+// data order, then id order
+static void checkResults(RecordBatch *results, size_t found, const char *prefix, int exact) {
+    int expected[RECORDS];
+    int count = 0;
+    for (int id = 0; id < RECORDS; id++) {
+        if (model[id][0] && (exact ? strcmp(model[id], prefix) == 0 : strncmp(model[id], prefix, strlen(prefix)) == 0)) {
+            expected[count++] = id;
+        }
+    }
+    qsort(expected, count, sizeof(int), compareModel);
+
+    CHECK(found == (size_t)count && results->count == (size_t)count);
+    if (found != (size_t)count) return;
+
+    int ids[RECORDS];
+    const Record *record = (const Record *)results->data;
+    for (int i = 0; i < count; i++, record = NEXT_RECORD(record)) {
+        CHECK(record->id >= 0 && record->id < RECORDS && strcmp(record->data, model[record->id]) == 0);
+        ids[i] = record->id;
+    }
+    // Exact matches come in no particular order
+    if (exact) {
+        qsort(ids, count, sizeof(int), compareModel);
+    }
+    CHECK(memcmp(ids, expected, count * sizeof(int)) == 0);
+}
+
+// Every exact and prefix search the model can tell apart agrees with it
+static void checkSearches(SequentialFile *file) {
+    static const char *prefixes[] = {"", "a", "al", "alpha", "alpha-1", "b", "bravo-0", "c", "charlie-", "z"};
+    RecordBatch results;
+    initRecordBatch(&results);
+
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        recordBatchClear(&results);
+        size_t found = searchRecordsByPayloadPrefix(file, prefixes[i], &results);
+        checkResults(&results, found, prefixes[i], 0);
+    }
+    for (int id = 0; id < RECORDS; id += 7) {
+        if (!model[id][0]) continue;
+        recordBatchClear(&results);
+        size_t found = searchRecordsByPayload(file, model[id], &results);
+        checkResults(&results, found, model[id], 1);
+    }
+    recordBatchClear(&results);
+    CHECK(searchRecordsByPayload(file, "absent", &results) == 0 && results.count == 0);
+    freeRecordBatch(&results);
+}
+
+static const char *names[] = {"alpha", "bravo", "charlie"};
+
+// Exact and prefix lookups follow inserts, updates, deletes and a
+// reorganization, and agree with the file scanned without the index
+static void testChanges(int isOrdered) {
+    SequentialFile *file = initializeFile(256, 0, isOrdered, 0, 0);
+    memset(model, 0, sizeof(model));
+    enablePayloadIndex(file);
+    char data[32];
+
+    // Several ids share each data
+    for (int id = RECORDS - 1; id >= 0; id--) {
+        snprintf(data, sizeof(data), "%s-%d", names[id % 3], id % 20);
+        setData(file, id, data, 1);
+    }
+    checkSearches(file);
+
+    for (int id = 0; id < RECORDS; id += 4) {
+        snprintf(data, sizeof(data), "%s-%d-updated", names[(id + 1) % 3], id % 10);
+        setData(file, id, data, 0);
+    }
+    checkSearches(file);
+
+    for (int id = 0; id < RECORDS; id += 5) {
+        CHECK(deleteRecord(file, id));
+        model[id][0] = '\0';
+    }
+    checkSearches(file);
+
+    reorganizeFile(file);
+    checkSearches(file);
+
+    // A search without the index scans, in file order; the same ids come back
+    RecordBatch indexed, scanned;
+    initRecordBatch(&indexed);
+    initRecordBatch(&scanned);
+    searchRecordsByPayloadPrefix(file, "bravo", &indexed);
+    disablePayloadIndex(file);
+    searchRecordsByPayloadPrefix(file, "bravo", &scanned);
+    CHECK(indexed.count == scanned.count && indexed.used == scanned.used);
+    enablePayloadIndex(file);
+    checkSearches(file);
+    freeRecordBatch(&indexed);
+    freeRecordBatch(&scanned);
+    freeFile(file);
+}
+
+// Entries added after a prefix search wait to be merged by the next one,
+// which also drops entries removed in between, and removed entries' slots
+// are reused once merged
+static void testPendingMerge(void) {
+    PayloadIndex *index = createPayloadIndex();
+    RecordBatch results;
+    initRecordBatch(&results);
+
+    payloadIndexAdd(index, 1, "kilo");
+    payloadIndexAdd(index, 2, "kiwi");
+    payloadIndexAdd(index, 3, "lima");
+    CHECK(payloadIndexFindPrefix(index, "ki", &results) == 2);
+    CHECK(index->pendingCount == 0 && index->sortedCount == 3);
+
+    payloadIndexAdd(index, 4, "kite");
+    payloadIndexAdd(index, 5, "kayak");
+    CHECK(payloadIndexRemove(index, 1, "kilo"));
+    CHECK(!payloadIndexRemove(index, 1, "kilo"));
+    CHECK(index->pendingCount == 2);
+
+    // Exact lookups do not wait for the merge
+    recordBatchClear(&results);
+    CHECK(payloadIndexFind(index, "kite", &results) == 1);
+    recordBatchClear(&results);
+    CHECK(payloadIndexFind(index, "kilo", &results) == 0);
+
+    recordBatchClear(&results);
+    CHECK(payloadIndexFindPrefix(index, "ki", &results) == 2);
+    CHECK(index->pendingCount == 0 && index->retiredCount == 0);
+    const Record *record = (const Record *)results.data;
+    CHECK(record->id == 4 && strcmp(record->data, "kite") == 0);
+    record = NEXT_RECORD(record);
+    CHECK(record->id == 2 && strcmp(record->data, "kiwi") == 0);
+
+    int entries = index->entryCount;
+    payloadIndexAdd(index, 6, "kilt");
+    CHECK(index->entryCount == entries);
+    recordBatchClear(&results);
+    CHECK(payloadIndexFindPrefix(index, "k", &results) == 4);
+
+    freeRecordBatch(&results);
+    freePayloadIndex(index);
+}
+
+// A run of inserts between two prefix searches of a file shows up in the
+// second one, in data order among the older records
+static void testInsertsBetweenSearches(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    memset(model, 0, sizeof(model));
+    enablePayloadIndex(file);
+    char data[32];
+
+    for (int id = 0; id < RECORDS / 2; id++) {
+        snprintf(data, sizeof(data), "charlie-%03d", (id * 37) % 100);
+        setData(file, id, data, 1);
+    }
+    checkSearches(file);
+    for (int id = RECORDS / 2; id < RECORDS; id++) {
+        snprintf(data, sizeof(data), "charlie-%03d", (id * 53) % 100);
+        setData(file, id, data, 1);
+    }
+    CHECK(file->payloadIndex->pendingCount == RECORDS / 2);
+    checkSearches(file);
+    freeFile(file);
+}
+
+// Records spanning blocks are indexed with all of their data
+static void testSpanned(void) {
+    SequentialFile *file = initializeFile(128, 0, 0, 0, 1);
+    enablePayloadIndex(file);
+    char large[400];
+    memset(large, 'x', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+    insertData(file, 1, large);
+    insertData(file, 2, "xylophone");
+
+    RecordBatch results;
+    initRecordBatch(&results);
+    CHECK(searchRecordsByPayload(file, large, &results) == 1);
+    recordBatchClear(&results);
+    CHECK(searchRecordsByPayloadPrefix(file, "xx", &results) == 1);
+    CHECK(results.count == 1 && strcmp(((const Record *)results.data)->data, large) == 0);
+
+    // A rebuild joins the pieces the same way
+    disablePayloadIndex(file);
+    enablePayloadIndex(file);
+    recordBatchClear(&results);
+    CHECK(searchRecordsByPayloadPrefix(file, "x", &results) == 2);
+    freeRecordBatch(&results);
+    freeFile(file);
+}
+
+int main(void) {
+    quietLibrary();
+    testChanges(0);
+    testChanges(1);
+    testPendingMerge();
+    testInsertsBetweenSearches();
+    testSpanned();
+    return checkResult("payload_index");
+}
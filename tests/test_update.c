@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "persistence.h"
+#include "cursor.h"
+
+// The block holding the live record `id`, its slot through `slotOut`
+static Block *blockOf(SequentialFile *file, int id, int *slotOut) {
+    for (Block *block = file->head; block; block = block->next) {
+        int count = blockRecordCount(block);
+        for (int slot = 0; slot < count; slot++) {
+            Record *record = blockRecordAt(block, slot);
+            if (record->id == id && !(record->flags & (RECORD_DELETED | RECORD_CONTINUATION))) {
+                if (slotOut) *slotOut = slot;
+                return block;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int holds(SequentialFile *file, int id, const char *data) {
+    char copy[1024];
+    return copyRecord(file, id, copy, sizeof(copy)) == (int)strlen(data) + 1 && strcmp(copy, data) == 0;
+}
+
+// Updates that moved their record so far, -1 with the counters compiled out
+static long long relocations(SequentialFile *file) {
+    FileStats stats;
+    getFileStats(file, &stats);
+    return stats.countersEnabled ? (long long)stats.counters.recordsRelocated : -1;
+}
+
+// Slack reserved after a record takes growth in place; shrinking gives
+// bytes back to it, and growth past it moves the record within its block
+static void testSlack(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    CHECK(setUpdateSlack(file, 14));
+    CHECK(file->updateSlack == 16);
+    CHECK(!setUpdateSlack(file, -1) && !setUpdateSlack(file, RECORD_MAX_SLACK + 1));
+    insertData(file, 1, "abc");
+    insertData(file, 2, "neighbour");
+
+    int slot;
+    Block *block = blockOf(file, 1, &slot);
+    Record *record = blockRecordAt(block, slot);
+    int offset = blockRecordOffset(block, slot);
+    int freeSpace = block->freeSpace;
+    CHECK(record->slack == 16);
+
+    // 4 bytes of data grow to 20 within the slack
+    CHECK(updateRecord(file, 1, "abcdefghijklmnopqrs"));
+    CHECK(blockOf(file, 1, &slot) == block && blockRecordOffset(block, slot) == offset);
+    CHECK(record->slack == 0 && block->deadSpace == 0 && block->freeSpace == freeSpace);
+    CHECK(holds(file, 1, "abcdefghijklmnopqrs"));
+
+    CHECK(updateRecord(file, 1, "ab"));
+    CHECK(blockRecordOffset(block, slot) == offset && record->slack == 16);
+    CHECK(holds(file, 1, "ab"));
+
+    // Past the slack the record gets a new copy at the end of the block
+    CHECK(updateRecord(file, 1, "abcdefghijklmnopqrstuvwxyz"));
+    CHECK(blockOf(file, 1, &slot) == block && blockRecordOffset(block, slot) != offset);
+    CHECK(block->deadSpace > 0);
+    CHECK(holds(file, 1, "abcdefghijklmnopqrstuvwxyz") && holds(file, 2, "neighbour"));
+    CHECK(relocations(file) <= 0);
+    freeFile(file);
+}
+
+// Slack is cut to the room the block has left, and fixed-length records
+// take none
+static void testSlackNeedsRoom(void) {
+    SequentialFile *file = initializeFile(128, 0, 0, 0, 0);
+    setUpdateSlack(file, 64);
+    char data[64];
+    memset(data, 'f', sizeof(data));
+    // 40 bytes of data leave less than 64 behind in a 128-byte block
+    data[39] = '\0';
+    insertData(file, 1, data);
+    int slot;
+    Block *block = blockOf(file, 1, &slot);
+    CHECK(block && blockRecordAt(block, slot)->slack < 64 && block->freeSpace < 4);
+    freeFile(file);
+
+    file = initializeFile(256, 0, 0, 1, 0);
+    setUpdateSlack(file, 16);
+    insertData(file, 1, "fixed");
+    block = blockOf(file, 1, &slot);
+    CHECK(block && blockRecordAt(block, slot)->slack == 0);
+    freeFile(file);
+}
+
+// Full blocks of short records numbered from 0, `count` of them
+static SequentialFile *fullFile(int isOrdered, int count) {
+    SequentialFile *file = initializeFile(256, 0, isOrdered, 0, 0);
+    enableIndex(file);
+    char data[32];
+    for (int id = 0; id < count; id++) {
+        snprintf(data, sizeof(data), "short %d", id);
+        insertData(file, id, data);
+    }
+    return file;
+}
+
+// An update that no longer fits its full block moves the record elsewhere,
+// and lookups, the index and, for ordered files, key order follow it
+static void testRelocation(int isOrdered) {
+    SequentialFile *file = fullFile(isOrdered, 200);
+    char large[160];
+    memset(large, 'L', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+
+    Block *before = blockOf(file, 50, NULL);
+    CHECK(before && before->freeSpace < (int)sizeof(large));
+    long long moved = relocations(file);
+    CHECK(updateRecord(file, 50, large));
+    CHECK(blockOf(file, 50, NULL) != before);
+    CHECK(holds(file, 50, large));
+    CHECK(moved < 0 || relocations(file) == moved + 1);
+
+    char data[32];
+    for (int id = 0; id < 200; id++) {
+        snprintf(data, sizeof(data), "short %d", id);
+        CHECK(id == 50 || holds(file, id, data));
+    }
+    disableIndex(file);
+    CHECK(holds(file, 50, large));
+
+    if (isOrdered) {
+        Record *record = binarySearchInFile(file, 50);
+        CHECK(record && strcmp(record->data, large) == 0);
+        Cursor cursor;
+        int last = -1, count = 0;
+        cursorOpen(&cursor, file);
+        for (Record *next; (next = cursorNext(&cursor)); count++) {
+            CHECK(next->id > last);
+            last = next->id;
+        }
+        cursorClose(&cursor);
+        CHECK(count == 200);
+    }
+    freeFile(file);
+}
+
+// A block with dead space is compacted to make room before the record is
+// moved out of it
+static void testCompactBeforeMove(void) {
+    SequentialFile *file = fullFile(0, 200);
+    Block *block = blockOf(file, 50, NULL);
+    int count = blockRecordCount(block);
+    int first = blockRecordAt(block, 0)->id;
+
+    // Delete every other record of the block but 50
+    for (int slot = 0; slot < count; slot++) {
+        int id = first + slot;
+        if (id != 50 && slot % 2 == 0) {
+            CHECK(deleteRecord(file, id));
+        }
+    }
+    int dead = block->deadSpace;
+    CHECK(dead > 0);
+    long long moved = relocations(file);
+    char data[64];
+    memset(data, 'c', block->freeSpace + 8);
+    data[block->freeSpace + 8] = '\0';
+    CHECK(updateRecord(file, 50, data));
+    // Only the copy the update left behind is dead now
+    CHECK(blockOf(file, 50, NULL) == block && block->deadSpace < dead);
+    CHECK(relocations(file) == moved);
+    CHECK(holds(file, 50, data));
+    freeFile(file);
+}
+
+// With overlap allowed, a record grows into pieces across blocks and
+// shrinks back into one
+static void testSpanning(void) {
+    SequentialFile *file = initializeFile(128, 0, 0, 0, 1);
+    insertData(file, 1, "small");
+    insertData(file, 2, "other");
+    char large[600];
+    memset(large, 's', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+
+    CHECK(updateRecord(file, 1, large));
+    int slot;
+    Block *block = blockOf(file, 1, &slot);
+    CHECK(block && (blockRecordAt(block, slot)->flags & RECORD_CONTINUED));
+    CHECK(holds(file, 1, large) && holds(file, 2, "other"));
+
+    CHECK(updateRecord(file, 1, "small again"));
+    block = blockOf(file, 1, &slot);
+    CHECK(block && !(blockRecordAt(block, slot)->flags & RECORD_CONTINUED));
+    CHECK(holds(file, 1, "small again") && holds(file, 2, "other"));
+    freeFile(file);
+}
+
+// The slack setting is saved with the file, and records keep their slack
+static void testSlackSaved(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_update_%d.bin", (int)getpid());
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    setUpdateSlack(file, 24);
+    insertData(file, 1, "kept");
+    saveFileToDisk(file, path);
+    freeFile(file);
+
+    file = loadFileFromDisk(path);
+    CHECK(file != NULL);
+    if (file) {
+        CHECK(file->updateSlack == 24);
+        int slot;
+        Block *block = blockOf(file, 1, &slot);
+        CHECK(block && blockRecordAt(block, slot)->slack == 24);
+        CHECK(updateRecord(file, 1, "kept and grown"));
+        CHECK(blockOf(file, 1, NULL) == block && block->deadSpace == 0);
+        freeFile(file);
+    }
+    deleteFileFromDisk(path);
+}
+
+int main(void) {
+    quietLibrary();
+    testSlack();
+    testSlackNeedsRoom();
+    testRelocation(0);
+    testRelocation(1);
+    testCompactBeforeMove();
+    testSpanning();
+    testSlackSaved();
+    return checkResult("update");
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "sequential_file.h"
+#include "persistence.h"
+
+static char path[64];
+static char logPath[80];
+
+static int countRecords(WriteAheadLog *log) {
+    size_t size;
+    char *contents = walRead(log, &size);
+    size_t pos = sizeof(WalHeader);
+    int count = 0;
+    while (walNext(log, contents, size, &pos)) {
+        count++;
+    }
+    free(contents);
+    return count;
+}
+
+// Records come back in order with their payloads, also after a reopen
+static void testRecords(void) {
+    WriteAheadLog *log = walOpen(logPath);
+    CHECK(log != NULL);
+    CHECK(walReset(log, 7));
+    walAppend(log, WAL_INSERT, 1, "alpha", 6);
+    walAppend(log, WAL_UPDATE, 1, "bravo!", 7);
+    walAppend(log, WAL_DELETE, 1, NULL, 0);
+    CHECK(walCommit(log));
+    walClose(log);
+
+    log = walOpen(logPath);
+    CHECK(log->generation == 7);
+    size_t size;
+    char *contents = walRead(log, &size);
+    size_t pos = sizeof(WalHeader);
+    const WalRecord *record = walNext(log, contents, size, &pos);
+    CHECK(record && record->type == WAL_INSERT && record->id == 1 && strcmp((const char *)(record + 1), "alpha") == 0);
+    record = walNext(log, contents, size, &pos);
+    CHECK(record && record->type == WAL_UPDATE && strcmp((const char *)(record + 1), "bravo!") == 0);
+    record = walNext(log, contents, size, &pos);
+    CHECK(record && record->type == WAL_DELETE && record->size == 0);
+    CHECK(walNext(log, contents, size, &pos) == NULL);
+    free(contents);
+
+    // Records checksummed for another generation do not apply
+    log->generation = 8;
+    CHECK(countRecords(log) == 0);
+    walClose(log);
+    unlink(logPath);
+}
+
+// A record torn by a crash ends the log, and truncating drops it
+static void testTornTail(void) {
+    WriteAheadLog *log = walOpen(logPath);
+    walReset(log, 1);
+    walAppend(log, WAL_INSERT, 1, "first", 6);
+    walAppend(log, WAL_INSERT, 2, "second", 7);
+    walCommit(log);
+    off_t end = log->end;
+    walClose(log);
+    CHECK(truncate(logPath, end - 3) == 0);
+
+    log = walOpen(logPath);
+    CHECK(countRecords(log) == 1);
+    walAppend(log, WAL_INSERT, 3, "third", 6);
+    walCommit(log);
+    CHECK(countRecords(log) == 1);
+
+    size_t size;
+    char *contents = walRead(log, &size);
+    size_t pos = sizeof(WalHeader);
+    walNext(log, contents, size, &pos);
+    free(contents);
+    CHECK(walTruncate(log, pos));
+    walAppend(log, WAL_INSERT, 3, "third", 6);
+    walCommit(log);
+    CHECK(countRecords(log) == 2);
+    walClose(log);
+    unlink(logPath);
+}
+
+// Committed changes not yet flushed are replayed when the file is opened
+static void testReplay(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    enableIndex(file);
+    for (int id = 0; id < 50; id++) {
+        insertData(file, id, "saved");
+    }
+    saveFileToDisk(file, path);
+    CHECK(enableWriteAheadLog(file));
+
+    insertData(file, 50, "logged");
+    CHECK(updateRecord(file, 10, "updated"));
+    CHECK(deleteRecord(file, 20));
+    CHECK(commitFile(file));
+
+    // Opened as if after a crash: the data file never saw these changes
+    SequentialFile *reopened = loadFileFromDisk(path);
+    CHECK(reopened != NULL);
+    if (reopened) {
+        Record *record = searchRecord(reopened, 50);
+        CHECK(record && strcmp(record->data, "logged") == 0);
+        record = searchRecord(reopened, 10);
+        CHECK(record && strcmp(record->data, "updated") == 0);
+        CHECK(searchRecord(reopened, 20) == NULL);
+        record = searchRecord(reopened, 30);
+        CHECK(record && strcmp(record->data, "saved") == 0);
+        freeFile(reopened);
+    }
+    freeFile(file);
+    deleteFileFromDisk(path);
+}
+
+// A flush is a checkpoint: the log starts over, and changes after it are
+// replayed on top of the flushed file
+static void testCheckpoint(void) {
+    SequentialFile *file = initializeFile(256, 0, 0, 0, 0);
+    for (int id = 0; id < 50; id++) {
+        insertData(file, id, "saved");
+    }
+    saveFileToDisk(file, path);
+    CHECK(enableWriteAheadLog(file));
+
+    for (int id = 50; id < 100; id++) {
+        insertData(file, id, "flushed");
+    }
+    CHECK(flushFileToDisk(file, path, 1));
+    CHECK(countRecords(file->log) == 0);
+
+    CHECK(deleteRecord(file, 0));
+    insertData(file, 100, "logged");
+    CHECK(commitFile(file));
+    CHECK(countRecords(file->log) == 2);
+
+    SequentialFile *reopened = loadFileFromDisk(path);
+    CHECK(reopened != NULL);
+    if (reopened) {
+        CHECK(searchRecord(reopened, 0) == NULL);
+        Record *record = searchRecord(reopened, 75);
+        CHECK(record && strcmp(record->data, "flushed") == 0);
+        record = searchRecord(reopened, 100);
+        CHECK(record && strcmp(record->data, "logged") == 0);
+        freeFile(reopened);
+    }
+    freeFile(file);
+    deleteFileFromDisk(path);
+}
+
+int main(void) {
+    quietLibrary();
+    snprintf(path, sizeof(path), "/tmp/test_wal_%d.bin", (int)getpid());
+    snprintf(logPath, sizeof(logPath), "%s.wal", path);
+    testRecords();
+    testTornTail();
+    testReplay();
+    testCheckpoint();
+    return checkResult("wal");
+}